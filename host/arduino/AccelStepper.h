@@ -0,0 +1,118 @@
+#pragma once
+
+// Host model of AccelStepper.  Steps are only ever taken from inside `run()`,
+// so a late `run()` call delays (rather than catches up) the step, exactly as
+// on the device.  Acceleration follows the same trapezoidal profile shape.
+// Steps go through the library's virtual step()/step4()/step8() to the coil
+// pattern, and a model rotor follows the coils: it turns to the nearest phase
+// of the eight, so a pattern more than two phases away is counted as a phase
+// error (a lost or reversed step on the device).
+
+#include <Arduino.h>
+
+class AccelStepper {
+ public:
+  enum MotorInterfaceType {
+    FUNCTION = 0,
+    DRIVER = 1,
+    FULL2WIRE = 2,
+    FULL3WIRE = 3,
+    FULL4WIRE = 4,
+    HALF3WIRE = 6,
+    HALF4WIRE = 8
+  };
+
+  AccelStepper(uint8_t interface = FULL4WIRE, uint8_t = 2, uint8_t = 3, uint8_t = 4, uint8_t = 5, bool = true)
+      : interface_(interface) {}
+
+  void moveTo(long absolute) { target_ = absolute; }
+  void move(long relative) { moveTo(position_ + relative); }
+  long distanceToGo() const { return target_ - position_; }
+  long targetPosition() const { return target_; }
+  long currentPosition() const { return position_; }
+  void setCurrentPosition(long position) {
+    position_ = target_ = position;
+    speed_ = 0;
+  }
+  void setMaxSpeed(float speed) { max_speed_ = speed > 0 ? speed : 0; }
+  float maxSpeed() const { return max_speed_; }
+  void setAcceleration(float acceleration) { acceleration_ = acceleration; }
+  float acceleration() const { return acceleration_; }
+  float speed() const { return speed_; }
+  bool isRunning() const { return distanceToGo() != 0; }
+  void stop() { moveTo(position_ + (speed_ > 0 ? 1 : speed_ < 0 ? -1 : 0)); }
+
+  bool run() {
+    sim::charge(run_cost_us);
+    const long dist = distanceToGo();
+    if (dist == 0 || max_speed_ <= 0) {
+      speed_ = 0;
+      return false;
+    }
+    const int dir = dist > 0 ? 1 : -1;
+    if (speed_ * dir <= 0) {  // Starting, or reversing
+      speed_ = dir * std::min<float>(max_speed_, 0.676f * std::sqrt(2.0f * acceleration_));
+      last_step_us_ = sim::now_us;
+      return true;
+    }
+    const uint64_t interval_us = static_cast<uint64_t>(1e6f / std::fabs(speed_));
+    if (sim::now_us - last_step_us_ < interval_us) return true;
+    // Step, then pick the next speed: limited by max speed, acceleration and
+    // the distance left to stop in.
+    last_step_us_ = sim::now_us;
+    position_ += dir;
+    ++steps_taken;
+    step(position_);
+    if (distanceToGo() == 0) {  // Arrived: as AccelStepper, start afresh next move
+      speed_ = 0;
+      return false;
+    }
+    const float v = std::fabs(speed_);
+    const float stop_v = std::sqrt(2.0f * acceleration_ * std::abs(distanceToGo()));
+    speed_ = dir * std::min({max_speed_, v + acceleration_ / v, std::max(stop_v, 1.0f)});
+    return distanceToGo() != 0;
+  }
+
+  uint8_t interface() const { return interface_; }
+
+  uint64_t steps_taken = 0;
+  uint32_t run_cost_us = 8;
+  long rotor_half_steps = 0;  // Rotor angle from the coils
+  uint32_t phase_errors = 0;
+
+ protected:
+  virtual void step(long step) {
+    if (interface_ == HALF4WIRE) {
+      step8(step);
+    } else {
+      step4(step);
+    }
+  }
+  virtual void step4(long step) {
+    static const uint8_t kPins[4] = {0b0101, 0b0110, 0b1010, 0b1001};
+    setOutputPins(kPins[step & 0x3]);
+  }
+  virtual void step8(long step) { setOutputPins(kHalfPins[step & 0x7]); }
+  virtual void setOutputPins(uint8_t mask) {
+    int phase = 0;
+    while (phase < 8 && kHalfPins[phase] != mask) ++phase;
+    int delta = (phase - phase_ + 8) % 8;
+    if (delta > 4) delta -= 8;
+    if (std::abs(delta) > 2) ++phase_errors;
+    rotor_half_steps += delta;
+    phase_ = phase;
+  }
+
+ private:
+  static constexpr uint8_t kHalfPins[8] = {0b0001, 0b0101, 0b0100, 0b0110,
+                                           0b0010, 0b1010, 0b1000, 0b1001};
+
+  int phase_ = 1;  // step4(0), where the rotor starts
+  uint8_t interface_;
+  long position_ = 0;
+  long target_ = 0;
+  float speed_ = 0;
+  float max_speed_ = 1;
+  float acceleration_ = 1;
+  uint64_t last_step_us_ = 0;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+// Minimal host-side stand-in for the Arduino core, just enough to compile the
+// firmware headers in ../master on Linux.  Time is virtual: nothing advances
+// unless the simulator (or a shim that models a slow call) charges for it.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define F(s) (s)
+
+// NodeMCU pin names
+enum : uint8_t { D0 = 16, D1 = 5, D2 = 4, D3 = 0, D4 = 2, D5 = 14, D6 = 12, D7 = 13, D8 = 15, TX = 1, RX = 3 };
+
+namespace sim {
+
+// Virtual clock, in microseconds.  thread_local so that independent robots can
+// be simulated on separate threads.
+inline thread_local uint64_t now_us = 0;
+
+// Charge `us` of (modelled) CPU time to the virtual clock.
+inline void charge(uint64_t us) { now_us += us; }
+
+// While nonzero, host CPU time passes on the virtual clock too, times this
+// factor (the device is slower), for code nothing else charges for: the clock
+// catches up whenever it is read.
+inline thread_local double host_time_scale = 0;
+inline thread_local std::chrono::steady_clock::time_point host_time_mark;
+
+inline void chargeHostTime(double scale) {
+  host_time_scale = scale;
+  host_time_mark = std::chrono::steady_clock::now();
+}
+inline uint64_t clock() {
+  if (host_time_scale > 0) {
+    const auto now = std::chrono::steady_clock::now();
+    now_us += std::chrono::duration<double, std::micro>(now - host_time_mark).count() *
+              host_time_scale;
+    host_time_mark = now;
+  }
+  return now_us;
+}
+
+}  // namespace sim
+
+inline unsigned long millis() { return sim::clock() / 1000; }
+inline unsigned long micros() { return sim::clock(); }
+inline void delay(unsigned long ms) { sim::charge(ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { sim::charge(us); }
+inline void yield() {}
+
+class String : public std::string {
+ public:
+  using std::string::string;
+  String() = default;
+  String(const std::string& s) : std::string(s) {}
+};
+inline String operator+(const char* lhs, const String& rhs) {
+  return String(std::string(lhs) + static_cast<const std::string&>(rhs));
+}
+
+class IPAddress {
+ public:
+  String toString() const { return "127.0.0.1"; }
+};
+
+// Stand-in for the ESP8266 core's `ESP` object.
+class EspClass {
+ public:
+  uint32_t getFreeHeap() const { return 40000; }
+  // The bootloader copies in a committed update, if its eboot command
+  // survived, and clears the command.
+  void restart() {
+    ++restarts;
+    if (ebootCommandValid()) {
+      ++updates_applied;
+      memset(rtc_memory, 0, kEbootBytes);
+    }
+  }
+  uint32_t getSketchSize() const { return running_image.size(); }
+  uint32_t getFreeSketchSpace() const { return 0x100000 - ((running_image.size() + 0xFFF) & ~0xFFFu); }
+  // Reads from `running_image`, which stands in for the start of flash.
+  bool flashRead(uint32_t address, uint8_t* data, size_t size) const {
+    if (address > running_image.size() || size > running_image.size() - address) return false;
+    memcpy(data, running_image.data() + address, size);
+    return true;
+  }
+
+  // RTC user memory: 512 bytes that survive a reset.  Offsets are in 4-byte
+  // blocks.
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) const {
+    if (offset * 4 + size > sizeof(rtc_memory)) return false;
+    memcpy(data, rtc_memory + offset * 4, size);
+    return true;
+  }
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > sizeof(rtc_memory)) return false;
+    memcpy(rtc_memory + offset * 4, data, size);
+    return true;
+  }
+
+  // Update.end() leaves the eboot command for the bootloader in the first 32
+  // blocks of RTC user memory; anything the firmware keeps there is lost.
+  static constexpr size_t kEbootBytes = 128;
+  void ebootCommandWrite() {
+    for (size_t i = 0; i < kEbootBytes; ++i) rtc_memory[i] = 0xEB ^ i;
+  }
+  bool ebootCommandValid() const {
+    for (size_t i = 0; i < kEbootBytes; ++i) {
+      if (rtc_memory[i] != (0xEB ^ i)) return false;
+    }
+    return true;
+  }
+
+  int restarts = 0;
+  int updates_applied = 0;
+  std::string running_image;  // The firmware "currently in flash"
+  uint8_t rtc_memory[512] = {};
+};
+inline EspClass ESP;
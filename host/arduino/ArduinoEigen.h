@@ -0,0 +1,7 @@
+#pragma once
+
+// Arduino's F() macro collides with Eigen's template parameter names.
+#pragma push_macro("F")
+#undef F
+#include <Eigen/Dense>
+#pragma pop_macro("F")
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Updater.h>
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+ public:
+  using THandlerFunction = std::function<void()>;
+  using THandlerFunction_Progress = std::function<void(unsigned int, unsigned int)>;
+  using THandlerFunction_Error = std::function<void(ota_error_t)>;
+
+  void setPort(uint16_t) {}
+  void setHostname(const char*) {}
+  void setPassword(const char*) {}
+  void setPasswordHash(const char*) {}
+  void onStart(THandlerFunction fn) { on_start = fn; }
+  void onEnd(THandlerFunction fn) { on_end = fn; }
+  void onProgress(THandlerFunction_Progress fn) { on_progress = fn; }
+  void onError(THandlerFunction_Error fn) { on_error = fn; }
+  void begin() { begun = true; }
+  void handle() { sim::charge(handle_cost_us); }
+  int getCommand() const { return U_FLASH; }
+
+  THandlerFunction on_start, on_end;
+  THandlerFunction_Progress on_progress;
+  THandlerFunction_Error on_error;
+  bool begun = false;
+  uint32_t handle_cost_us = 40;  // mDNS + UDP poll
+};
+inline ArduinoOTAClass ArduinoOTA;
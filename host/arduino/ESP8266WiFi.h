@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+};
+
+// Fake station interface.  `connect_after_us` models how long the access point
+// takes to answer after `begin()`, and it only answers at all from `ap_up_us`
+// (virtual time) on: an attempt made while it is down connects once it is up
+// and has answered.  `drop()` loses the link until the next `begin()`.
+class WiFiClass {
+ public:
+  bool mode(WiFiMode_t) { return true; }
+  bool hostname(const char*) { return true; }
+  wl_status_t begin(const char*, const char*) {
+    begin_us_ = sim::now_us;
+    ++begins;
+    return status();
+  }
+  bool disconnect(bool = false) {
+    begin_us_ = UINT64_MAX;
+    ++disconnects;
+    return true;
+  }
+  void drop() { begin_us_ = UINT64_MAX; }
+  wl_status_t status() const {
+    return begin_us_ != UINT64_MAX &&
+                   sim::now_us >= std::max(begin_us_, ap_up_us) + connect_after_us
+               ? WL_CONNECTED
+               : WL_DISCONNECTED;
+  }
+  uint8_t waitForConnectResult(unsigned long timeout_ms = 60000) {
+    uint64_t waited = 0;
+    while (status() != WL_CONNECTED && waited < timeout_ms * 1000ull) {
+      sim::charge(1000);
+      waited += 1000;
+    }
+    return status();
+  }
+  bool isConnected() const { return status() == WL_CONNECTED; }
+  IPAddress localIP() const { return {}; }
+
+  uint64_t connect_after_us = 1500000;
+  uint64_t ap_up_us = 0;
+  int begins = 0;
+  int disconnects = 0;
+
+ private:
+  uint64_t begin_us_ = UINT64_MAX;
+};
+inline WiFiClass WiFi;
@@ -0,0 +1,225 @@
+#pragma once
+
+// Host stand-in for ESPAsyncWebServer.  Routes are recorded so the simulator
+// can issue requests (`get`, `upload`) and read back what the firmware sent.
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <Arduino.h>
+
+enum WebRequestMethod : uint8_t { HTTP_GET = 0b01, HTTP_POST = 0b10, HTTP_ANY = 0b11 };
+
+class AsyncWebServerRequest;
+using ArRequestHandlerFunction = std::function<void(AsyncWebServerRequest*)>;
+using ArUploadHandlerFunction = std::function<void(AsyncWebServerRequest*, String filename, size_t index,
+                                                   uint8_t* data, size_t len, bool final)>;
+using AwsResponseFiller = std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)>;
+
+class AsyncWebServerResponse {
+ public:
+  void addHeader(const char* name, const char* value) { headers.emplace_back(name, value); }
+
+  int code = 200;
+  std::string content_type;
+  std::string content;
+  AwsResponseFiller filler;  // Set for chunked responses
+  std::vector<std::pair<std::string, std::string>> headers;
+};
+
+class AsyncWebParameter {
+ public:
+  AsyncWebParameter(std::string value) : value_(std::move(value)) {}
+  const String& value() const { return value_; }
+
+ private:
+  String value_;
+};
+
+class AsyncWebServerRequest {
+ public:
+  explicit AsyncWebServerRequest(std::map<std::string, std::string> params = {}) {
+    for (auto& [k, v] : params) params_.emplace(k, AsyncWebParameter(v));
+  }
+
+  void send(int code, const char* content_type = "", const char* content = "") {
+    response_ = std::make_unique<AsyncWebServerResponse>();
+    response_->code = code;
+    response_->content_type = content_type;
+    response_->content = content;
+  }
+  void send(int code, const char* content_type, const String& content) { send(code, content_type, content.c_str()); }
+  void send(AsyncWebServerResponse* response) { response_.reset(response); }
+  void redirect(const char* url) {
+    send(302);
+    response_->addHeader("Location", url);
+  }
+  AsyncWebServerResponse* beginChunkedResponse(const char* content_type, AwsResponseFiller filler) {
+    auto* response = new AsyncWebServerResponse();
+    response->content_type = content_type;
+    response->filler = filler;
+    return response;
+  }
+  // Basic authentication against what the simulator set in `user` and
+  // `password`.
+  bool authenticate(const char* username, const char* pass, const char* realm = nullptr,
+                    bool passwordIsHash = false) const {
+    (void)realm;
+    (void)passwordIsHash;
+    return user == username && password == pass;
+  }
+  void requestAuthentication(const char* realm = nullptr, bool isDigest = true) {
+    (void)realm;
+    (void)isDigest;
+    send(401);
+    response_->addHeader("WWW-Authenticate", "Basic realm=\"Login Required\"");
+  }
+  bool hasParam(const char* name) const { return params_.count(name) != 0; }
+  const AsyncWebParameter* getParam(const char* name) const {
+    auto it = params_.find(name);
+    return it == params_.end() ? nullptr : &it->second;
+  }
+
+  // Simulator side: the credentials sent with the request.
+  std::string user, password;
+
+  // Simulator side: drain the response body, `chunk` bytes at a time.
+  std::string body(size_t chunk = 1024) {
+    if (!response_) return {};
+    if (!response_->filler) return response_->content;
+    std::string out;
+    std::vector<uint8_t> buf(chunk);
+    size_t n;
+    while ((n = response_->filler(buf.data(), buf.size(), out.size())) > 0) {
+      out.append(reinterpret_cast<char*>(buf.data()), n);
+    }
+    return out;
+  }
+  const AsyncWebServerResponse* response() const { return response_.get(); }
+
+ private:
+  std::map<std::string, AsyncWebParameter> params_;
+  std::unique_ptr<AsyncWebServerResponse> response_;
+};
+
+class AsyncWebHandler {};
+class AsyncCallbackWebHandler : public AsyncWebHandler {};
+
+// WebSockets: the simulator connects clients, sends them text, and reads back
+// every message the firmware pushed.
+enum AwsEventType { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA };
+enum AwsFrameType : uint8_t { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 8, WS_PING, WS_PONG };
+
+struct AwsFrameInfo {
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+};
+
+class AsyncWebSocketClient {
+ public:
+  explicit AsyncWebSocketClient(uint32_t id) : id_(id) {}
+  uint32_t id() const { return id_; }
+
+  std::vector<std::string> received;  // Simulator side: messages sent to it
+  size_t bytes_received = 0;
+
+ private:
+  uint32_t id_;
+};
+
+class AsyncWebSocket : public AsyncWebHandler {
+ public:
+  using AwsEventHandler = std::function<void(AsyncWebSocket*, AsyncWebSocketClient*, AwsEventType,
+                                             void*, uint8_t*, size_t)>;
+
+  explicit AsyncWebSocket(const String& url) : url_(url) {}
+  void onEvent(AwsEventHandler handler) { handler_ = handler; }
+  size_t count() const { return clients_.size(); }
+  void cleanupClients(uint16_t = 8) {}
+  bool availableForWriteAll() { return true; }
+  void binaryAll(uint8_t* message, size_t len) {
+    sim::charge(len * us_per_byte);
+    for (auto& client : clients_) {
+      client->received.emplace_back(reinterpret_cast<const char*>(message), len);
+      client->bytes_received += len;
+    }
+  }
+  void textAll(const char* message) { binaryAll((uint8_t*)message, strlen(message)); }
+
+  // Simulator side.
+  AsyncWebSocketClient* connect() {
+    clients_.push_back(std::make_unique<AsyncWebSocketClient>(next_id_++));
+    if (handler_) handler_(this, clients_.back().get(), WS_EVT_CONNECT, nullptr, nullptr, 0);
+    return clients_.back().get();
+  }
+  void disconnect(AsyncWebSocketClient* client) {
+    if (handler_) handler_(this, client, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+    clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                  [&](const auto& c) { return c.get() == client; }),
+                   clients_.end());
+  }
+  void send(AsyncWebSocketClient* client, std::string text) {
+    AwsFrameInfo info{WS_TEXT, 0, 1, 1, WS_TEXT, text.size(), {}, 0};
+    if (handler_) {
+      handler_(this, client, WS_EVT_DATA, &info, reinterpret_cast<uint8_t*>(text.data()), text.size());
+    }
+  }
+
+  uint32_t us_per_byte = 2;  // Same model as WebSerial, which is a WebSocket too
+
+ private:
+  String url_;
+  AwsEventHandler handler_;
+  std::vector<std::unique_ptr<AsyncWebSocketClient>> clients_;
+  uint32_t next_id_ = 1;
+};
+
+class AsyncWebServer {
+ public:
+  explicit AsyncWebServer(uint16_t port) : port_(port) {}
+
+  void begin() { begun = true; }
+  AsyncCallbackWebHandler& on(const char* uri, WebRequestMethod method, ArRequestHandlerFunction on_request,
+                              ArUploadHandlerFunction on_upload = nullptr) {
+    routes_[{uri, method}] = {on_request, on_upload};
+    return handler_;
+  }
+  void onNotFound(ArRequestHandlerFunction fn) { not_found_ = fn; }
+  AsyncWebHandler& addHandler(AsyncWebHandler* handler) { return *handler; }
+
+  // Simulator side: issue a GET and return the request (holding the response).
+  std::unique_ptr<AsyncWebServerRequest> get(const std::string& uri, std::map<std::string, std::string> params = {}) {
+    auto request = std::make_unique<AsyncWebServerRequest>(std::move(params));
+    auto it = routes_.find({uri, HTTP_GET});
+    if (it != routes_.end()) {
+      it->second.first(request.get());
+    } else if (not_found_) {
+      not_found_(request.get());
+    }
+    return request;
+  }
+  // Simulator side: deliver one multipart upload chunk.
+  void uploadChunk(AsyncWebServerRequest* request, const std::string& uri, size_t index, std::string data,
+                   bool final) {
+    auto it = routes_.find({uri, HTTP_POST});
+    if (it == routes_.end() || !it->second.second) return;
+    it->second.second(request, "upload.gcode", index, reinterpret_cast<uint8_t*>(data.data()), data.size(), final);
+    if (final) it->second.first(request);
+  }
+
+  bool begun = false;
+
+ private:
+  uint16_t port_;
+  std::map<std::pair<std::string, WebRequestMethod>, std::pair<ArRequestHandlerFunction, ArUploadHandlerFunction>>
+      routes_;
+  ArRequestHandlerFunction not_found_;
+  AsyncCallbackWebHandler handler_;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+// In-memory stand-in for the ESP8266 LittleFS filesystem.
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <Arduino.h>
+
+class File {
+ public:
+  File() = default;
+  File(std::shared_ptr<std::vector<uint8_t>> data, bool append) : data_(std::move(data)) {
+    if (append) pos_ = data_->size();
+  }
+
+  explicit operator bool() const { return data_ != nullptr; }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  size_t position() const { return pos_; }
+  int available() const { return data_ ? static_cast<int>(data_->size() - pos_) : 0; }
+  bool seek(uint32_t pos) {
+    if (!data_ || pos > data_->size()) return false;
+    pos_ = pos;
+    return true;
+  }
+  size_t read(uint8_t* buf, size_t len) {
+    if (!data_) return 0;
+    len = std::min(len, data_->size() - pos_);
+    memcpy(buf, data_->data() + pos_, len);
+    pos_ += len;
+    return len;
+  }
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  size_t write(const uint8_t* buf, size_t len) {
+    if (!data_) return 0;
+    if (data_->size() < pos_ + len) data_->resize(pos_ + len);
+    memcpy(data_->data() + pos_, buf, len);
+    pos_ += len;
+    return len;
+  }
+  size_t write(uint8_t c) { return write(&c, 1); }
+  void flush() {}
+  void close() { data_.reset(); }
+
+ private:
+  std::shared_ptr<std::vector<uint8_t>> data_;
+  size_t pos_ = 0;
+};
+
+class FS {
+ public:
+  bool begin() { return true; }
+  bool format() {
+    files_.clear();
+    return true;
+  }
+  File open(const char* path, const char* mode) {
+    auto it = files_.find(path);
+    if (mode[0] == 'r') {
+      return it == files_.end() ? File() : File(it->second, false);
+    }
+    if (it == files_.end() || mode[0] == 'w') {
+      it = files_.insert_or_assign(path, std::make_shared<std::vector<uint8_t>>()).first;
+    }
+    return File(it->second, mode[0] == 'a');
+  }
+  bool exists(const char* path) const { return files_.count(path) != 0; }
+  bool remove(const char* path) { return files_.erase(path) != 0; }
+  bool rename(const char* from, const char* to) {
+    auto it = files_.find(from);
+    if (it == files_.end()) return false;
+    files_[to] = it->second;
+    files_.erase(from);
+    return true;
+  }
+
+ private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files_;
+};
+inline FS LittleFS;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+
+class Servo {
+ public:
+  uint8_t attach(int pin) {
+    pin_ = pin;
+    return 0;
+  }
+  bool attached() const { return pin_ >= 0; }
+  void write(int angle) {
+    if (angle != angle_) last_change_us = sim::now_us;
+    angle_ = angle;
+  }
+  int read() const { return angle_; }
+
+  uint64_t last_change_us = 0;
+
+ private:
+  int pin_ = -1;
+  int angle_ = 90;
+};
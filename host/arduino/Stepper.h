@@ -0,0 +1,3 @@
+#pragma once
+
+// Unused on host; the firmware drives steppers through AccelStepper.
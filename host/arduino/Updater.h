@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef U_FLASH
+#define U_FLASH 0
+#define U_FS 100
+#endif
+
+// Stand-in for the ESP8266 core's Updater: collects the new image in memory.
+// `end()` commits only when every promised byte arrived (or `evenIfRemaining`),
+// like the real one; otherwise the update is discarded.
+class UpdaterClass {
+ public:
+  bool begin(size_t size, int command = U_FLASH) {
+    if (running_ || size == 0 || size > ESP.getFreeSketchSpace()) return false;
+    (void)command;
+    running_ = true;
+    size_ = size;
+    image.clear();
+    committed = false;
+    return true;
+  }
+  size_t write(uint8_t* data, size_t len) {
+    if (!running_ || image.size() + len > size_) return 0;
+    image.append(reinterpret_cast<const char*>(data), len);
+    return len;
+  }
+  bool end(bool evenIfRemaining = false) {
+    if (!running_) return false;
+    running_ = false;
+    if (image.size() < size_ && !evenIfRemaining) return false;
+    committed = true;
+    ESP.ebootCommandWrite();
+    return true;
+  }
+  bool runAsync(bool) { return true; }
+  bool isRunning() const { return running_; }
+  bool hasError() const { return false; }
+  size_t size() const { return size_; }
+  size_t remaining() const { return size_ - image.size(); }
+
+  std::string image;       // Bytes written so far
+  bool committed = false;  // Would boot into `image` after a restart
+
+ private:
+  bool running_ = false;
+  size_t size_ = 0;
+};
+inline UpdaterClass Update;
@@ -0,0 +1,54 @@
+#pragma once
+
+// Host stand-in for WebSerial: output goes to stdout (or nowhere), and the
+// simulator can inject incoming messages with `receive()`.
+
+#include <cstdarg>
+#include <iostream>
+
+#include <Arduino.h>
+
+class AsyncWebServer;
+
+class WebSerialClass {
+ public:
+  using RecvMsgHandler = std::function<void(uint8_t* data, size_t len)>;
+
+  void begin(AsyncWebServer*) {}
+  void onMessage(RecvMsgHandler handler) { handler_ = handler; }
+
+  size_t write(const uint8_t* data, size_t len) {
+    sim::charge(len * us_per_byte);
+    bytes_out += len;
+    if (echo) std::cout.write(reinterpret_cast<const char*>(data), len);
+    return len;
+  }
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t print(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+  size_t print(const std::string& s) { return write(reinterpret_cast<const uint8_t*>(s.data()), s.size()); }
+  size_t print(const IPAddress& ip) { return print(ip.toString()); }
+  template <typename T>
+  size_t println(const T& v) { return print(v) + print("\n"); }
+  size_t println() { return print("\n"); }
+  size_t printf(const char* fmt, ...) {
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return n > 0 ? write(reinterpret_cast<const uint8_t*>(buf), std::min<size_t>(n, sizeof(buf) - 1)) : 0;
+  }
+
+  // Simulator side: deliver a message as if typed into the WebSerial console.
+  void receive(std::string msg) {
+    if (handler_) handler_(reinterpret_cast<uint8_t*>(msg.data()), msg.size());
+  }
+
+  bool echo = true;
+  size_t bytes_out = 0;
+  uint32_t us_per_byte = 2;  // Rough cost of formatting + queueing on the ESP8266
+
+ private:
+  RecvMsgHandler handler_;
+};
+inline WebSerialClass WebSerial;
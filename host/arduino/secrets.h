@@ -0,0 +1,3 @@
+#pragma once
+
+// Host builds always use the STASSID/STAPSK placeholders from wifi.h.
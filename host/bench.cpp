@@ -0,0 +1,262 @@
+// Micro-benchmarks for the firmware hot paths, run natively on the host.
+//
+//   g++ -std=gnu++17 -O2 -Ihost/arduino -I/usr/include/eigen3 host/bench.cpp -o host/build/bench
+//   host/build/bench [--json out.json] [--compare baseline.json] [--threshold pct] [--filter substr]
+//
+// Each benchmark is warmed up, then timed over several repetitions; the median
+// ns/op is reported, with the fastest and slowest repetitions as its spread.
+// With --compare, a benchmark is flagged and the exit code is 1 only if it is
+// slower than the baseline by more than the threshold (default 10%) and by
+// more than either run's spread, and the two spreads don't overlap: a change
+// the repetitions themselves vary by is noise.
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "sim.h"
+
+namespace {
+
+// Keeps the compiler from optimizing away a benchmark's result.
+template <typename T>
+void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark {
+  const char* name;
+  std::function<void()> fn;
+  size_t ops_per_call = 1;
+};
+
+// ns/op: the median repetition, and the fastest and slowest.
+struct Timing {
+  double ns = 0, low = 0, high = 0;
+
+  // Spread, in percent of the median.
+  double noisePct() const { return ns > 0 ? 100 * (high - low) / ns : 0; }
+};
+
+// Times `benches` together: each is warmed up, then the repetitions take
+// turns, so that a machine slowing down part way through widens every
+// benchmark's spread instead of shifting one benchmark's median.
+std::vector<Timing> nsPerOp(const std::vector<Benchmark>& benches) {
+  using Clock = std::chrono::steady_clock;
+  constexpr auto kWarmup = std::chrono::milliseconds(50);
+  constexpr auto kRepetition = std::chrono::milliseconds(40);
+  constexpr int kRepetitions = 9;
+
+  // Warm up, and find how many calls fill one repetition.
+  std::vector<size_t> calls_per_rep;
+  for (const auto& bench : benches) {
+    size_t calls = 0;
+    const auto warmup_start = Clock::now();
+    while (Clock::now() - warmup_start < kWarmup) {
+      bench.fn();
+      ++calls;
+    }
+    calls_per_rep.push_back(std::max<size_t>(1, calls * kRepetition / kWarmup));
+  }
+
+  std::vector<std::vector<double>> samples(benches.size());
+  for (int rep = 0; rep < kRepetitions; ++rep) {
+    for (size_t b = 0; b < benches.size(); ++b) {
+      const auto start = Clock::now();
+      for (size_t i = 0; i < calls_per_rep[b]; ++i) benches[b].fn();
+      const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+      samples[b].push_back(elapsed.count() / (calls_per_rep[b] * benches[b].ops_per_call));
+    }
+  }
+  std::vector<Timing> timings;
+  for (auto& s : samples) {
+    std::sort(s.begin(), s.end());
+    timings.push_back({s[kRepetitions / 2], s.front(), s.back()});
+  }
+  return timings;
+}
+
+std::vector<Benchmark> benchmarks() {
+  static const std::string gcode = sim::readFile("gcode_files/I_am_DoodleBot.gcode");
+  static const std::string line = "G1 X65.6184240085996 Y15.075259289862196 F300";
+  static const State state{.x = 12.5, .y = -3.0, .cos = std::cos(0.3), .sin = std::sin(0.3)};
+  static std::array<GCommand, MAX_COMMANDS> program;
+  static char listing[32 * 1024];
+  static std::array<GCommand, MAX_COMMANDS> parsed;
+  static const size_t parsed_size = [] {
+    std::string_view sv = gcode;
+    size_t size = 0;
+    GCodeParser::parse(sv, parsed, size);
+    return size;
+  }();
+
+  return {
+      {"parse_float",
+       [] {
+         std::string_view sv = "65.6184240085996";
+         doNotOptimize(parseFloat<double>(sv));
+       }},
+      {"parse_line",
+       [] {
+         std::string_view sv = line;
+         size_t size = 0;
+         doNotOptimize(GCodeParser::parse(sv, program, size));
+       }},
+      {"parse_file",
+       [] {
+         std::string_view sv = gcode;
+         size_t size = 0;
+         doNotOptimize(GCodeParser::parse(sv, program, size));
+       }},
+      {"jacobians",
+       [] {
+         doNotOptimize(state_D_q(state));
+         doNotOptimize(pen_D_state(state));
+       }},
+      {"estimator_step",
+       [] {
+         Estimator est;
+         for (int i = 1; i <= 16; ++i) est.update(Q(0.5 * i, 0.4 * i));
+         doNotOptimize(est.state());
+       },
+       16},
+      {"controller_step",
+       [] {
+         static Controller ctrl;
+         ctrl.setSetpoint(Eigen::Vector2d(20, 10));
+         doNotOptimize(ctrl.getAction(state));
+       }},
+      // A pen-up move's search, per heading tried.
+      {"travel_heading",
+       [] {
+         static TravelSearch search;
+         doNotOptimize(search.solve(state, Eigen::Vector2d(-20, 10)).time_s);
+       },
+       TRAVEL_SAMPLES + 2 * TRAVEL_REFINE},
+      // The upload's statistics, per command of the bundled program.
+      {"analyze_command",
+       [] {
+         ProgramAnalysis analysis;
+         for (size_t i = 0; i < parsed_size; ++i) analysis.add(parsed[i]);
+         doNotOptimize(analysis.timeMs());
+       },
+       parsed_size},
+      // One listing line, the old way and the new.
+      {"line_snprintf",
+       [] {
+         char buf[64];
+         doNotOptimize(snprintf(buf, sizeof(buf), "%3u: LINEAR  (%.2f, %.2f)\n", 123u,
+                                65.6184240085996, -15.075259289862196));
+       }},
+      {"line_fixed",
+       [] {
+         char buf[64];
+         TextWriter out(buf, sizeof(buf));
+         out << Unsigned<3>(123) << ": LINEAR  (" << Fixed<2>(65.6184240085996) << ", "
+             << Fixed<2>(-15.075259289862196) << ")\n";
+         doNotOptimize(out.size());
+       }},
+      // One status update each way: the telemetry frame, and the '?' text
+      // dump as WebSerial sends it.
+      {"telemetry_frame",
+       [] {
+         TelemetryFrame frame = telemetryFrame();
+         doNotOptimize(frame);
+       }},
+      {"status_dump", [] { doNotOptimize(parseLine("?")); }},
+      {"program_listing",
+       [] {
+         static bool loaded = false;
+         if (!loaded) {
+           gcode_player.loadProgram(gcode);
+           loaded = true;
+         }
+         doNotOptimize(gcode_player.printProgram(listing, sizeof(listing), 0));
+       }},
+  };
+}
+
+// Reads the timings back out of a file written by --json.  Files from before
+// the spread was saved read as having none.
+std::map<std::string, Timing> readBaseline(const std::string& path) {
+  std::map<std::string, Timing> baseline;
+  const std::string json = sim::readFile(path);
+  size_t pos = 0;
+  while ((pos = json.find("\"name\":\"", pos)) != std::string::npos) {
+    pos += 8;
+    const size_t end = json.find('"', pos);
+    const std::string name = json.substr(pos, end - pos);
+    const size_t close = json.find('}', end);
+    auto field = [&](const char* key, double fallback) {
+      const std::string quoted = std::string("\"") + key + "\":";
+      const size_t at = json.find(quoted, end);
+      return at < close ? atof(json.c_str() + at + quoted.size()) : fallback;
+    };
+    Timing& timing = baseline[name];
+    timing.ns = field("ns_per_op", 0);
+    timing.low = field("low", timing.ns);
+    timing.high = field("high", timing.ns);
+    if (close == std::string::npos) break;
+    pos = close;
+  }
+  return baseline;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string json_path, baseline_path, filter;
+  double threshold_pct = 10;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--json") {
+      json_path = argv[i + 1];
+    } else if (flag == "--compare") {
+      baseline_path = argv[i + 1];
+    } else if (flag == "--threshold") {
+      threshold_pct = atof(argv[i + 1]);
+    } else if (flag == "--filter") {
+      filter = argv[i + 1];
+    } else {
+      fprintf(stderr, "Unknown flag %s\n", argv[i]);
+      return 1;
+    }
+  }
+  WebSerial.echo = false;
+  const auto baseline = baseline_path.empty() ? std::map<std::string, Timing>{}
+                                              : readBaseline(baseline_path);
+
+  std::string json = "{\"benchmarks\":[";
+  bool regressed = false;
+  printf("%-18s %12s %7s %12s %8s\n", "benchmark", "ns/op", "spread", "baseline", "change");
+  std::vector<Benchmark> selected;
+  for (auto& bench : benchmarks()) {
+    if (filter.empty() || std::string(bench.name).find(filter) != std::string::npos) {
+      selected.push_back(std::move(bench));
+    }
+  }
+  const std::vector<Timing> timings = nsPerOp(selected);
+  for (size_t b = 0; b < selected.size(); ++b) {
+    const Benchmark& bench = selected[b];
+    const Timing& now = timings[b];
+    printf("%-18s %12.1f %6.1f%%", bench.name, now.ns, now.noisePct());
+    auto it = baseline.find(bench.name);
+    if (it != baseline.end()) {
+      const Timing& before = it->second;
+      const double change_pct = 100 * (now.ns / before.ns - 1);
+      const double floor_pct = std::max({threshold_pct, now.noisePct(), before.noisePct()});
+      const bool slower = change_pct > floor_pct && now.low > before.high;
+      regressed |= slower;
+      printf(" %12.1f %+7.1f%%%s", before.ns, change_pct, slower ? "  REGRESSION" : "");
+    }
+    printf("\n");
+    char entry[160];
+    snprintf(entry, sizeof(entry),
+             "%s{\"name\":\"%s\",\"ns_per_op\":%.2f,\"low\":%.2f,\"high\":%.2f}",
+             json.back() == '[' ? "" : ",", bench.name, now.ns, now.low, now.high);
+    json += entry;
+  }
+  json += "]}\n";
+  if (!json_path.empty()) std::ofstream(json_path) << json;
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+// Splits one drawing among several robots sharing a sheet, writes a program
+// per robot, and simulates the whole fleet to check makespan and clearance.
+//
+//   g++ -std=gnu++17 -O2 -Ihost/arduino -I/usr/include/eigen3 host/fleet.cpp -o host/build/fleet
+//   host/build/fleet [--robots n] [--scale s] [--tol mm] [--margin mm] [-o dir] drawing.{svg,gcode}
+//
+// Strokes are cut into vertical bands of equal estimated time (ProgramAnalysis,
+// the player's own motion model).  Robot i starts with its pen at the
+// bottom-left of band i facing +x, and every robot sweeps its band left to
+// right, so neighbours stay about a band apart.  The simulation checks that
+// no two bodies (WIDTH x LENGTH, as axle-to-pen capsules) come within
+// `margin` of each other; where two would, the left one is held (pen up)
+// before the stroke it was drawing and the fleet is simulated again.
+//
+// The firmware is a set of globals, so each robot runs in its own forked
+// process rather than a thread; they all run at once.
+
+#include "sim.h"
+#include "svg.h"
+
+namespace {
+
+using Stroke = svg::Polyline;
+
+std::vector<Stroke> loadStrokes(const std::string& path, double scale, double tol) {
+  const std::string text = sim::readFile(path);
+  std::vector<Stroke> strokes;
+  if (path.size() > 4 && path.compare(path.size() - 4, 4, ".svg") == 0) {
+    strokes = svg::parse(text, tol / scale);
+  } else {
+    static std::array<GCommand, MAX_COMMANDS> program;
+    std::string_view sv = text;
+    size_t size = 0;
+    GCodeParser::parse(sv, program, size);
+    Eigen::Vector2d pos = Eigen::Vector2d::Zero();
+    bool pen_down = false;
+    auto begin = [&] { strokes.push_back({{pos.x(), pos.y()}}); };
+    for (size_t i = 0; i < size; ++i) {
+      const GCommand& cmd = program[i];
+      switch (cmd.type) {
+        case GCommand::RAPID:
+          pos = cmd.target;
+          if (pen_down) begin();
+          break;
+        case GCommand::LINEAR:
+          pos = cmd.target;
+          if (pen_down) strokes.back().push_back({pos.x(), pos.y()});
+          break;
+        case GCommand::PEN_DOWN:
+          if (!pen_down) begin();
+          pen_down = true;
+          break;
+        case GCommand::PEN_UP:
+          pen_down = false;
+          break;
+        case GCommand::HOME:
+          pos = Eigen::Vector2d::Zero();
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  for (auto& stroke : strokes) {
+    for (auto& p : stroke) p = {p.x * scale, p.y * scale};
+  }
+  strokes.erase(std::remove_if(strokes.begin(), strokes.end(),
+                               [](const Stroke& s) { return s.empty(); }),
+                strokes.end());
+  return strokes;
+}
+
+double minX(const Stroke& s) {
+  double x = INFINITY;
+  for (const auto& p : s) x = std::min(x, p.x);
+  return x;
+}
+
+// Estimated time of drawing `strokes` in order, from the analysis model.
+double estimateMs(const std::vector<Stroke>& strokes, svg::Point origin) {
+  ProgramAnalysis analysis;
+  auto add = [&](GCommand::Type type, svg::Point p = {0, 0}) {
+    GCommand cmd{type, Eigen::Vector2d(p.x - origin.x, p.y - origin.y), 0};
+    analysis.add(cmd);
+  };
+  for (const auto& stroke : strokes) {
+    add(GCommand::RAPID, stroke.front());
+    add(GCommand::PEN_DOWN);
+    for (size_t i = 1; i < stroke.size(); ++i) add(GCommand::LINEAR, stroke[i]);
+    add(GCommand::PEN_UP);
+  }
+  return analysis.timeMs();
+}
+
+struct RobotPlan {
+  svg::Point origin;  // Sheet position of the robot's home (pen) pose
+  std::vector<Stroke> strokes;
+  std::vector<uint32_t> hold_ms;  // Pen-up wait before each stroke
+  std::string gcode;
+  double est_ms = 0;  // Whole program, from the player's own model
+  std::vector<int> stroke_of;  // Program command index -> stroke
+};
+
+// The robot's program in its own frame: each stroke preceded by its hold,
+// then parked below the drawing, far enough down that no robot still drawing
+// can reach it.
+std::string programFor(RobotPlan& robot, double margin_mm) {
+  std::string out = "G21\nG90\n";
+  for (size_t s = 0; s < robot.strokes.size(); ++s) {
+    if (robot.hold_ms[s] > 0) out += "M5\nG4 P" + std::to_string(robot.hold_ms[s]) + "\n";
+    Stroke local = robot.strokes[s];
+    for (auto& p : local) p = {p.x - robot.origin.x, p.y - robot.origin.y};
+    const std::string gcode = svg::toGcode({local});
+    out += gcode.substr(8, gcode.size() - 8 - 3);  // Drop "G21 G90" and "M5"
+  }
+  char park[48];
+  snprintf(park, sizeof(park), "M5\nG0 X0 Y%.0f\n",
+           -(2 * Robot::length_mm + Robot::width_mm + margin_mm));
+  out += park;
+
+  static std::array<GCommand, MAX_COMMANDS> program;
+  std::string_view sv = out;
+  size_t size = 0;
+  GCodeParser::parse(sv, program, size);
+  robot.stroke_of.clear();
+  ProgramAnalysis analysis;
+  int stroke = -1;
+  for (size_t i = 0; i < size; ++i) {
+    stroke += program[i].type == GCommand::RAPID;
+    robot.stroke_of.push_back(std::max(stroke, 0));
+    analysis.add(program[i]);
+  }
+  robot.est_ms = analysis.timeMs();
+  return out;
+}
+
+// Pose samples from a simulated run, in the robot's own frame.
+struct Sample {
+  float x, y, cos, sin;
+  uint32_t index;  // Program command being run
+};
+constexpr uint64_t kSampleUs = 50000;
+
+std::string simulate(const std::string& gcode) {
+  sim::boot();
+  sim::upload(gcode);
+  gcode_player.play();
+  std::string out(sizeof(uint64_t), '\0');
+  uint64_t next_us = sim::now_us;
+  const uint64_t job_us = sim::runUntil(
+      [&] {
+        loop();
+        if (sim::now_us < next_us) return;
+        next_us += kSampleUs;
+        const State& s = estimator.state();
+        const Sample sample{float(s.x), float(s.y), float(s.cos), float(s.sin),
+                            uint32_t(gcode_player.index())};
+        out.append(reinterpret_cast<const char*>(&sample), sizeof(sample));
+      },
+      [] { return gcode_player.isFinished() && sim::stepsIdle(); }, 3600e6);
+  memcpy(out.data(), &job_us, sizeof(job_us));
+  return out;
+}
+
+double segmentDistance(Eigen::Vector2d p1, Eigen::Vector2d q1, Eigen::Vector2d p2,
+                       Eigen::Vector2d q2) {
+  auto pointSeg = [](Eigen::Vector2d p, Eigen::Vector2d a, Eigen::Vector2d b) {
+    const Eigen::Vector2d ab = b - a;
+    const double t = std::clamp((p - a).dot(ab) / std::max(ab.squaredNorm(), 1e-12), 0.0, 1.0);
+    return (a + t * ab - p).norm();
+  };
+  auto cross = [](Eigen::Vector2d a, Eigen::Vector2d b) { return a.x() * b.y() - a.y() * b.x(); };
+  const Eigen::Vector2d d1 = q1 - p1, d2 = q2 - p2;
+  const double denom = cross(d1, d2);
+  if (std::fabs(denom) > 1e-12) {
+    const double t = cross(p2 - p1, d2) / denom, u = cross(p2 - p1, d1) / denom;
+    if (t >= 0 && t <= 1 && u >= 0 && u <= 1) return 0;  // Crossing
+  }
+  return std::min({pointSeg(p1, p2, q2), pointSeg(q1, p2, q2), pointSeg(p2, p1, q1),
+                   pointSeg(q2, p1, q1)});
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t num_robots = 3;
+  double scale = 1, margin_mm = 20, tol = 0.25;
+  std::string dir = ".", path;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--robots" && i + 1 < argc) {
+      num_robots = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--scale" && i + 1 < argc) {
+      scale = atof(argv[++i]);
+    } else if (arg == "--tol" && i + 1 < argc) {
+      tol = atof(argv[++i]);
+    } else if (arg == "--margin" && i + 1 < argc) {
+      margin_mm = atof(argv[++i]);
+    } else if (arg == "-o" && i + 1 < argc) {
+      dir = argv[++i];
+    } else {
+      path = arg;
+    }
+  }
+  if (path.empty() || scale <= 0) {
+    fprintf(stderr, "usage: fleet [--robots n] [--scale s] [--tol mm] [--margin mm] [-o dir] drawing.{svg,gcode}\n");
+    return 1;
+  }
+  WebSerial.echo = false;
+
+  auto strokes = loadStrokes(path, scale, tol);
+  if (strokes.empty()) {
+    fprintf(stderr, "%s has no strokes\n", path.c_str());
+    return 1;
+  }
+  std::stable_sort(strokes.begin(), strokes.end(),
+                   [](const Stroke& a, const Stroke& b) { return minX(a) < minX(b); });
+  double min_y = INFINITY;
+  for (const auto& s : strokes) {
+    for (const auto& p : s) min_y = std::min(min_y, p.y);
+  }
+
+  // Cut the left-to-right stroke order where cumulative estimated time
+  // crosses each 1/n of the total.  Robots start side by side facing +x, so
+  // if any band is shorter than a body, try again with one robot fewer.
+  std::vector<double> cum;
+  svg::Point pos{minX(strokes.front()), min_y};
+  for (const auto& stroke : strokes) {
+    cum.push_back((cum.empty() ? 0 : cum.back()) + estimateMs({stroke}, pos));
+    pos = stroke.back();
+  }
+  const double min_band_mm = Robot::length_mm + Robot::width_mm + margin_mm;
+  std::vector<RobotPlan> robots;
+  for (size_t n = num_robots; n > 0 && robots.empty(); --n) {
+    robots.clear();
+    size_t begin = 0;
+    for (size_t r = 0; r < n && begin < strokes.size(); ++r) {
+      size_t end = begin;
+      const double goal = cum.back() * (r + 1) / n;
+      while (end < strokes.size() && (end == begin || cum[end - 1] < goal)) ++end;
+      if (r + 1 == n) end = strokes.size();
+      if (!robots.empty() && minX(strokes[begin]) - robots.back().origin.x < min_band_mm) break;
+      RobotPlan& robot = robots.emplace_back();
+      robot.origin = {minX(strokes[begin]), min_y};
+      robot.strokes.assign(strokes.begin() + begin, strokes.begin() + end);
+      robot.hold_ms.assign(end - begin, 0);
+      begin = end;
+    }
+    if (begin < strokes.size()) robots.clear();
+  }
+  if (robots.size() < num_robots) {
+    printf("Drawing too narrow for %zu robots %.0fmm apart; using %zu.\n", num_robots,
+           min_band_mm, robots.size());
+  }
+
+  for (size_t r = 0; r < robots.size(); ++r) robots[r].gcode = programFor(robots[r], margin_mm);
+
+  // Simulate every robot at once, then walk the tracks in lockstep checking
+  // body clearance; hold back a robot and retry until the fleet is clear.
+  constexpr int kMaxRounds = 100;
+  constexpr uint32_t kHoldStepMs = 1000;
+  std::vector<uint64_t> job_us;
+  std::vector<std::vector<Sample>> tracks;
+  double min_clear_mm = INFINITY;
+  int rounds = 0;
+  bool clear = false;
+  for (; rounds < kMaxRounds && !clear; ++rounds) {
+    std::vector<sim::Child> children;
+    for (const auto& robot : robots) {
+      children.push_back(sim::spawn([&] { return simulate(robot.gcode); }));
+    }
+    job_us.clear();
+    tracks.clear();
+    for (auto& child : children) {
+      const std::string out = child.wait();
+      if (out.size() < sizeof(uint64_t)) {
+        fprintf(stderr, "Robot simulation failed\n");
+        return 1;
+      }
+      job_us.push_back(*reinterpret_cast<const uint64_t*>(out.data()));
+      tracks.emplace_back((out.size() - sizeof(uint64_t)) / sizeof(Sample));
+      memcpy(tracks.back().data(), out.data() + sizeof(uint64_t),
+             tracks.back().size() * sizeof(Sample));
+    }
+
+    auto sample = [&](size_t r, size_t i) {
+      return tracks[r].empty() ? Sample{float(-Robot::length_unit), 0, 1, 0, 0}
+                               : tracks[r][std::min(i, tracks[r].size() - 1)];
+    };
+    auto body = [&](size_t r, size_t i) {
+      const Sample s = sample(r, i);
+      const Eigen::Vector2d origin(robots[r].origin.x, robots[r].origin.y);
+      const Eigen::Vector2d axle = origin + Eigen::Vector2d(s.x, s.y) * Robot::mm_per_unit;
+      const Eigen::Vector2d pen = axle + Eigen::Vector2d(s.cos, s.sin) * Robot::length_mm;
+      return std::pair{axle, pen};
+    };
+    size_t num_samples = 0;
+    for (const auto& track : tracks) num_samples = std::max(num_samples, track.size());
+    min_clear_mm = INFINITY;
+    clear = true;
+    for (size_t i = 0; i < num_samples && clear; ++i) {
+      for (size_t a = 0; a < robots.size() && clear; ++a) {
+        for (size_t b = a + 1; b < robots.size() && clear; ++b) {
+          const auto [axle_a, pen_a] = body(a, i);
+          const auto [axle_b, pen_b] = body(b, i);
+          const double clearance = segmentDistance(axle_a, pen_a, axle_b, pen_b) - Robot::width_mm;
+          min_clear_mm = std::min(min_clear_mm, clearance);
+          if (clearance >= margin_mm) continue;
+          clear = false;
+          // Hold the left robot, unless it is already parking.
+          auto strokeAt = [&](size_t r) {
+            const auto& stroke_of = robots[r].stroke_of;
+            return static_cast<size_t>(stroke_of[std::min<size_t>(sample(r, i).index, stroke_of.size() - 1)]);
+          };
+          const size_t r = strokeAt(a) < robots[a].strokes.size() ? a : b;
+          const size_t stroke = std::min(strokeAt(r), robots[r].strokes.size() - 1);
+          robots[r].hold_ms[stroke] += kHoldStepMs;
+          robots[r].gcode = programFor(robots[r], margin_mm);
+        }
+      }
+    }
+  }
+
+  for (size_t r = 0; r < robots.size(); ++r) {
+    const std::string out = dir + "/robot" + std::to_string(r) + ".gcode";
+    std::ofstream(out, std::ios::binary) << robots[r].gcode;
+    if (robots[r].stroke_of.size() >= MAX_COMMANDS) {
+      printf("warning: %s doesn't fit in the robot's %zu commands\n", out.c_str(), MAX_COMMANDS);
+    }
+  }
+  printf("%s on %zu robot(s), scale %.2f:\n", path.c_str(), robots.size(), scale);
+  printf("  %-6s %8s %8s %8s %9s %9s %9s\n", "robot", "start x", "strokes", "bytes", "est", "hold",
+         "sim");
+  uint64_t makespan_us = 0;
+  for (size_t r = 0; r < robots.size(); ++r) {
+    const auto& robot = robots[r];
+    uint32_t hold_ms = 0;
+    for (const uint32_t ms : robot.hold_ms) hold_ms += ms;
+    printf("  %-6zu %8.1f %8zu %8zu %8.1fs %8.1fs %8.1fs\n", r, robot.origin.x,
+           robot.strokes.size(), robot.gcode.size(), robot.est_ms / 1e3,
+           hold_ms / 1e3, job_us[r] / 1e6);
+    makespan_us = std::max(makespan_us, job_us[r]);
+  }
+  printf("makespan %.1fs (one robot drawing it all, estimated: %.1fs)\n", makespan_us / 1e6,
+         estimateMs(strokes, {minX(strokes.front()), min_y}) / 1e3);
+  if (robots.size() > 1) {
+    printf("min body clearance %.1fmm after %d round(s)%s\n", min_clear_mm, rounds,
+           clear ? "" : ", STILL COLLIDING");
+  }
+  return clear ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+// Packs firmware images into DBD files (master/ota_delta.h) for the /update
+// endpoint: compressed, or as a delta against the image the robot is running.
+//
+//   g++ -std=gnu++17 -O2 -Ihost/arduino host/otapack.cpp -o host/build/otapack
+//   host/build/otapack [--base running.bin] [-o out.dbd] new.bin
+//   host/build/otapack --test old.bin new.bin [old.bin new.bin ...]
+//
+// Every file written is first decoded with the firmware's own decoder and
+// compared against the input.  --test does that for each pair, both as a
+// plain compressed image and as a delta, and reports sizes and decode speed;
+// it also checks that corrupt and mismatched images are refused.
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "../master/ota_delta.h"
+#include "../master/step_stream.h"
+
+namespace {
+
+std::string readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Can't open %s\n", path.c_str());
+    exit(1);
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+size_t varintLen(uint32_t v) {
+  size_t n = 1;
+  while (v >= 0x80) v >>= 7, ++n;
+  return n;
+}
+
+uint32_t crcOf(const std::string& s) {
+  return ota_delta::crc32(0, reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+// Greedy LZ77 over two dictionaries: the last OTA_DELTA_WINDOW bytes of the
+// new image, and all of `src`.  Source matches near where the previous one
+// ended are cheap to encode, so code that merely moved stays a run of short
+// COPY_SRC ops.
+class Encoder {
+ public:
+  Encoder(const std::string& src, const std::string& out) : src_(src), out_(out) {}
+
+  std::string encode() {
+    OtaDeltaHeader header{};
+    memcpy(header.magic, OTA_DELTA_MAGIC, sizeof(header.magic));
+    header.out_size = out_.size();
+    header.src_size = src_.size();
+    header.src_crc = src_.empty() ? 0 : crcOf(src_);
+    header.out_crc = crcOf(out_);
+    body_.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    index(src_, src_head_, src_prev_, src_.size());
+    out_head_.assign(kHashSize, -1);
+    out_prev_.assign(out_.size(), -1);
+
+    size_t pos = 0, literal_start = 0;
+    while (pos < out_.size()) {
+      const Match match = best(pos);
+      if (match.gain <= 0) {
+        insert(pos++);
+        continue;
+      }
+      literal(literal_start, pos);
+      step_stream::putVarint(body_, match.len << 2 | match.kind);
+      if (match.kind == ota_delta::COPY_OUT) {
+        step_stream::putVarint(body_, pos - match.from);
+      } else {
+        step_stream::putVarint(body_, step_stream::zigzag(match.from - src_next_));
+        src_next_ = match.from + match.len;
+      }
+      for (size_t end = pos + match.len; pos < end;) insert(pos++);
+      literal_start = pos;
+    }
+    literal(literal_start, pos);
+    return body_;
+  }
+
+ private:
+  static constexpr size_t kHashBits = 16, kHashSize = 1 << kHashBits;
+  static constexpr int kMinMatch = 4, kChainDepth = 48;
+  static constexpr uint32_t kMaxLen = 1 << 20;
+
+  struct Match {
+    uint8_t kind = 0;
+    int64_t from = 0;
+    uint32_t len = 0;
+    long gain = 0;  // Bytes saved over sending literals
+  };
+
+  static uint32_t hash(const std::string& s, size_t i) {
+    uint32_t v;
+    memcpy(&v, s.data() + i, 4);
+    return (v * 2654435761u) >> (32 - kHashBits);
+  }
+
+  static void index(const std::string& s, std::vector<int32_t>& head, std::vector<int32_t>& prev,
+                    size_t n) {
+    head.assign(kHashSize, -1);
+    prev.assign(n, -1);
+    for (size_t i = 0; i + kMinMatch <= n; ++i) {
+      const uint32_t h = hash(s, i);
+      prev[i] = head[h];
+      head[h] = i;
+    }
+  }
+
+  void insert(size_t pos) {
+    if (pos + kMinMatch > out_.size()) return;
+    const uint32_t h = hash(out_, pos);
+    out_prev_[pos] = out_head_[h];
+    out_head_[h] = pos;
+  }
+
+  uint32_t matchLen(const std::string& dict, size_t from, size_t pos) const {
+    const size_t limit = std::min<size_t>({kMaxLen, out_.size() - pos, dict.size() - from});
+    uint32_t len = 0;
+    while (len < limit && dict[from + len] == out_[pos + len]) ++len;
+    return len;
+  }
+
+  void consider(Match& best, uint8_t kind, int64_t from, uint32_t len, size_t cost) const {
+    const long gain = static_cast<long>(len) - static_cast<long>(cost);
+    if (len >= kMinMatch && gain > best.gain) best = {kind, from, len, gain};
+  }
+
+  Match best(size_t pos) const {
+    Match best;
+    if (pos + kMinMatch > out_.size()) return best;
+    auto src_cost = [&](int64_t from, uint32_t len) {
+      return varintLen(len << 2) + varintLen(step_stream::zigzag(from - src_next_));
+    };
+    // Right where the last source copy left off: typical after a patched byte.
+    if (src_next_ < static_cast<int64_t>(src_.size())) {
+      const uint32_t len = matchLen(src_, src_next_, pos);
+      consider(best, ota_delta::COPY_SRC, src_next_, len, src_cost(src_next_, len));
+    }
+    if (!src_.empty()) {
+      int depth = 0;
+      for (int32_t from = src_head_[hash(out_, pos)]; from >= 0 && depth < kChainDepth;
+           from = src_prev_[from], ++depth) {
+        const uint32_t len = matchLen(src_, from, pos);
+        consider(best, ota_delta::COPY_SRC, from, len, src_cost(from, len));
+      }
+    }
+    int depth = 0;
+    for (int32_t from = out_head_[hash(out_, pos)];
+         from >= 0 && pos - from <= OTA_DELTA_WINDOW && depth < kChainDepth;
+         from = out_prev_[from], ++depth) {
+      // Overlapping copies are fine: the decoder goes byte by byte.
+      uint32_t len = 0;
+      while (pos + len < out_.size() && len < kMaxLen && out_[from + len] == out_[pos + len]) ++len;
+      consider(best, ota_delta::COPY_OUT, from, len, varintLen(len << 2) + varintLen(pos - from));
+    }
+    return best;
+  }
+
+  void literal(size_t begin, size_t end) {
+    if (begin == end) return;
+    step_stream::putVarint(body_, (end - begin) << 2 | ota_delta::LITERAL);
+    body_.append(out_, begin, end - begin);
+  }
+
+  const std::string& src_;
+  const std::string& out_;
+  std::vector<int32_t> src_head_, src_prev_, out_head_, out_prev_;
+  int64_t src_next_ = 0;
+  std::string body_;
+};
+
+struct Decoded {
+  bool committed;
+  std::string image;
+  const char* error;
+  double seconds;
+};
+
+// Feeds `dbd` to the firmware's decoder in upload-sized chunks, with `running`
+// standing in for the flash contents.
+Decoded decode(const std::string& dbd, const std::string& running, size_t chunk = 1436) {
+  ESP.running_image = running;
+  Update = UpdaterClass();
+  OtaDeltaDecoder decoder;
+  const auto start = std::chrono::steady_clock::now();
+  decoder.begin();
+  std::string data = dbd;
+  bool ok = true;
+  for (size_t i = 0; i < data.size() && ok; i += chunk) {
+    ok = decoder.write(reinterpret_cast<uint8_t*>(&data[i]), std::min(chunk, data.size() - i));
+  }
+  ok = ok && decoder.end();
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return {ok && Update.committed, Update.image, decoder.error(), seconds};
+}
+
+bool verify(const std::string& dbd, const std::string& running, const std::string& expected,
+            double* mb_per_s = nullptr) {
+  const Decoded result = decode(dbd, running);
+  if (!result.committed || result.image != expected) {
+    fprintf(stderr, "Decode check failed: %s\n", result.committed ? "image differs" : result.error);
+    return false;
+  }
+  if (mb_per_s) *mb_per_s = expected.size() / 1e6 / result.seconds;
+  return true;
+}
+
+int test(const std::vector<std::string>& paths) {
+  printf("%-24s %-24s %9s %9s %6s %9s %6s %9s %9s\n", "old", "new", "new B", "packed B", "%",
+         "delta B", "%", "pack MB/s", "delta MB/s");
+  bool ok = true;
+  for (size_t i = 0; i + 1 < paths.size(); i += 2) {
+    const std::string src = readFile(paths[i]), out = readFile(paths[i + 1]);
+    const std::string packed = Encoder("", out).encode();
+    const std::string delta = Encoder(src, out).encode();
+    double packed_speed = 0, delta_speed = 0;
+    ok &= verify(packed, src, out, &packed_speed);
+    ok &= verify(delta, src, out, &delta_speed);
+
+    // Must be refused: a delta applied to the wrong firmware, and a corrupt file.
+    std::string other = src;
+    other[other.size() / 2] ^= 1;
+    const bool wrong_base = decode(delta, other).committed;
+    std::string corrupt = packed;
+    corrupt[corrupt.size() - 1] ^= 0x55;
+    const bool corrupt_ok = decode(corrupt, src).committed;
+    if (wrong_base || corrupt_ok) {
+      fprintf(stderr, "%s: decoder accepted a %s image\n", paths[i + 1].c_str(),
+              wrong_base ? "mismatched" : "corrupt");
+      ok = false;
+    }
+
+    printf("%-24s %-24s %9zu %9zu %5.1f%% %9zu %5.1f%% %9.1f %9.1f\n", paths[i].c_str(),
+           paths[i + 1].c_str(), out.size(), packed.size(), 100.0 * packed.size() / out.size(),
+           delta.size(), 100.0 * delta.size() / out.size(), packed_speed, delta_speed);
+  }
+  printf("Decoder RAM: %zu B window + %zu B header/state\n", size_t{OTA_DELTA_WINDOW},
+         sizeof(OtaDeltaDecoder) - OTA_DELTA_WINDOW);
+  printf("%s\n", ok ? "All images decoded; bad images refused" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string base_path, out_path, in_path;
+  std::vector<std::string> test_paths;
+  bool testing = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--base" && i + 1 < argc) {
+      base_path = argv[++i];
+    } else if (arg == "-o" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--test") {
+      testing = true;
+    } else if (testing) {
+      test_paths.push_back(arg);
+    } else {
+      in_path = arg;
+    }
+  }
+  if (testing) {
+    if (test_paths.size() < 2 || test_paths.size() % 2 != 0) {
+      fprintf(stderr, "--test takes old/new image pairs\n");
+      return 1;
+    }
+    return test(test_paths);
+  }
+  if (in_path.empty()) {
+    fprintf(stderr, "usage: otapack [--base running.bin] [-o out.dbd] new.bin\n"
+                    "       otapack --test old.bin new.bin [old.bin new.bin ...]\n");
+    return 1;
+  }
+
+  const std::string out = readFile(in_path);
+  const std::string src = base_path.empty() ? "" : readFile(base_path);
+  const std::string dbd = Encoder(src, out).encode();
+  if (!verify(dbd, src, out)) return 1;
+  if (out_path.empty()) out_path = in_path + ".dbd";
+  std::ofstream(out_path, std::ios::binary) << dbd;
+  printf("%s: %zu -> %zu bytes (%.1f%%), %s\n", out_path.c_str(), out.size(), dbd.size(),
+         100.0 * dbd.size() / out.size(),
+         src.empty() ? "compressed" : ("delta against " + base_path).c_str());
+  return 0;
+}
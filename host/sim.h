@@ -0,0 +1,289 @@
+#pragma once
+
+// Host-side simulation harness: runs the real firmware (master/master.ino) on
+// a virtual clock with the stand-in libraries in host/arduino.
+//
+// The firmware is made of globals, so one process holds one robot.  Use
+// `sim::isolated()` to run independent experiments in forked children.
+
+#include <Arduino.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "../master/master.ino"
+
+namespace sim {
+
+inline std::string readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Can't open %s\n", path.c_str());
+    exit(1);
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// Modelled ESP8266 cost of one call to each scheduled task, on top of whatever
+// the stand-in libraries charge themselves (WebSerial output, OTA polling,
+// stepper `run()`).  Rough figures from timing the device with micros().
+struct TaskCost {
+  const char* name;
+  uint32_t us;
+};
+inline TaskCost kTaskCosts[] = {
+    {"motors", 250},  // Soft-float Eigen: estimator update + controller
+    {"ota", 0},
+    {"io", 20},
+    {"ui", 5},
+    {"wifi", 5},
+    {"telemetry", 5},  // Idle check; frames are charged per byte by the shim
+    {"snapshot", 60},  // Capture, compare and bitwise CRC; flash writes are rare
+};
+
+inline uint32_t taskCost(const char* name) {
+  for (const auto& cost : kTaskCosts) {
+    if (strcmp(cost.name, name) == 0) return cost.us;
+  }
+  return 0;
+}
+
+// Re-point every scheduler task at a trampoline that charges its modelled cost
+// to the virtual clock before calling the real task.
+inline std::array<Scheduler::TaskFn, MAX_TASKS> wrapped_fns;
+inline std::array<uint32_t, MAX_TASKS> wrapped_costs;
+template <size_t I>
+void chargedTask() {
+  charge(wrapped_costs[I]);
+  wrapped_fns[I]();
+}
+template <size_t... Is>
+void chargeTaskCosts(std::index_sequence<Is...>) {
+  constexpr Scheduler::TaskFn trampolines[] = {chargedTask<Is>...};
+  for (size_t i = 0; i < scheduler.numTasks(); ++i) {
+    Scheduler::Task& task = scheduler.task(i);
+    wrapped_fns[i] = task.fn;
+    wrapped_costs[i] = taskCost(task.name);
+    task.fn = trampolines[i];
+  }
+}
+
+// Boots the firmware: runs `setup()` with WebSerial output silenced (unless
+// `echo`), then wraps the scheduled tasks with their modelled costs.
+inline void boot(bool echo = false) {
+  WebSerial.echo = echo;
+  setup();
+  chargeTaskCosts(std::make_index_sequence<MAX_TASKS>{});
+}
+
+// Uploads `text` through the /upload endpoint in TCP-sized chunks, exactly as
+// the browser form would.
+inline void upload(const std::string& text, size_t chunk = 1436) {
+  AsyncWebServerRequest request;
+  for (size_t i = 0; i < text.size() || i == 0; i += chunk) {
+    server.uploadChunk(&request, "/upload", i, text.substr(i, chunk),
+                       i + chunk >= text.size());
+  }
+}
+
+// The old fixed `loop()`: every task once, round-robin, then the steppers.
+inline void legacyLoop() {
+  for (size_t i = 0; i < scheduler.numTasks(); ++i) scheduler.task(i).fn();
+  scheduler.serviceSteps();
+}
+
+// Runs `loop_fn` until `done()` or `max_us` of virtual time has elapsed.
+// Returns the virtual time spent.
+template <typename LoopFn, typename DoneFn>
+uint64_t runUntil(LoopFn loop_fn, DoneFn done, uint64_t max_us) {
+  const uint64_t start_us = now_us;
+  while (!done() && now_us - start_us < max_us) loop_fn();
+  return now_us - start_us;
+}
+
+struct CompileResult {
+  bool ok;
+  size_t stream_bytes;
+  uint32_t ticks;
+  uint64_t job_us;
+  long s1, s2;  // Final wheel positions
+  double pen_x, pen_y;
+};
+
+inline bool stepsIdle() {
+  return stepper1.distanceToGo() == 0 && stepper2.distanceToGo() == 0;
+}
+
+// Runs the program on the simulated firmware and records every wheel-target
+// change and pen event, at the minimum replan period, into a step stream.
+inline CompileResult compileSteps(const std::string& gcode, const std::string& out) {
+  const uint16_t kTickMs = std::max<uint32_t>(1, motion_params.min_replan_ms);
+  sim::boot();
+  sim::upload(gcode);
+  gcode_player.play();
+  const uint64_t start_us = sim::now_us;
+  const uint32_t first_tick = millis() / kTickMs + 1;
+  auto tick = [&] { return millis() / kTickMs - first_tick; };
+
+  step_stream::Writer writer(kTickMs);
+  long t1 = stepper1.targetPosition(), t2 = stepper2.targetPosition();
+  bool pen_down = servo_target == SERVO_DOWN_ANGLE;
+  sim::runUntil(
+      [&] {
+        loop();
+        if ((servo_target == SERVO_DOWN_ANGLE) != pen_down) {
+          pen_down = !pen_down;
+          writer.pen(tick(), pen_down);
+        }
+        if (stepper1.targetPosition() != t1 ||
+            stepper2.targetPosition() != t2) {
+          writer.step(tick(), stepper1.targetPosition() - t1,
+                      stepper2.targetPosition() - t2);
+          t1 = stepper1.targetPosition();
+          t2 = stepper2.targetPosition();
+        }
+      },
+      [] { return gcode_player.isFinished() && stepsIdle(); }, 3600e6);
+
+  estimator.update(Q(t1, t2) * Robot::units_per_step);
+  const State& state = estimator.state();
+  const uint32_t ticks = tick() + 1;
+  const std::string stream =
+      writer.finish(ticks, state.x, state.y, state.cos, state.sin);
+  std::ofstream(out, std::ios::binary) << stream;
+  const auto pen = state.pen();
+  return {gcode_player.isFinished(), stream.size(), ticks,
+          sim::now_us - start_us, t1, t2, pen(0), pen(1)};
+}
+
+// Whether the pen is physically down: servo at the down angle and done moving.
+inline bool penDown() {
+  return servo.read() == SERVO_DOWN_ANGLE &&
+         now_us - servo.last_change_us >= penSlewMs() * 1000ull;
+}
+
+// Pen-down segments of the loaded program, for measuring how far the drawn
+// path strays from the programmed one.
+class ProgramPath {
+ public:
+  explicit ProgramPath(const ProgramPlayer& player) {
+    Eigen::Vector2d pos = Eigen::Vector2d::Zero();
+    bool pen_down = false;
+    for (size_t i = 0; i < player.size(); ++i) {
+      const GCommand& cmd = player.command(i);
+      switch (cmd.type) {
+        case GCommand::LINEAR:
+          if (pen_down) segments_.emplace_back(pos, cmd.target);
+          pos = cmd.target;
+          break;
+        case GCommand::RAPID:
+          pos = cmd.target;
+          break;
+        case GCommand::HOME:
+          pos = Eigen::Vector2d::Zero();
+          break;
+        case GCommand::PEN_DOWN:
+          segments_.emplace_back(pos, pos);  // Dots count too
+          pen_down = true;
+          break;
+        case GCommand::PEN_UP:
+          pen_down = false;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  bool empty() const { return segments_.empty(); }
+
+  double distance(const Eigen::Vector2d& p) const {
+    double best = INFINITY;
+    for (const auto& [a, b] : segments_) {
+      const Eigen::Vector2d ab = b - a;
+      const double len2 = ab.squaredNorm();
+      const double t = len2 > 0 ? std::clamp((p - a).dot(ab) / len2, 0.0, 1.0) : 0.0;
+      best = std::min(best, (a + t * ab - p).norm());
+    }
+    return best;
+  }
+
+ private:
+  std::vector<std::pair<Eigen::Vector2d, Eigen::Vector2d>> segments_;
+};
+
+// Runs `fn` in a forked child and returns the POD it produces, so experiments
+// that mutate firmware globals don't leak into each other.
+template <typename Result, typename Fn>
+Result isolated(Fn fn) {
+  static_assert(std::is_trivially_copyable_v<Result>);
+  int fds[2];
+  if (pipe(fds) != 0) exit(1);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Result result = fn();
+    fflush(stdout);
+    if (write(fds[1], &result, sizeof(result)) != sizeof(result)) _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  Result result{};
+  if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+    fprintf(stderr, "Simulation child failed\n");
+  }
+  close(fds[0]);
+  waitpid(pid, nullptr, 0);
+  return result;
+}
+
+// A simulation running in a forked child; `wait()` collects the bytes it
+// returned.  Spawn several before waiting to run them on separate cores.
+class Child {
+ public:
+  Child(pid_t pid, int fd) : pid_(pid), fd_(fd) {}
+
+  std::string wait() {
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd_, buf, sizeof(buf))) > 0) out.append(buf, n);
+    close(fd_);
+    waitpid(pid_, nullptr, 0);
+    return out;
+  }
+
+ private:
+  pid_t pid_;
+  int fd_;
+};
+
+template <typename Fn>
+Child spawn(Fn fn) {
+  int fds[2];
+  if (pipe(fds) != 0) exit(1);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    const std::string result = fn();
+    fflush(stdout);
+    for (size_t off = 0; off < result.size();) {
+      const ssize_t n = write(fds[1], result.data() + off, result.size() - off);
+      if (n <= 0) _exit(1);
+      off += n;
+    }
+    _exit(0);
+  }
+  close(fds[1]);
+  return Child(pid, fds[0]);
+}
+
+}  // namespace sim
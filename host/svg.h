@@ -0,0 +1,493 @@
+#pragma once
+
+// Minimal SVG reader: turns <path>, <line>, <polyline>, <polygon>, <rect>,
+// <circle> and <ellipse> elements into polylines in millimetres (y up, like
+// G-code), honouring nested transforms and the root viewBox.  Curves are
+// flattened adaptively: Beziers are subdivided until their control points lie
+// within `tolerance_mm` of the chord, and arcs get as many segments as their
+// radius needs for the same sagitta.
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace svg {
+
+struct Point {
+  double x, y;
+};
+using Polyline = std::vector<Point>;
+
+struct Affine {
+  double a = 1, b = 0, c = 0, d = 1, e = 0, f = 0;
+
+  Point operator()(Point p) const { return {a * p.x + c * p.y + e, b * p.x + d * p.y + f}; }
+  Affine operator*(const Affine& o) const {
+    return {a * o.a + c * o.b, b * o.a + d * o.b, a * o.c + c * o.d,
+            b * o.c + d * o.d, a * o.e + c * o.f + e, b * o.e + d * o.f + f};
+  }
+  // Largest stretch the transform applies to any direction.
+  double maxScale() const {
+    const double s1 = a * a + b * b, s2 = c * c + d * d, cross = a * c + b * d;
+    const double mean = (s1 + s2) / 2, diff = (s1 - s2) / 2;
+    return std::sqrt(mean + std::sqrt(diff * diff + cross * cross));
+  }
+};
+
+namespace detail {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Pulls the next number out of path data / attribute lists, skipping
+// separators.  Handles "1.5.5" and "1-2" style run-together numbers.
+inline bool nextNumber(std::string_view& s, double& out) {
+  while (!s.empty() && (isspace(static_cast<unsigned char>(s.front())) || s.front() == ',')) {
+    s.remove_prefix(1);
+  }
+  if (s.empty()) return false;
+  const char c = s.front();
+  if (!(isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.')) return false;
+  size_t i = (c == '-' || c == '+') ? 1 : 0;
+  bool dot = false;
+  while (i < s.size() && (isdigit(static_cast<unsigned char>(s[i])) || (s[i] == '.' && !dot))) {
+    dot |= s[i] == '.';
+    ++i;
+  }
+  if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    size_t j = i + 1;
+    if (j < s.size() && (s[j] == '-' || s[j] == '+')) ++j;
+    if (j < s.size() && isdigit(static_cast<unsigned char>(s[j]))) {
+      i = j;
+      while (i < s.size() && isdigit(static_cast<unsigned char>(s[i]))) ++i;
+    }
+  }
+  out = strtod(std::string(s.substr(0, i)).c_str(), nullptr);
+  s.remove_prefix(i);
+  return true;
+}
+
+// Arc flags may be written without separators ("a1 1 0 01 5 5").
+inline bool nextFlag(std::string_view& s, double& out) {
+  while (!s.empty() && (isspace(static_cast<unsigned char>(s.front())) || s.front() == ',')) {
+    s.remove_prefix(1);
+  }
+  if (s.empty() || (s.front() != '0' && s.front() != '1')) return false;
+  out = s.front() - '0';
+  s.remove_prefix(1);
+  return true;
+}
+
+inline double distToLine(Point p, Point a, Point b) {
+  const double dx = b.x - a.x, dy = b.y - a.y;
+  const double len = std::hypot(dx, dy);
+  if (len < 1e-12) return std::hypot(p.x - a.x, p.y - a.y);
+  return std::fabs((p.x - a.x) * dy - (p.y - a.y) * dx) / len;
+}
+
+inline Point lerp(Point a, Point b, double t) { return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t}; }
+
+// Appends the cubic p0..p3 (already in output space), excluding p0.
+inline void flattenCubic(Polyline& out, Point p0, Point p1, Point p2, Point p3, double tol, int depth = 0) {
+  if (depth >= 16 || std::max(distToLine(p1, p0, p3), distToLine(p2, p0, p3)) <= tol) {
+    out.push_back(p3);
+    return;
+  }
+  const Point p01 = lerp(p0, p1, 0.5), p12 = lerp(p1, p2, 0.5), p23 = lerp(p2, p3, 0.5);
+  const Point p012 = lerp(p01, p12, 0.5), p123 = lerp(p12, p23, 0.5);
+  const Point mid = lerp(p012, p123, 0.5);
+  flattenCubic(out, p0, p01, p012, mid, tol, depth + 1);
+  flattenCubic(out, mid, p123, p23, p3, tol, depth + 1);
+}
+
+inline void flattenQuad(Polyline& out, Point p0, Point p1, Point p2, double tol, int depth = 0) {
+  if (depth >= 16 || distToLine(p1, p0, p2) <= tol) {
+    out.push_back(p2);
+    return;
+  }
+  const Point p01 = lerp(p0, p1, 0.5), p12 = lerp(p1, p2, 0.5), mid = lerp(p01, p12, 0.5);
+  flattenQuad(out, p0, p01, mid, tol, depth + 1);
+  flattenQuad(out, mid, p12, p2, tol, depth + 1);
+}
+
+// SVG endpoint arc (spec F.6.5), flattened in user space then transformed.
+inline void flattenArc(Polyline& out, const Affine& m, Point p1, double rx, double ry, double phi_deg,
+                       bool large, bool sweep, Point p2, double tol) {
+  rx = std::fabs(rx);
+  ry = std::fabs(ry);
+  if (rx < 1e-12 || ry < 1e-12) {
+    out.push_back(m(p2));
+    return;
+  }
+  const double phi = phi_deg * kPi / 180, cp = std::cos(phi), sp = std::sin(phi);
+  const double dx = (p1.x - p2.x) / 2, dy = (p1.y - p2.y) / 2;
+  const double x1 = cp * dx + sp * dy, y1 = -sp * dx + cp * dy;
+  const double lambda = x1 * x1 / (rx * rx) + y1 * y1 / (ry * ry);
+  if (lambda > 1) {
+    rx *= std::sqrt(lambda);
+    ry *= std::sqrt(lambda);
+  }
+  const double num = rx * rx * ry * ry - rx * rx * y1 * y1 - ry * ry * x1 * x1;
+  const double den = rx * rx * y1 * y1 + ry * ry * x1 * x1;
+  double coef = den > 0 ? std::sqrt(std::max(0.0, num / den)) : 0;
+  if (large == sweep) coef = -coef;
+  const double cx1 = coef * rx * y1 / ry, cy1 = -coef * ry * x1 / rx;
+  const double cx = cp * cx1 - sp * cy1 + (p1.x + p2.x) / 2;
+  const double cy = sp * cx1 + cp * cy1 + (p1.y + p2.y) / 2;
+  auto angle = [](double ux, double uy, double vx, double vy) {
+    return std::atan2(ux * vy - uy * vx, ux * vx + uy * vy);
+  };
+  const double theta = angle(1, 0, (x1 - cx1) / rx, (y1 - cy1) / ry);
+  double dtheta = angle((x1 - cx1) / rx, (y1 - cy1) / ry, (-x1 - cx1) / rx, (-y1 - cy1) / ry);
+  if (!sweep && dtheta > 0) dtheta -= 2 * kPi;
+  if (sweep && dtheta < 0) dtheta += 2 * kPi;
+
+  const double r = std::max(rx, ry) * m.maxScale();
+  const double step = tol >= r ? kPi / 2 : 2 * std::acos(1 - tol / r);
+  const int n = std::max(1, static_cast<int>(std::ceil(std::fabs(dtheta) / step)));
+  for (int i = 1; i < n; ++i) {
+    const double t = theta + dtheta * i / n;
+    const double ex = rx * std::cos(t), ey = ry * std::sin(t);
+    out.push_back(m({cp * ex - sp * ey + cx, sp * ex + cp * ey + cy}));
+  }
+  out.push_back(m(p2));
+}
+
+inline void parsePath(std::string_view d, const Affine& m, double tol, std::vector<Polyline>& out) {
+  Point cur{0, 0}, start{0, 0}, last_ctrl{0, 0};
+  char cmd = 0, prev_cmd = 0;
+  Polyline* line = nullptr;
+  auto moveTo = [&](Point p) {
+    out.emplace_back();
+    line = &out.back();
+    line->push_back(m(p));
+    cur = start = p;
+  };
+  auto ensureLine = [&] {
+    if (!line) moveTo(cur);
+  };
+
+  while (true) {
+    std::string_view rest = d;
+    while (!rest.empty() && (isspace(static_cast<unsigned char>(rest.front())) || rest.front() == ',')) {
+      rest.remove_prefix(1);
+    }
+    if (rest.empty()) break;
+    if (isalpha(static_cast<unsigned char>(rest.front()))) {
+      cmd = rest.front();
+      rest.remove_prefix(1);
+    } else if (!cmd) {
+      break;
+    }
+    d = rest;
+    const bool rel = islower(static_cast<unsigned char>(cmd));
+    const Point base = rel ? cur : Point{0, 0};
+    double v[7];
+    auto args = [&](int n) {
+      for (int i = 0; i < n; ++i) {
+        if (!nextNumber(d, v[i])) return false;
+      }
+      return true;
+    };
+    switch (toupper(cmd)) {
+      case 'M':
+        if (!args(2)) return;
+        moveTo({base.x + v[0], base.y + v[1]});
+        cmd = rel ? 'l' : 'L';  // Extra pairs are implicit lineto
+        break;
+      case 'L':
+      case 'H':
+      case 'V': {
+        Point p = cur;
+        if (toupper(cmd) == 'L') {
+          if (!args(2)) return;
+          p = {base.x + v[0], base.y + v[1]};
+        } else if (!args(1)) {
+          return;
+        } else if (toupper(cmd) == 'H') {
+          p.x = (rel ? cur.x : 0) + v[0];
+        } else {
+          p.y = (rel ? cur.y : 0) + v[0];
+        }
+        ensureLine();
+        line->push_back(m(p));
+        cur = p;
+        break;
+      }
+      case 'C':
+      case 'S': {
+        Point c1, c2, p;
+        if (toupper(cmd) == 'C') {
+          if (!args(6)) return;
+          c1 = {base.x + v[0], base.y + v[1]};
+          c2 = {base.x + v[2], base.y + v[3]};
+          p = {base.x + v[4], base.y + v[5]};
+        } else {
+          if (!args(4)) return;
+          const bool smooth = strchr("CcSs", prev_cmd) != nullptr;
+          c1 = smooth ? Point{2 * cur.x - last_ctrl.x, 2 * cur.y - last_ctrl.y} : cur;
+          c2 = {base.x + v[0], base.y + v[1]};
+          p = {base.x + v[2], base.y + v[3]};
+        }
+        ensureLine();
+        flattenCubic(*line, m(cur), m(c1), m(c2), m(p), tol);
+        last_ctrl = c2;
+        cur = p;
+        break;
+      }
+      case 'Q':
+      case 'T': {
+        Point c, p;
+        if (toupper(cmd) == 'Q') {
+          if (!args(4)) return;
+          c = {base.x + v[0], base.y + v[1]};
+          p = {base.x + v[2], base.y + v[3]};
+        } else {
+          if (!args(2)) return;
+          const bool smooth = strchr("QqTt", prev_cmd) != nullptr;
+          c = smooth ? Point{2 * cur.x - last_ctrl.x, 2 * cur.y - last_ctrl.y} : cur;
+          p = {base.x + v[0], base.y + v[1]};
+        }
+        ensureLine();
+        flattenQuad(*line, m(cur), m(c), m(p), tol);
+        last_ctrl = c;
+        cur = p;
+        break;
+      }
+      case 'A': {
+        if (!nextNumber(d, v[0]) || !nextNumber(d, v[1]) || !nextNumber(d, v[2]) ||
+            !nextFlag(d, v[3]) || !nextFlag(d, v[4]) || !nextNumber(d, v[5]) || !nextNumber(d, v[6])) {
+          return;
+        }
+        const Point p{base.x + v[5], base.y + v[6]};
+        ensureLine();
+        flattenArc(*line, m, cur, v[0], v[1], v[2], v[3] != 0, v[4] != 0, p, tol);
+        cur = p;
+        break;
+      }
+      case 'Z':
+        if (line) line->push_back(m(start));
+        cur = start;
+        line = nullptr;
+        break;
+      default:
+        return;  // Unknown command: stop parsing this path
+    }
+    prev_cmd = cmd;
+  }
+}
+
+inline std::string attr(std::string_view tag, std::string_view name) {
+  size_t pos = 0;
+  while ((pos = tag.find(name, pos)) != std::string_view::npos) {
+    const bool starts = pos > 0 && isspace(static_cast<unsigned char>(tag[pos - 1]));
+    size_t eq = pos + name.size();
+    while (eq < tag.size() && isspace(static_cast<unsigned char>(tag[eq]))) ++eq;
+    if (starts && eq < tag.size() && tag[eq] == '=') {
+      size_t q = eq + 1;
+      while (q < tag.size() && isspace(static_cast<unsigned char>(tag[q]))) ++q;
+      if (q >= tag.size()) break;
+      const char quote = tag[q];
+      const size_t end = tag.find(quote, q + 1);
+      if (end == std::string_view::npos) break;
+      return std::string(tag.substr(q + 1, end - q - 1));
+    }
+    pos += name.size();
+  }
+  return {};
+}
+
+inline double num(std::string_view tag, std::string_view name, double fallback = 0) {
+  const std::string value = attr(tag, name);
+  return value.empty() ? fallback : strtod(value.c_str(), nullptr);
+}
+
+inline Affine parseTransform(std::string_view s) {
+  Affine m;
+  while (true) {
+    while (!s.empty() && (isspace(static_cast<unsigned char>(s.front())) || s.front() == ',')) {
+      s.remove_prefix(1);
+    }
+    const size_t open = s.find('(');
+    const size_t close = s.find(')');
+    if (open == std::string_view::npos || close == std::string_view::npos) break;
+    std::string name(s.substr(0, open));
+    while (!name.empty() && isspace(static_cast<unsigned char>(name.back()))) name.pop_back();
+    std::string_view list = s.substr(open + 1, close - open - 1);
+    double v[6] = {0, 0, 0, 0, 0, 0};
+    int n = 0;
+    while (n < 6 && nextNumber(list, v[n])) ++n;
+    Affine t;
+    if (name == "matrix" && n == 6) {
+      t = {v[0], v[1], v[2], v[3], v[4], v[5]};
+    } else if (name == "translate") {
+      t.e = v[0];
+      t.f = n > 1 ? v[1] : 0;
+    } else if (name == "scale") {
+      t.a = v[0];
+      t.d = n > 1 ? v[1] : v[0];
+    } else if (name == "rotate") {
+      const double r = v[0] * kPi / 180;
+      const Affine rot{std::cos(r), std::sin(r), -std::sin(r), std::cos(r), 0, 0};
+      t = n == 3 ? Affine{1, 0, 0, 1, v[1], v[2]} * rot * Affine{1, 0, 0, 1, -v[1], -v[2]} : rot;
+    } else if (name == "skewX") {
+      t.c = std::tan(v[0] * kPi / 180);
+    } else if (name == "skewY") {
+      t.b = std::tan(v[0] * kPi / 180);
+    }
+    m = m * t;
+    s.remove_prefix(close + 1);
+  }
+  return m;
+}
+
+// Converts a length attribute ("300pt", "21cm", "100") to millimetres.
+inline double toMm(const std::string& value) {
+  if (value.empty()) return 0;
+  char* end;
+  const double v = strtod(value.c_str(), &end);
+  const std::string unit(end);
+  if (unit == "mm") return v;
+  if (unit == "cm") return v * 10;
+  if (unit == "in") return v * 25.4;
+  if (unit == "pt") return v * 25.4 / 72;
+  if (unit == "pc") return v * 25.4 / 6;
+  return v * 25.4 / 96;  // px / unitless
+}
+
+}  // namespace detail
+
+// Parses an SVG document into polylines, in mm with the y axis pointing up
+// and the origin at the bottom-left of the page.
+inline std::vector<Polyline> parse(std::string_view text, double tolerance_mm) {
+  using namespace detail;
+  std::vector<Polyline> out;
+  std::vector<Affine> stack{Affine{}};
+  int skip_depth = 0;  // Inside <defs>, <clipPath>, ... nothing is drawn
+
+  size_t pos = 0;
+  while ((pos = text.find('<', pos)) != std::string_view::npos) {
+    if (text.compare(pos, 4, "<!--") == 0) {
+      pos = text.find("-->", pos);
+      if (pos == std::string_view::npos) break;
+      continue;
+    }
+    const size_t end = text.find('>', pos);
+    if (end == std::string_view::npos) break;
+    const std::string_view tag = text.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+    if (tag.empty() || tag.front() == '?' || tag.front() == '!') continue;
+
+    const bool closing = tag.front() == '/';
+    const bool self_closing = tag.back() == '/';
+    size_t name_end = closing ? 1 : 0;
+    while (name_end < tag.size() && !isspace(static_cast<unsigned char>(tag[name_end])) &&
+           tag[name_end] != '/') {
+      ++name_end;
+    }
+    const std::string name(tag.substr(closing ? 1 : 0, name_end - (closing ? 1 : 0)));
+    const bool container = name == "g" || name == "svg" || name == "a";
+    const bool hidden = name == "defs" || name == "clipPath" || name == "mask" ||
+                        name == "symbol" || name == "marker" || name == "pattern";
+
+    if (closing) {
+      if (hidden) --skip_depth;
+      if (container && stack.size() > 1) stack.pop_back();
+      continue;
+    }
+    if (hidden && !self_closing) ++skip_depth;
+    if (skip_depth > 0) continue;
+
+    Affine m = stack.back() * parseTransform(attr(tag, "transform"));
+    if (name == "svg" && stack.size() == 1) {
+      // Root: map the viewBox onto the page in mm, then flip y.
+      const std::string view_box = attr(tag, "viewBox");
+      double vb[4] = {0, 0, 0, 0};
+      std::string_view vbs = view_box;
+      int n = 0;
+      while (n < 4 && nextNumber(vbs, vb[n])) ++n;
+      double width = toMm(attr(tag, "width")), height = toMm(attr(tag, "height"));
+      if (n == 4 && width == 0) width = toMm(std::to_string(vb[2]));
+      if (n == 4 && height == 0) height = toMm(std::to_string(vb[3]));
+      const double sx = n == 4 && vb[2] > 0 ? width / vb[2] : 25.4 / 96;
+      const double sy = n == 4 && vb[3] > 0 ? height / vb[3] : 25.4 / 96;
+      m = Affine{sx, 0, 0, -sy, -vb[0] * sx, height + vb[1] * sy} * parseTransform(attr(tag, "transform"));
+    }
+    if (container) {
+      if (!self_closing) stack.push_back(m);
+      continue;
+    }
+
+    std::string d;
+    char buf[256];
+    if (name == "path") {
+      d = attr(tag, "d");
+    } else if (name == "line") {
+      snprintf(buf, sizeof(buf), "M%.17g %.17g L%.17g %.17g", num(tag, "x1"), num(tag, "y1"),
+               num(tag, "x2"), num(tag, "y2"));
+      d = buf;
+    } else if (name == "polyline" || name == "polygon") {
+      d = "M" + attr(tag, "points") + (name == "polygon" ? "Z" : "");
+    } else if (name == "rect") {
+      const double x = num(tag, "x"), y = num(tag, "y"), w = num(tag, "width"), h = num(tag, "height");
+      snprintf(buf, sizeof(buf), "M%.17g %.17g h%.17g v%.17g h%.17g Z", x, y, w, h, -w);
+      d = buf;
+    } else if (name == "circle" || name == "ellipse") {
+      const double cx = num(tag, "cx"), cy = num(tag, "cy");
+      const double rx = name == "circle" ? num(tag, "r") : num(tag, "rx");
+      const double ry = name == "circle" ? rx : num(tag, "ry");
+      snprintf(buf, sizeof(buf), "M%.17g %.17g A%.17g %.17g 0 1 0 %.17g %.17g A%.17g %.17g 0 1 0 %.17g %.17g",
+               cx - rx, cy, rx, ry, cx + rx, cy, rx, ry, cx - rx, cy);
+      d = buf;
+    }
+    if (!d.empty()) parsePath(d, m, tolerance_mm, out);
+  }
+  return out;
+}
+
+inline void appendNumber(std::string& out, char axis, double v) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.2f", v);
+  std::string s = buf;
+  s.erase(s.find_last_not_of('0') + 1);
+  if (s.back() == '.') s.pop_back();
+  if (s == "-0") s = "0";
+  out += ' ';
+  out += axis;
+  out += s;
+}
+
+// Emits minimal G-code: one M3 after the first travel (the player lifts and
+// lowers the pen around each later G0 itself), 0.01mm precision, no feed
+// rates, and unchanged axes omitted.
+inline std::string toGcode(const std::vector<Polyline>& lines) {
+  std::string out = "G21\nG90\n";
+  bool first = true;
+  std::string last_x, last_y;
+  for (const auto& line : lines) {
+    if (line.empty()) continue;
+    for (size_t i = 0; i < line.size(); ++i) {
+      std::string x, y;
+      appendNumber(x, 'X', line[i].x);
+      appendNumber(y, 'Y', line[i].y);
+      if (i > 0 && x == last_x && y == last_y) continue;
+      out += i == 0 ? "G0" : "G1";
+      if (i == 0 || x != last_x) out += x;
+      if (i == 0 || y != last_y) out += y;
+      out += '\n';
+      if (first) {
+        out += "M3\n";
+        first = false;
+      }
+      last_x = x;
+      last_y = y;
+    }
+  }
+  out += "M5\n";
+  return out;
+}
+
+}  // namespace svg
@@ -0,0 +1,117 @@
+// Converts SVG drawings into programs for the robot: minimal G-code, or with
+// --dbs a precompiled step stream (see `doodlesim compile`).
+//
+//   g++ -std=gnu++17 -O2 -pthread -Ihost/arduino -I/usr/include/eigen3 host/svg2prog.cpp -o host/build/svg2prog
+//   host/build/svg2prog [--tol mm] [--dbs] [-o dir] [--force] file.svg...
+//
+// Files are converted in parallel, one worker per core.  Each output is
+// written next to its input (or into `-o dir`) with the extension replaced.
+// Nothing is converted if an output already exists, unless --force.
+
+#include <atomic>
+#include <thread>
+
+#include "sim.h"
+#include "svg.h"
+
+namespace {
+
+struct Job {
+  std::string in, out;
+  size_t paths = 0, points = 0, svg_bytes = 0, gcode_bytes = 0;
+  double draw_mm = 0;
+  std::string gcode;
+};
+
+std::string outputPath(const std::string& in, const std::string& dir, const char* ext) {
+  const size_t slash = in.find_last_of('/');
+  std::string base = slash == std::string::npos ? in : in.substr(slash + 1);
+  const size_t dot = base.find_last_of('.');
+  if (dot != std::string::npos) base.resize(dot);
+  const std::string parent = dir.empty() ? in.substr(0, slash == std::string::npos ? 0 : slash + 1)
+                                         : dir + "/";
+  return parent + base + ext;
+}
+
+void convert(Job& job, double tol) {
+  const std::string text = sim::readFile(job.in);
+  job.svg_bytes = text.size();
+  const auto lines = svg::parse(text, tol);
+  for (const auto& line : lines) {
+    if (line.empty()) continue;
+    ++job.paths;
+    job.points += line.size();
+    for (size_t i = 1; i < line.size(); ++i) {
+      job.draw_mm += std::hypot(line[i].x - line[i - 1].x, line[i].y - line[i - 1].y);
+    }
+  }
+  job.gcode = svg::toGcode(lines);
+  job.gcode_bytes = job.gcode.size();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double tol = 0.1;
+  bool dbs = false, force = false;
+  std::string dir;
+  std::vector<Job> jobs;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--tol" && i + 1 < argc) {
+      tol = atof(argv[++i]);
+    } else if (arg == "--dbs") {
+      dbs = true;
+    } else if (arg == "-o" && i + 1 < argc) {
+      dir = argv[++i];
+    } else if (arg == "--force") {
+      force = true;
+    } else {
+      jobs.emplace_back();
+      jobs.back().in = arg;
+    }
+  }
+  if (jobs.empty() || tol <= 0) {
+    fprintf(stderr, "usage: svg2prog [--tol mm] [--dbs] [-o dir] [--force] file.svg...\n");
+    return 1;
+  }
+  bool exists = false;
+  for (auto& job : jobs) {
+    job.out = outputPath(job.in, dir, dbs ? ".dbs" : ".gcode");
+    if (!force && std::ifstream(job.out)) {
+      fprintf(stderr, "%s exists\n", job.out.c_str());
+      exists = true;
+    }
+  }
+  if (exists) {
+    fprintf(stderr, "Not overwriting: pass --force, or -o another directory\n");
+    return 1;
+  }
+
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  const size_t num_workers = std::min<size_t>(jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+  for (size_t w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&] {
+      for (size_t i; (i = next++) < jobs.size();) convert(jobs[i], tol);
+    });
+  }
+  for (auto& worker : workers) worker.join();
+
+  printf("%-32s %6s %8s %10s %10s %10s\n", "file", "paths", "points", "svg B", "gcode B", "draw mm");
+  for (auto& job : jobs) {
+    if (dbs) {
+      // The firmware is a singleton, so compile in a child (after the
+      // workers have joined: forking a threaded process is asking for it).
+      const std::string gcode = job.gcode, out = job.out;
+      const auto result = sim::isolated<sim::CompileResult>(
+          [&] { return sim::compileSteps(gcode, out); });
+      if (!result.ok) fprintf(stderr, "%s: program didn't finish\n", job.in.c_str());
+    } else {
+      std::ofstream(job.out, std::ios::binary) << job.gcode;
+    }
+    printf("%-32s %6zu %8zu %10zu %10zu %10.1f\n", job.in.c_str(), job.paths, job.points,
+           job.svg_bytes, job.gcode_bytes, job.draw_mm);
+  }
+  return 0;
+}
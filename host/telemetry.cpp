@@ -0,0 +1,277 @@
+// Client for the /telemetry WebSocket (master/telemetry.h), and a benchmark of
+// the stream against polling with '?'.
+//
+//   g++ -std=gnu++17 -O2 -Ihost/arduino -I/usr/include/eigen3 host/telemetry.cpp -o host/build/telemetry
+//   host/build/telemetry <robot ip> [period_ms]
+//   host/build/telemetry --bench [file.gcode] [period_ms]
+//
+// Live mode subscribes and prints one decoded line per frame until the robot
+// closes the connection.  --bench runs a job on the simulated firmware with a
+// subscriber attached, checks the frames it receives, and compares one status
+// update each way: bytes on the wire, the send time the shims charge for them
+// (a per-byte estimate, not a measurement), and host time to build and send
+// it.  host/bench.cpp times the same two paths (telemetry_frame, status_dump).
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+
+#include "sim.h"
+
+namespace {
+
+// Minimal RFC 6455 client: no extensions, no fragmentation on send.
+class WsClient {
+ public:
+  ~WsClient() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool connect(const char* host, const char* path) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, "80", &hints, &res) != 0) return false;
+    for (addrinfo* ai = res; ai && fd_ < 0; ai = ai->ai_next) {
+      fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd_ >= 0 && ::connect(fd_, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd_);
+        fd_ = -1;
+      }
+    }
+    freeaddrinfo(res);
+    if (fd_ < 0) return false;
+
+    // The server doesn't need the accept key checked by us to be useful.
+    char request[256];
+    const int n = snprintf(request, sizeof(request),
+                           "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+                           "Connection: Upgrade\r\nSec-WebSocket-Key: ZG9vZGxlYm90dGVsZW0=\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n",
+                           path, host);
+    if (!sendAll(request, n)) return false;
+    std::string response;
+    char c;
+    while (response.find("\r\n\r\n") == std::string::npos) {
+      if (read(fd_, &c, 1) != 1) return false;
+      response += c;
+    }
+    return response.compare(0, 12, "HTTP/1.1 101") == 0;
+  }
+
+  // Sends one masked frame (clients must mask).
+  bool send(uint8_t opcode, const std::string& payload) {
+    std::string frame(1, static_cast<char>(0x80 | opcode));
+    if (payload.size() < 126) {
+      frame += static_cast<char>(0x80 | payload.size());
+    } else {
+      frame += static_cast<char>(0x80 | 126);
+      frame += static_cast<char>(payload.size() >> 8);
+      frame += static_cast<char>(payload.size() & 0xff);
+    }
+    uint8_t mask[4];
+    for (auto& m : mask) m = rng_();
+    frame.append(reinterpret_cast<char*>(mask), 4);
+    for (size_t i = 0; i < payload.size(); ++i) frame += payload[i] ^ mask[i % 4];
+    return sendAll(frame.data(), frame.size());
+  }
+
+  // Reads one frame.  Returns false when the connection is gone.
+  bool receive(uint8_t& opcode, std::string& payload) {
+    uint8_t head[2];
+    if (!readAll(head, 2)) return false;
+    opcode = head[0] & 0x0f;
+    uint64_t len = head[1] & 0x7f;
+    if (len >= 126) {
+      uint8_t ext[8];
+      const size_t n = len == 126 ? 2 : 8;
+      if (!readAll(ext, n)) return false;
+      len = 0;
+      for (size_t i = 0; i < n; ++i) len = len << 8 | ext[i];
+    }
+    uint8_t mask[4] = {};
+    if ((head[1] & 0x80) && !readAll(mask, 4)) return false;
+    payload.resize(len);
+    if (!readAll(payload.data(), len)) return false;
+    for (size_t i = 0; i < len; ++i) payload[i] ^= mask[i % 4];
+    return true;
+  }
+
+ private:
+  bool sendAll(const char* data, size_t len) {
+    while (len > 0) {
+      const ssize_t n = write(fd_, data, len);
+      if (n <= 0) return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool readAll(void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+      const ssize_t n = read(fd_, p, len);
+      if (n <= 0) return false;
+      p += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+  std::mt19937 rng_{std::random_device{}()};
+};
+
+int live(const char* host, uint32_t period_ms) {
+  WsClient ws;
+  if (!ws.connect(host, TELEMETRY_PATH)) {
+    fprintf(stderr, "Can't open ws://%s%s\n", host, TELEMETRY_PATH);
+    return 1;
+  }
+  ws.send(0x1, std::to_string(period_ms));
+  uint8_t opcode;
+  std::string payload;
+  char line[256];
+  while (ws.receive(opcode, payload)) {
+    if (opcode == 0x8) break;                  // Close
+    if (opcode == 0x9) ws.send(0xA, payload);  // Ping: pong
+    if (opcode != 0x2) continue;
+    TelemetryFrame frame;
+    if (!telemetry::decode(reinterpret_cast<const uint8_t*>(payload.data()), payload.size(),
+                           frame)) {
+      fprintf(stderr, "Skipping %zu-byte frame (version %d)\n", payload.size(),
+              payload.empty() ? -1 : payload[0]);
+      continue;
+    }
+    telemetry::format(frame, line, sizeof(line));
+    fputs(line, stdout);
+    fflush(stdout);
+  }
+  return 0;
+}
+
+struct Cost {
+  double bytes;      // Per update
+  double send_us;    // Charged by the shims per byte, per update
+  double host_ns;    // Measured, per update
+};
+
+template <typename Fn>
+Cost measure(Fn update, const size_t& bytes_counter, size_t reps = 20000) {
+  const size_t bytes_before = bytes_counter;
+  const uint64_t us_before = sim::now_us;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < reps; ++i) update();
+  const double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  return {double(bytes_counter - bytes_before) / reps, double(sim::now_us - us_before) / reps,
+          ns / reps};
+}
+
+int bench(const std::string& path, uint32_t period_ms) {
+  sim::boot();
+  sim::upload(sim::readFile(path));
+  AsyncWebSocketClient* client = telemetry_ws.connect();
+  telemetry_ws.send(client, std::to_string(period_ms));
+  gcode_player.play();
+  const uint64_t job_us = sim::runUntil(loop, [] { return gcode_player.isFinished(); }, 1200e6);
+  // Let the frame after the last command go out.
+  sim::runUntil(loop, [] { return false; }, 2000 * period_ms);
+
+  // The stream: consecutive, at the requested rate, and following the job.
+  bool ok = gcode_player.isFinished();
+  size_t frames = 0, pen_down = 0;
+  TelemetryFrame first{}, last{};
+  for (const auto& msg : client->received) {
+    TelemetryFrame f;
+    if (!telemetry::decode(reinterpret_cast<const uint8_t*>(msg.data()), msg.size(), f)) {
+      fprintf(stderr, "Frame %zu doesn't decode\n", frames);
+      ok = false;
+      break;
+    }
+    if (frames == 0) first = f;
+    if (frames > 0 && (f.seq != uint16_t(last.seq + 1) || f.index < last.index ||
+                       f.percent < last.percent || f.ms - last.ms < period_ms)) {
+      fprintf(stderr, "Frame %zu out of order: seq %u after %u, index %u after %u\n", frames,
+              f.seq, last.seq, f.index, last.index);
+      ok = false;
+    }
+    pen_down += (f.flags & TELEMETRY_PEN_DOWN) != 0;
+    last = f;
+    ++frames;
+  }
+  const double span_s = (last.ms - first.ms) / 1e3;
+  const double rate = frames > 1 ? (frames - 1) / span_s : 0;
+  if (rate < 0.9e3 / period_ms || rate > 1.1e3 / period_ms) {
+    fprintf(stderr, "Rate %.1f Hz, expected %.1f Hz\n", rate, 1e3 / period_ms);
+    ok = false;
+  }
+  if (last.index != last.size || last.percent != 10000 || (last.flags & TELEMETRY_PLAYING) ||
+      pen_down == 0) {
+    fprintf(stderr, "Stream doesn't show the job finishing\n");
+    ok = false;
+  }
+  char line[256];
+  printf("%s: job %.1fs, %zu frames at %.1f Hz\n", path.c_str(), job_us / 1e6, frames, rate);
+  telemetry::format(first, line, sizeof(line));
+  printf("  first %s", line);
+  telemetry::format(last, line, sizeof(line));
+  printf("  last  %s", line);
+
+  // Faster than the minimum gets clamped; "0" stops the stream.
+  const size_t before_stop = client->received.size();
+  telemetry_ws.send(client, "1");
+  const bool clamped = telemetry_period_ms == TELEMETRY_MIN_MS;
+  telemetry_ws.send(client, "0");
+  sim::runUntil(loop, [] { return false; }, 1e6);
+  if (!clamped || client->received.size() != before_stop) {
+    fprintf(stderr, "Period commands not honoured\n");
+    ok = false;
+  }
+
+  // Cost of one update each way, on the finished job's state.
+  WebSerial.echo = false;
+  const Cost push = measure(
+      [] {
+        TelemetryFrame frame = telemetryFrame();
+        telemetry_ws.binaryAll(reinterpret_cast<uint8_t*>(&frame), sizeof(frame));
+      },
+      client->bytes_received);
+  const Cost poll = measure([] { WebSerial.receive("?"); }, WebSerial.bytes_out);
+
+  const double hz = 1e3 / period_ms;
+  printf("\nPer update at %.0f Hz:   %10s %10s %12s %12s\n", hz, "bytes", "bytes/s",
+         "send us est", "host ns");
+  printf("  telemetry frame     %10.0f %10.0f %12.1f %12.0f\n", push.bytes, push.bytes * hz,
+         push.send_us, push.host_ns);
+  printf("  '?' text dump       %10.0f %10.0f %12.1f %12.0f\n", poll.bytes, poll.bytes * hz,
+         poll.send_us, poll.host_ns);
+  printf("  ratio               %9.1fx %9.1fx %11.1fx %11.1fx\n", poll.bytes / push.bytes,
+         poll.bytes / push.bytes, poll.send_us / push.send_us, poll.host_ns / push.host_ns);
+  printf("(send us est: bytes times the shims' per-byte cost, so it only restates bytes;\n"
+         " host ns: measured here, building and sending; '?' also pays a request message\n"
+         " per update, not counted here)\n");
+  printf("%s\n", ok ? "Stream OK" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    const std::string path = argc > 2 ? argv[2] : "gcode_files/I_am_DoodleBot.gcode";
+    return bench(path, argc > 3 ? atoi(argv[3]) : TELEMETRY_DEFAULT_MS);
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: telemetry <robot ip> [period_ms]\n"
+                    "       telemetry --bench [file.gcode] [period_ms]\n");
+    return 1;
+  }
+  return live(argv[1], argc > 2 ? atoi(argv[2]) : TELEMETRY_DEFAULT_MS);
+}
@@ -0,0 +1,238 @@
+// Sweeps the motion parameters (master/motion_params.h) on the simulated
+// firmware and prints the Pareto front of job time vs. path deviation.
+//
+//   g++ -std=gnu++17 -O2 -Ihost/arduino -I/usr/include/eigen3 host/tune.cpp -o host/build/tune
+//   host/build/tune [--random n] [--seed s] [--jobs n] [--csv out.csv] [name=v1,v2,... | name=lo:hi ...] [file.gcode]
+//
+// With no parameter arguments a small default grid is swept.  `name=v1,v2`
+// lists grid values; `name=lo:hi` is a range for --random, which draws n
+// configurations uniformly instead of walking the grid.  Every configuration
+// runs in its own forked simulation, --jobs at a time (default: all cores).
+// The front's configurations are printed as 'K' commands for WebSerial.
+
+#include <random>
+#include <thread>
+
+#include "sim.h"
+
+namespace {
+
+struct Param {
+  const char* name;
+  double MotionParams::*dbl;
+  uint32_t MotionParams::*u32;
+  long MotionParams::*lng;
+
+  double get(const MotionParams& p) const {
+    return dbl ? p.*dbl : u32 ? p.*u32 : p.*lng;
+  }
+  void set(MotionParams& p, double v) const {
+    if (dbl) p.*dbl = v;
+    if (u32) p.*u32 = static_cast<uint32_t>(std::lround(std::max(0.0, v)));
+    if (lng) p.*lng = std::lround(v);
+  }
+};
+
+const Param kParams[] = {
+    {"speed", &MotionParams::max_steps_per_s, nullptr, nullptr},
+    {"accel", &MotionParams::acceleration, nullptr, nullptr},
+    {"max_replan_ms", nullptr, &MotionParams::max_replan_ms, nullptr},
+    {"min_replan_ms", nullptr, &MotionParams::min_replan_ms, nullptr},
+    {"lookahead", nullptr, nullptr, &MotionParams::lookahead_steps},
+    {"max_step", &MotionParams::max_step_unit, nullptr, nullptr},
+    {"tol", &MotionParams::done_tol_unit, nullptr, nullptr},
+    {"servo_ms_per_deg", nullptr, &MotionParams::servo_ms_per_deg, nullptr},
+    {"profile", nullptr, &MotionParams::speed_profile, nullptr},
+};
+
+const Param* findParam(const std::string& name) {
+  for (const auto& param : kParams) {
+    if (name == param.name) return &param;
+  }
+  return nullptr;
+}
+
+struct Score {
+  bool finished;
+  double job_s;
+  double max_dev_mm, mean_dev_mm;
+};
+
+Score evaluate(const std::string& gcode, const MotionParams& params) {
+  motion_params = params;
+  sim::boot();
+  sim::upload(gcode);
+  const sim::ProgramPath path(gcode_player);
+  gcode_player.play();
+
+  constexpr uint64_t kSampleUs = 10000;
+  uint64_t next_us = sim::now_us, samples = 0;
+  double max_dev = 0, sum_dev = 0;
+  const uint64_t job_us = sim::runUntil(
+      [&] {
+        loop();
+        if (sim::now_us < next_us) return;
+        next_us += kSampleUs;
+        if (!sim::penDown()) return;
+        const double dev = path.distance(estimator.state().pen()) * Robot::mm_per_unit;
+        max_dev = std::max(max_dev, dev);
+        sum_dev += dev;
+        ++samples;
+      },
+      [] { return gcode_player.isFinished(); }, 1200e6);
+  return {gcode_player.isFinished(), job_us / 1e6, max_dev, samples ? sum_dev / samples : 0};
+}
+
+struct Trial {
+  MotionParams params;
+  Score score{};
+  bool front = false;
+};
+
+std::string kCommand(const MotionParams& p) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "K%.1f,%.1f,%u,%u,%ld,%.3f,%.3f,%u,%u", p.max_steps_per_s,
+           p.acceleration, p.max_replan_ms, p.min_replan_ms, p.lookahead_steps, p.max_step_unit,
+           p.done_tol_unit, p.servo_ms_per_deg, p.speed_profile);
+  return buf;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string path = "gcode_files/I_am_DoodleBot.gcode", csv_path;
+  size_t random = 0, jobs = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t seed = 1;
+  std::vector<std::pair<const Param*, std::vector<double>>> grid;
+  std::vector<std::tuple<const Param*, double, double>> ranges;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    if (arg == "--random" && i + 1 < argc) {
+      random = atoi(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      jobs = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csv_path = argv[++i];
+    } else if (eq != std::string::npos) {
+      const Param* param = findParam(arg.substr(0, eq));
+      if (!param) {
+        fprintf(stderr, "Unknown parameter %s\n", arg.substr(0, eq).c_str());
+        return 1;
+      }
+      const std::string values = arg.substr(eq + 1);
+      const size_t colon = values.find(':');
+      if (colon != std::string::npos) {
+        ranges.emplace_back(param, atof(values.c_str()), atof(values.c_str() + colon + 1));
+      } else {
+        std::vector<double> list;
+        for (size_t pos = 0; pos != std::string::npos;) {
+          list.push_back(atof(values.c_str() + pos));
+          pos = values.find(',', pos);
+          if (pos != std::string::npos) ++pos;
+        }
+        grid.emplace_back(param, list);
+      }
+    } else {
+      path = arg;
+    }
+  }
+  if (grid.empty() && ranges.empty()) {
+    grid = {{findParam("speed"), {400, 500, 600}},
+            {findParam("max_step"), {2.5, 5, 10}},
+            {findParam("tol"), {0.5, 1, 2}}};
+  }
+  const std::string gcode = sim::readFile(path);
+
+  // Build the trial list: the full grid, or `random` draws.
+  std::vector<Trial> trials;
+  if (random > 0) {
+    std::mt19937 rng(seed);
+    for (size_t t = 0; t < random; ++t) {
+      Trial trial{MotionParams{}};
+      for (const auto& [param, lo, hi] : ranges) {
+        param->set(trial.params, std::uniform_real_distribution<double>(lo, hi)(rng));
+      }
+      for (const auto& [param, values] : grid) {
+        param->set(trial.params, values[rng() % values.size()]);
+      }
+      trials.push_back(trial);
+    }
+  } else {
+    trials.push_back({MotionParams{}});
+    for (const auto& [param, values] : grid) {
+      std::vector<Trial> expanded;
+      for (const auto& trial : trials) {
+        for (const double v : values) {
+          expanded.push_back(trial);
+          param->set(expanded.back().params, v);
+        }
+      }
+      trials = expanded;
+    }
+  }
+
+  // Run `jobs` simulations at a time, each in its own process.
+  std::vector<std::pair<size_t, sim::Child>> running;
+  auto collect = [&] {
+    auto& [index, child] = running.front();
+    const std::string out = child.wait();
+    if (out.size() == sizeof(Score)) memcpy(&trials[index].score, out.data(), sizeof(Score));
+    running.erase(running.begin());
+  };
+  for (size_t i = 0; i < trials.size(); ++i) {
+    if (running.size() >= jobs) collect();
+    running.emplace_back(i, sim::spawn([&] {
+      const Score score = evaluate(gcode, trials[i].params);
+      return std::string(reinterpret_cast<const char*>(&score), sizeof(score));
+    }));
+  }
+  while (!running.empty()) collect();
+
+  // Pareto front over (job time, max deviation), both minimized.
+  for (auto& a : trials) {
+    if (!a.score.finished) continue;
+    a.front = std::none_of(trials.begin(), trials.end(), [&](const Trial& b) {
+      return b.score.finished && b.score.job_s <= a.score.job_s &&
+             b.score.max_dev_mm <= a.score.max_dev_mm &&
+             (b.score.job_s < a.score.job_s || b.score.max_dev_mm < a.score.max_dev_mm);
+    });
+  }
+  std::sort(trials.begin(), trials.end(),
+            [](const Trial& a, const Trial& b) { return a.score.job_s < b.score.job_s; });
+
+  const MotionParams defaults{};
+  std::string header, csv;
+  for (const auto& param : kParams) {
+    header += param.name;
+    header += ',';
+  }
+  csv = header + "finished,job_s,max_dev_mm,mean_dev_mm,front\n";
+  size_t finished = 0;
+  for (const auto& trial : trials) {
+    finished += trial.score.finished;
+    char buf[96];
+    for (const auto& param : kParams) {
+      snprintf(buf, sizeof(buf), "%g,", param.get(trial.params));
+      csv += buf;
+    }
+    snprintf(buf, sizeof(buf), "%d,%.3f,%.4f,%.4f,%d\n", trial.score.finished, trial.score.job_s,
+             trial.score.max_dev_mm, trial.score.mean_dev_mm, trial.front);
+    csv += buf;
+  }
+  if (!csv_path.empty()) std::ofstream(csv_path) << csv;
+
+  printf("%zu configurations on %s (%zu finished), %zu at a time\n", trials.size(), path.c_str(),
+         finished, jobs);
+  printf("Pareto front (job time vs. max path deviation):\n");
+  printf("  %8s %9s %9s  %s\n", "job", "dev max", "dev mean", "WebSerial");
+  for (const auto& trial : trials) {
+    if (!trial.front) continue;
+    printf("  %7.1fs %7.3fmm %7.3fmm  %s%s\n", trial.score.job_s, trial.score.max_dev_mm,
+           trial.score.mean_dev_mm, kCommand(trial.params).c_str(),
+           kCommand(trial.params) == kCommand(defaults) ? "  (current)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <Arduino.h>
+#include <WebSerial.h>
+
+#include "fixed_format.h"
+
+// Time taken by each stage of setup(), for the 'B' WebSerial command.  Motion
+// only waits for these; the network comes up in the background afterwards
+// (see WifiLink), so the log is usually read long after it was written.
+#define BOOT_MAX_STAGES 12
+
+class BootLog {
+ public:
+  struct Stage {
+    const char* name;
+    uint32_t us;
+  };
+
+  // Runs `fn` as the named stage.
+  template <typename Fn>
+  void stage(const char* name, Fn fn) {
+    const uint32_t start_us = micros();
+    fn();
+    if (num_stages_ < BOOT_MAX_STAGES) {
+      stages_[num_stages_++] = {name, static_cast<uint32_t>(micros() - start_us)};
+    }
+  }
+
+  // setup() has finished: the robot can move.
+  void ready() { ready_ms_ = millis(); }
+
+  size_t numStages() const { return num_stages_; }
+  const Stage& stage(size_t i) const { return stages_[i]; }
+  uint32_t readyMs() const { return ready_ms_; }
+
+  void print() const {
+    char buf[40 + Unsigned<>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nBoot: ready to move " << Unsigned<>(ready_ms_) << "ms after reset\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+    for (size_t i = 0; i < num_stages_; ++i) {
+      char line[32 + Fixed<1, 8>::kMaxChars];  // Names are a word
+      TextWriter out(line, sizeof(line));
+      out << "  " << stages_[i].name;
+      for (size_t n = strlen(stages_[i].name); n < 10; ++n) out << " ";
+      out << " " << Fixed<1, 8>(stages_[i].us / 1e3) << "ms\n";
+      WebSerial.write(reinterpret_cast<const uint8_t*>(line), out.length());
+    }
+  }
+
+ private:
+  Stage stages_[BOOT_MAX_STAGES];
+  uint8_t num_stages_ = 0;
+  uint32_t ready_ms_ = 0;
+};
+
+BootLog boot_log;
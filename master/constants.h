@@ -1,15 +1,12 @@
 
-// Motor calibration
-// 183mm = 3000 steps
-#define STEPS_PER_MM (3000.0 / 183.0)
-#define UNITS_PER_STEP (1.0 / STEPS_PER_UNIT)
+// Motor calibration (geometry is in robot_config.h)
+#define MAX_STEPS_PER_S 500.0
+// Half steps are shorter but the motors can't take them twice as fast.
+#define MAX_HALF_STEPS_PER_S 800.0
 
-// Kinematics
-#define WIDTH_MM 117.0
-#define LENGTH_MM 125.0
-
-// For conditioning reasons, keep state in units of cm
-#define MM_PER_UNIT 1.0
-#define WIDTH_UNIT (WIDTH_MM / MM_PER_UNIT)
-#define LENGTH_UNIT (LENGTH_MM / MM_PER_UNIT)
-#define STEPS_PER_UNIT (STEPS_PER_MM * MM_PER_UNIT)
+// Control: a new wheel command is issued when either wheel is within
+// REPLAN_LOOKAHEAD_STEPS of its target or the setpoint changes, but no more
+// often than REPLAN_MIN_MS and at least every MOTOR_TICK_MS.
+#define MOTOR_TICK_MS 50
+#define REPLAN_MIN_MS 10
+#define REPLAN_LOOKAHEAD_STEPS 3
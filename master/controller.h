@@ -1,13 +1,19 @@
 #pragma once
 
+#include "fixed_format.h"
 #include "kinematics.h"
+#include "motion_params.h"
 
-class Controller {
+template <typename RobotT>
+class ControllerT {
 public:
-  Controller()
+  using State = StateT<RobotT>;
+
+  ControllerT()
     : setpoint_(Eigen::Vector2d::Zero()) {}
 
-  bool done(const State& state, double tol = 1.0) const {
+  bool done(const State& state,
+            double tol = motion_params.done_tol_unit) const {
     return (setpoint_ - state.pen()).norm() < tol;
   }
 
@@ -23,7 +29,7 @@ public:
     setpoint_ = Eigen::Vector2d::Zero();
   }
 
-  Eigen::Vector2d getAction(const State& state, double max_step_size_unit = 5.0, bool verbose = false) const {
+  Eigen::Vector2d getAction(const State& state, double max_step_size_unit = motion_params.max_step_unit, bool verbose = false) const {
     const auto state_H_q = state_D_q(state);
     const auto pen_H_state = pen_D_state(state);
     const Eigen::Matrix2d pen_H_q = pen_H_state * state_H_q;
@@ -58,15 +64,17 @@ Controller debug!
   }
 
   void print() {
-    WebSerial.printf(R"(
-Controller:
-  setpoint: (%.3f, %.3f)
-)",
-                     setpoint_(0), setpoint_(1));
+    char buf[32 + 2 * Fixed<3>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nController:\n  setpoint: (" << Fixed<3>(setpoint_(0)) << ", "
+        << Fixed<3>(setpoint_(1)) << ")\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
   }
 
 private:
   Eigen::Vector2d setpoint_;
 };
 
+using Controller = ControllerT<Robot>;
+
 Controller controller{};
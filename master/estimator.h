@@ -1,12 +1,16 @@
 #pragma once
 
 #include "constants.h"
+#include "fixed_format.h"
 #include "kinematics.h"
 
-class Estimator {
+template <typename RobotT>
+class EstimatorT {
 public:
-  Estimator()
-    : state_({ .x = -LENGTH_UNIT, .y = 0, .cos = 1, .sin = 0 }),
+  using State = StateT<RobotT>;
+
+  EstimatorT()
+    : state_(State::home()),
       q_prev_(0, 0) {}
 
   void update(const Q& q, bool verbose = false) {
@@ -39,19 +43,31 @@ Estimator debug!
     return state_;
   }
 
+  // Wheel positions at the last update.
+  const Q& q() const {
+    return q_prev_;
+  }
+
+  // Jump to a known pose, e.g. after a step replay that bypassed estimation.
+  void setState(const State& state, const Q& q) {
+    state_ = state;
+    q_prev_ = q;
+  }
+
   void reset() {
-    state_ = State{ .x = -LENGTH_UNIT, .y = 0, .cos = 1, .sin = 0 };
+    state_ = State::home();
     // Intentionally don't reset prev_q.
   }
 
   void print() {
     const auto pen_pos = state_.pen();
-    WebSerial.printf(R"(
-Estimator:
-  state: (%.3f, %.3f) angle [%.3f, %.3f] - pen pos: (%.3f, %.3f)
-  q_prev: (%.3f, %.3f)
-)",
-                     state_.x, state_.y, state_.cos, state_.sin, pen_pos(0), pen_pos(1), q_prev_(0), q_prev_(1));
+    char buf[72 + 8 * Fixed<3>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nEstimator:\n  state: (" << Fixed<3>(state_.x) << ", " << Fixed<3>(state_.y)
+        << ") angle [" << Fixed<3>(state_.cos) << ", " << Fixed<3>(state_.sin)
+        << "] - pen pos: (" << Fixed<3>(pen_pos(0)) << ", " << Fixed<3>(pen_pos(1))
+        << ")\n  q_prev: (" << Fixed<3>(q_prev_(0)) << ", " << Fixed<3>(q_prev_(1)) << ")\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
   }
 
 private:
@@ -59,4 +75,6 @@ private:
   Q q_prev_;
 };
 
+using Estimator = EstimatorT<Robot>;
+
 Estimator estimator{};
@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Text output for listings and status lines without snprintf: the ESP8266
+// has no FPU, and "%.2f" costs a soft-float conversion and a large stack
+// frame per number.  Numbers are written with integer arithmetic only,
+// straight from the bits of the double, in formats fixed at compile time:
+// out << Fixed<D, W>(v) writes exactly what "%W.Df" would, rounding the
+// exact binary value half to even like newlib and glibc, for up to 3
+// decimals and magnitudes below 2^64 / 10^D.  Larger ones are written as
+// "#", infinities and NaNs as "inf", "-inf" and "nan".  Like snprintf,
+// output is cut at max_chars - 1 and NUL-terminated, and size() counts what
+// would have been written.
+
+// "%W.Df"
+template <uint8_t kDecimals, uint8_t kWidth = 0>
+struct Fixed {
+  // The most it writes: a sign, up to 20 digits and the point, or kWidth if
+  // that's wider.  A buffer holds a line if it has room for the line's own
+  // text plus kMaxChars for each number in it, so numbers from a bad
+  // setting or a corrupt file are never cut off.
+  static constexpr size_t kMaxChars = std::max<size_t>(kWidth, kDecimals == 0 ? 21 : 22);
+
+  constexpr Fixed(double value) : value(value) {}
+  double value;
+};
+// "%Wu"
+template <uint8_t kWidth = 0>
+struct Unsigned {
+  static constexpr size_t kMaxChars = std::max<size_t>(kWidth, 10);
+
+  constexpr Unsigned(uint32_t value) : value(value) {}
+  uint32_t value;
+};
+
+class TextWriter {
+ public:
+  TextWriter(char* buf, size_t max_chars);
+
+  TextWriter& operator<<(const char* s);
+  template <uint8_t kDecimals, uint8_t kWidth>
+  TextWriter& operator<<(Fixed<kDecimals, kWidth> v);
+  template <uint8_t kWidth>
+  TextWriter& operator<<(Unsigned<kWidth> n);
+
+  // Characters the whole text takes, written or not.
+  size_t size() const { return size_; }
+  // Characters written to the buffer.
+  size_t length() const { return max_chars_ == 0 ? 0 : std::min(size_, max_chars_ - 1); }
+
+ private:
+  void put(char c);
+  void put(const char* s, size_t len, size_t width);
+
+  char* buf_;
+  size_t max_chars_;
+  size_t size_ = 0;
+};
+
+// |v| * 10^kDecimals rounded half to even, and the sign.  Returns false if v
+// isn't finite or the result doesn't fit in 64 bits.
+template <uint8_t kDecimals>
+bool scaleFixed(double v, uint64_t& scaled, bool& negative);
+
+/**************************************************************************/
+
+TextWriter::TextWriter(char* buf, size_t max_chars) : buf_(buf), max_chars_(max_chars) {
+  if (max_chars_ > 0) buf_[0] = '\0';
+}
+
+TextWriter& TextWriter::operator<<(const char* s) {
+  while (*s) put(*s++);
+  return *this;
+}
+
+void TextWriter::put(char c) {
+  if (size_ + 1 < max_chars_) {
+    buf_[size_] = c;
+    buf_[size_ + 1] = '\0';
+  }
+  ++size_;
+}
+
+void TextWriter::put(const char* s, size_t len, size_t width) {
+  for (; width > len; --width) put(' ');
+  for (size_t i = 0; i < len; ++i) put(s[i]);
+}
+
+template <uint8_t kDecimals>
+bool scaleFixed(double v, uint64_t& scaled, bool& negative) {
+  static_assert(kDecimals <= 3, "mantissa * 10^kDecimals must fit in 64 bits");
+  constexpr uint64_t kScale = kDecimals == 0 ? 1 : kDecimals == 1 ? 10 : kDecimals == 2 ? 100 : 1000;
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  negative = bits >> 63;
+  const int biased = (bits >> 52) & 0x7FF;
+  if (biased == 0x7FF) return false;
+  uint64_t mantissa = bits & ((uint64_t{1} << 52) - 1);
+  int exponent = -1074;  // v = mantissa * 2^exponent
+  if (biased != 0) {
+    mantissa |= uint64_t{1} << 52;
+    exponent = biased - 1075;
+  }
+  const uint64_t n = mantissa * kScale;  // < 2^63
+  if (exponent >= 0) {
+    if (exponent >= 64 || n > (UINT64_MAX >> exponent)) return false;
+    scaled = n << exponent;
+    return true;
+  }
+  if (exponent <= -64) {  // Below a half
+    scaled = 0;
+    return true;
+  }
+  const unsigned shift = -exponent;
+  const uint64_t rest = n & ((uint64_t{1} << shift) - 1);
+  const uint64_t half = uint64_t{1} << (shift - 1);
+  scaled = n >> shift;
+  if (rest > half || (rest == half && (scaled & 1))) ++scaled;
+  return true;
+}
+
+template <uint8_t kDecimals, uint8_t kWidth>
+TextWriter& TextWriter::operator<<(Fixed<kDecimals, kWidth> fixed) {
+  const double v = fixed.value;
+  uint64_t scaled;
+  bool negative;
+  if (!scaleFixed<kDecimals>(v, scaled, negative)) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    const bool finite = ((bits >> 52) & 0x7FF) != 0x7FF;
+    const char* s = finite                               ? "#"
+                    : (bits & ((uint64_t{1} << 52) - 1)) ? "nan"
+                    : negative                           ? "-inf"
+                                                         : "inf";
+    put(s, strlen(s), kWidth);
+    return *this;
+  }
+  // Backwards from the last digit.  32-bit division while it fits, which is
+  // always for coordinates.
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  uint8_t decimals = 0;
+  auto emit = [&](auto n) {
+    do {
+      *--p = '0' + n % 10;
+      n /= 10;
+      if (++decimals == kDecimals) *--p = '.';
+    } while (n > 0 || decimals <= kDecimals);
+  };
+  if (scaled <= UINT32_MAX) {
+    emit(static_cast<uint32_t>(scaled));
+  } else {
+    emit(scaled);
+  }
+  if (negative) *--p = '-';
+  put(p, digits + sizeof(digits) - p, kWidth);
+  return *this;
+}
+
+template <uint8_t kWidth>
+TextWriter& TextWriter::operator<<(Unsigned<kWidth> number) {
+  uint32_t n = number.value;
+  char digits[10];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  put(p, digits + sizeof(digits) - p, kWidth);
+  return *this;
+}
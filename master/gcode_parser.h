@@ -1,6 +1,7 @@
 #include <memory>
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <string>
 #include <string_view>
@@ -8,9 +9,18 @@
 #include <ArduinoEigen.h>
 
 #include "controller.h"
+#include "program_transform.h"
+#include "stroke_font.h"
 #include "string_parsing.h"
 
 constexpr size_t MAX_COMMANDS = 500;
+// Subroutine calls and repeat blocks open at once while playing.
+#define PROGRAM_STACK_DEPTH 8
+// Characters of text in a TEXT command, and in one M800 line.
+#define TEXT_CHUNK_CHARS 8
+#define TEXT_MAX_CHARS 64
+#define TEXT_DEFAULT_HEIGHT 5  // Capitals, in program units
+#define MAX_COMMANDS_PER_LINE (1 + TEXT_MAX_CHARS / TEXT_CHUNK_CHARS)
 
 // Parsed representation of a G-code move
 struct GCommand {
@@ -21,33 +31,99 @@ struct GCommand {
     PEN_DOWN,
     DWELL,
     HOME,
-    END
-  } type;
-  Eigen::Vector2d target;  // For RAPID/LINEAR
-  double dwell_ms;         // For DWELL
+    END,
+    // Program flow (see program_flow.h), never seen by the player
+    SUB,         // O<n> SUB: start of subroutine n's definition
+    RETURN,      // M99 / O<n> ENDSUB
+    CALL,        // M98 P<n>: subroutine n, with its origin at `target`
+    REPEAT,      // O<n> REPEAT: the body `flow.count` times, `target` apart
+    REPEAT_END,  // O<n> ENDREPEAT
+    // Text, played as the glyphs' strokes
+    FONT,  // M800: one font unit along the baseline in `target`
+    TEXT,  // M800: `text`, the first glyph's origin at `target`
+  } type = END;
+  // For RAPID/LINEAR; CALL, TEXT: origin; REPEAT: step; FONT: glyph x axis
+  Eigen::Vector2d target = Eigen::Vector2d::Zero();
+  // Zeroed whole, so that saved programs don't hold stray bytes
+  union {
+    double dwell_ms = 0;  // For DWELL
+    struct {
+      uint16_t id;     // SUB, CALL: subroutine; REPEAT(_END): block number
+      uint16_t link;   // Filled in by linkProgram()
+      uint16_t count;  // REPEAT: passes
+    } flow;
+    char text[TEXT_CHUNK_CHARS];  // For TEXT, padded with NULs
+  };
 };
 
+// Move targets come out through `transform` (see program_transform.h), so a
+// drawing can be placed while it streams in.
+//
+// Besides moves, programs can define subroutines and repeat blocks, which
+// are stored once and played through a call stack:
+//   O<n> SUB ... O<n> ENDSUB      define subroutine n (or O<n> ... M99)
+//   M98 P<n> [X Y] [L<k> I J]     call it with its origin at X Y (a move
+//                                 target, so G91 makes it relative), k
+//                                 times, I J further on each time
+//   O<n> REPEAT [k] [X Y] ... O<n> ENDREPEAT
+//                                 play the body k times, X Y further on
+//                                 each time
+// Coordinates in a subroutine are relative to its origin.  After a call,
+// G91 moves carry on from the call's origin; after a repeat block, from
+// where the last pass ended.
+//
+// Text is drawn with the built-in stroke font (see stroke_font.h):
+//   M800 [X Y] [H<height>] [R<degrees>] "text"
+// puts the left end of the baseline at X Y (a move target) with capitals
+// H tall (TEXT_DEFAULT_HEIGHT) and the baseline R degrees anticlockwise.  The
+// text is stored as written, TEXT_CHUNK_CHARS characters a command, and only
+// turned into strokes as it plays.  It can't contain ';' or '\', and G91
+// moves carry on from the end of its baseline.
 class GCodeParser {
  public:
-  static size_t parse(std::string_view& input,
-                      std::array<GCommand, MAX_COMMANDS>& out_program) {
+  // Parser state carried from one line of an upload to the next.
+  struct Context {
+    struct Repeat {
+      uint16_t count;
+      Eigen::Vector2d step;
+    };
+
+    bool abs = true;
+    Eigen::Vector2d pos = Eigen::Vector2d::Zero();
+    bool in_sub = false;
+    Eigen::Vector2d caller_pos = Eigen::Vector2d::Zero();  // Back after ENDSUB
+    Repeat repeats[PROGRAM_STACK_DEPTH];
+    uint8_t num_repeats = 0;
+    bool flow = false;  // Any subroutine or repeat block so far
+  };
+
+  static size_t parse(
+      std::string_view& input, std::array<GCommand, MAX_COMMANDS>& out_program,
+      const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
     size_t program_size = 0;
-    parse(input, out_program, program_size);
+    parse(input, out_program, program_size, transform);
     WebSerial.printf("Parsed %u gcode lines.\n", program_size);
     if (program_size < MAX_COMMANDS) {
       out_program[program_size++].type = GCommand::END;
     }
     return program_size;
   }
-  static size_t parse(std::string_view& input,
-                      std::array<GCommand, MAX_COMMANDS>& out_program,
-                      size_t& program_size) {
+  static size_t parse(
+      std::string_view& input, std::array<GCommand, MAX_COMMANDS>& out_program,
+      size_t& program_size,
+      const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
+    Context context;
+    return parse(input, out_program, program_size, context, transform);
+  }
+  static size_t parse(
+      std::string_view& input, std::array<GCommand, MAX_COMMANDS>& out_program,
+      size_t& program_size, Context& context,
+      const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
     trim(input);
 
-    bool cur_is_abs = true;
-    Eigen::Vector2d cur_pos(0, 0);
-
-    while (!input.empty() && program_size < MAX_COMMANDS) {
+    bool full = false;
+    while (!input.empty() && !full) {
+      const std::string_view rest = input;
       auto endline = input.find_first_of("\n\\");
       std::string_view line = input.substr(0, endline);
       if (endline == std::string_view::npos)
@@ -59,11 +135,33 @@ class GCodeParser {
       trim(line);
       if (line.empty() || line.front() == ';') continue;
 
-      GCommand cmd;
-      if (!parseCmd(line, cur_is_abs, cur_pos, cmd)) continue;
-      out_program[program_size++] = cmd;
+      // Parsed against a copy of the context, kept only once the commands
+      // fit: a line that doesn't is parsed again with the next upload.
+      GCommand cmds[MAX_COMMANDS_PER_LINE]{};
+      Context next = context;
+      const size_t n = parseCmd(line, next, cmds);
+      if (program_size + n > MAX_COMMANDS) {
+        input = rest;
+        full = true;
+        break;
+      }
+      context = next;
+      for (size_t i = 0; i < n; ++i) {
+        GCommand& cmd = cmds[i];
+        // Subroutines are drawn relative to their origin, and steps are
+        // offsets: neither is moved by the transform's translation.
+        if (cmd.type == GCommand::RAPID || cmd.type == GCommand::LINEAR ||
+            cmd.type == GCommand::CALL || cmd.type == GCommand::TEXT) {
+          cmd.target = context.in_sub ? (transform.linear() * cmd.target).eval()
+                                      : (transform * cmd.target).eval();
+        } else if (cmd.type == GCommand::REPEAT || cmd.type == GCommand::FONT) {
+          cmd.target = transform.linear() * cmd.target;
+        }
+        out_program[program_size++] = cmd;
+      }
+      full = program_size >= MAX_COMMANDS;
     }
-    if (program_size >= MAX_COMMANDS) {
+    if (full) {
       WebSerial.printf(
           "Ran out of gcode storage space!  Still %u characters remaining.\n",
           input.size());
@@ -72,17 +170,23 @@ class GCodeParser {
   }
 
  private:
-  static bool parseCmd(std::string_view& line, bool& cur_is_abs,
-                       Eigen::Vector2d& cur_pos, GCommand& cmd) {
+  static void parseError(std::string_view line) {
+    WebSerial.print(F("Failed to parse gcode line:\n\t"));
+    WebSerial.write(reinterpret_cast<const uint8_t*>(line.data()), line.size());
+  }
+
+  // Writes the commands for `line` to `cmds` and returns how many.
+  static size_t parseCmd(std::string_view& line, Context& context,
+                         GCommand* cmds) {
+    GCommand& cmd = cmds[0];
+    cmd.target = Eigen::Vector2d::Zero();  // Unless a move or call sets it
     if (starts_with(line, "G0 ") || starts_with(line, "G1 ")) {
       cmd.type = line[1] == '0' ? GCommand::RAPID : GCommand::LINEAR;
-      if (!parseMove(line.substr(3), cur_is_abs, cur_pos)) {
-        WebSerial.print(F("Failed to parse gcode line:\n\t"));
-        WebSerial.write(reinterpret_cast<const uint8_t*>(line.data()),
-                        line.size());
-        return false;
+      if (!parseMove(line.substr(3), context.abs, context.pos)) {
+        parseError(line);
+        return 0;
       } else {
-        cmd.target = cur_pos;
+        cmd.target = context.pos;
       }
     } else if (starts_with(line, "G4 ")) {
       cmd.type = GCommand::DWELL;
@@ -90,19 +194,25 @@ class GCodeParser {
       trimFront(line);
       if (line.empty() || line.front() != 'P' ||
           !parseNumbersNotInPlace(line.substr(1), cmd.dwell_ms)) {
-        WebSerial.print(F("Failed to parse gcode line:\n\t"));
-        WebSerial.write(reinterpret_cast<const uint8_t*>(line.data()),
-                        line.size());
-        return false;
+        parseError(line);
+        return 0;
       }
     } else if (starts_with(line, "G28")) {
       cmd.type = GCommand::HOME;
     } else if (starts_with(line, "G90")) {
-      cur_is_abs = true;
-      return false;  // this doesn't actually generate a command
+      context.abs = true;
+      return 0;  // this doesn't actually generate a command
     } else if (starts_with(line, "G91")) {
-      cur_is_abs = false;
-      return false;  // this doesn't actually generate a command
+      context.abs = false;
+      return 0;  // this doesn't actually generate a command
+    } else if (line.front() == 'O' || line.front() == 'o') {
+      return parseOWord(line, context, cmd);
+    } else if (starts_with(line, "M98")) {
+      return parseCall(line, context, cmds);
+    } else if (starts_with(line, "M99")) {
+      return endSub(line, context, cmd);
+    } else if (starts_with(line, "M800")) {
+      return parseText(line, context, cmds);
     } else if (starts_with(line, "M2") || starts_with(line, "M30")) {
       cmd.type = GCommand::END;
     } else if (starts_with(line, "M3")) {
@@ -110,14 +220,212 @@ class GCodeParser {
     } else if (starts_with(line, "M5")) {
       cmd.type = GCommand::PEN_UP;
     } else {
-      WebSerial.print(F("Failed to parse gcode line:\n\t"));
-      WebSerial.write(reinterpret_cast<const uint8_t*>(line.data()),
-                      line.size());
-      return false;
+      parseError(line);
+      return 0;
     }
+    return 1;
+  }
+
+  static bool isWord(std::string_view& line, std::string_view word) {
+    if (line.size() < word.size()) return false;
+    for (size_t i = 0; i < word.size(); ++i) {
+      const char c = line[i] >= 'a' && line[i] <= 'z' ? line[i] - 'a' + 'A' : line[i];
+      if (c != word[i]) return false;
+    }
+    line.remove_prefix(word.size());
+    trimFront(line);
     return true;
   }
 
+  // O<n> SUB / ENDSUB / REPEAT / ENDREPEAT, or O<n> alone (a subroutine).
+  static size_t parseOWord(std::string_view line, Context& context, GCommand& cmd) {
+    const std::string_view whole = line;
+    line.remove_prefix(1);
+    const std::optional<uint16_t> id = parseInt<uint16_t>(line);
+    trimFront(line);
+    if (!id) {
+      parseError(whole);
+      return 0;
+    }
+    cmd.flow = {*id, 0, 0};
+    cmd.target = Eigen::Vector2d::Zero();
+    if (line.empty() || isWord(line, "SUB")) {
+      if (context.in_sub) {
+        WebSerial.printf("Subroutine O%u defined inside another\n", *id);
+        return 0;
+      }
+      cmd.type = GCommand::SUB;
+      context.in_sub = true;
+      context.caller_pos = context.pos;
+      context.pos = Eigen::Vector2d::Zero();
+      context.flow = true;
+      return 1;
+    }
+    if (isWord(line, "ENDSUB")) return endSub(whole, context, cmd);
+    if (isWord(line, "ENDREPEAT")) {
+      if (context.num_repeats == 0) {
+        parseError(whole);
+        return 0;
+      }
+      const Context::Repeat& repeat = context.repeats[--context.num_repeats];
+      context.pos += (std::max<int>(repeat.count, 1) - 1) * repeat.step;
+      cmd.type = GCommand::REPEAT_END;
+      return 1;
+    }
+    if (isWord(line, "REPEAT")) {
+      if (!line.empty() && line.front() == '[') line.remove_prefix(1);
+      const std::optional<uint16_t> count = parseInt<uint16_t>(line);
+      trimFront(line);
+      if (!line.empty() && line.front() == ']') line.remove_prefix(1);
+      Eigen::Vector2d step = Eigen::Vector2d::Zero();
+      if (!count || !parseMove(line, false, step) ||
+          context.num_repeats == PROGRAM_STACK_DEPTH) {
+        parseError(whole);
+        return 0;
+      }
+      context.repeats[context.num_repeats++] = {*count, step};
+      cmd.type = GCommand::REPEAT;
+      cmd.flow.count = *count;
+      cmd.target = step;
+      context.flow = true;
+      return 1;
+    }
+    parseError(whole);
+    return 0;
+  }
+
+  static size_t endSub(std::string_view line, Context& context, GCommand& cmd) {
+    if (!context.in_sub) {
+      parseError(line);
+      return 0;
+    }
+    cmd.type = GCommand::RETURN;
+    context.in_sub = false;
+    context.pos = context.caller_pos;
+    return 1;
+  }
+
+  // M98 P<n> [X Y] [L<k> I J]: a repeat block around the call if k > 1.
+  static size_t parseCall(std::string_view line, Context& context, GCommand* cmds) {
+    const std::string_view whole = line;
+    line.remove_prefix(3);
+    trimFront(line);
+    std::optional<double> p, l, x, y, i, j;
+    while (!line.empty()) {
+      std::optional<double>* target;
+      switch (line.front()) {
+        case 'P': case 'p': target = &p; break;
+        case 'L': case 'l': target = &l; break;
+        case 'X': case 'x': target = &x; break;
+        case 'Y': case 'y': target = &y; break;
+        case 'I': case 'i': target = &i; break;
+        case 'J': case 'j': target = &j; break;
+        default:
+          parseError(whole);
+          return 0;
+      }
+      line.remove_prefix(1);
+      *target = parseFloat<double>(line);
+      if (!*target) {
+        parseError(whole);
+        return 0;
+      }
+      trim(line);
+    }
+    if (!p || *p < 0 || *p > UINT16_MAX || (l && (*l < 0 || *l > UINT16_MAX))) {
+      parseError(whole);
+      return 0;
+    }
+    Eigen::Vector2d origin = context.pos;
+    if (context.abs) {
+      if (x) origin(0) = *x;
+      if (y) origin(1) = *y;
+    } else {
+      origin += Eigen::Vector2d(x.value_or(0), y.value_or(0));
+    }
+    context.pos = origin;
+    context.flow = true;
+
+    const uint16_t count = l ? static_cast<uint16_t>(*l) : 1;
+    const Eigen::Vector2d step(i.value_or(0), j.value_or(0));
+    GCommand call{};
+    call.type = GCommand::CALL;
+    call.target = origin;
+    call.flow = {static_cast<uint16_t>(*p), 0, 0};
+    if (count == 1 && step.isZero()) {
+      cmds[0] = call;
+      return 1;
+    }
+    cmds[0].type = GCommand::REPEAT;
+    cmds[0].target = step;
+    cmds[0].flow = {0, 0, count};
+    cmds[1] = call;
+    cmds[2].type = GCommand::REPEAT_END;
+    cmds[2].target = Eigen::Vector2d::Zero();
+    cmds[2].flow = {0, 0, 0};
+    return 3;
+  }
+
+  // M800 [X Y] [H] [R] "text": a FONT, then the text in TEXT commands.
+  static size_t parseText(std::string_view line, Context& context, GCommand* cmds) {
+    const std::string_view whole = line;
+    line.remove_prefix(4);
+    trimFront(line);
+    std::optional<double> x, y, h, r;
+    while (!line.empty() && line.front() != '"') {
+      std::optional<double>* target;
+      switch (line.front()) {
+        case 'X': case 'x': target = &x; break;
+        case 'Y': case 'y': target = &y; break;
+        case 'H': case 'h': target = &h; break;
+        case 'R': case 'r': target = &r; break;
+        default:
+          parseError(whole);
+          return 0;
+      }
+      line.remove_prefix(1);
+      *target = parseFloat<double>(line);
+      if (!*target) {
+        parseError(whole);
+        return 0;
+      }
+      trimFront(line);
+    }
+    if (line.size() < 2 || line.back() != '"' || line.size() - 2 > TEXT_MAX_CHARS) {
+      parseError(whole);
+      return 0;
+    }
+    const std::string_view text = line.substr(1, line.size() - 2);
+
+    Eigen::Vector2d origin = context.pos;
+    if (context.abs) {
+      if (x) origin(0) = *x;
+      if (y) origin(1) = *y;
+    } else {
+      origin += Eigen::Vector2d(x.value_or(0), y.value_or(0));
+    }
+    const double angle = r.value_or(0) * M_PI / 180;
+    const Eigen::Vector2d axis = h.value_or(TEXT_DEFAULT_HEIGHT) / FONT_CAP_HEIGHT *
+                                 Eigen::Vector2d(std::cos(angle), std::sin(angle));
+    cmds[0].type = GCommand::FONT;
+    cmds[0].target = axis;
+    size_t n = 1;
+    int advance = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (i % TEXT_CHUNK_CHARS == 0) {
+        GCommand& chunk = cmds[n++];
+        chunk.type = GCommand::TEXT;
+        chunk.target = origin + advance * axis;
+        std::fill(std::begin(chunk.text), std::end(chunk.text), '\0');
+      }
+      cmds[n - 1].text[i % TEXT_CHUNK_CHARS] = text[i];
+      advance += StrokeFont::width(text[i]);
+    }
+    context.pos = origin + advance * axis;
+    context.flow = true;
+    return n;
+  }
+
   static bool parseMove(std::string_view line, bool is_abs,
                         Eigen::Vector2d& pos) {
     std::optional<double> x, y;
@@ -1,12 +1,39 @@
 #pragma once
 
+#include <LittleFS.h>
+
 #include "controller.h"
+#include "fixed_format.h"
 #include "gcode_parser.h"
+#include "hpgl_parser.h"
 #include "motors.h"
+#include "path_speed.h"
+#include "program_analysis.h"
+#include "program_flow.h"
+#include "stroke_merger.h"
+#include "stroke_orienter.h"
+#include "travel_planner.h"
+
+uint32_t movePenDown(bool down);
+uint32_t penClearMs();
 
-#define PEN_STATE_DELAY_MS 500
+// The loaded program is kept in flash so that an interrupted job can be
+// resumed after a reboot; the resume point is a separate small file so that
+// updating it doesn't rewrite the program.  While playing, the resume point
+// goes to RTC memory, which survives a reset but not a power cut, and only
+// every RESUME_FLASH_MS to flash; pausing and P0 save it to both.
+#define PROGRAM_PATH "/program.bin"
+#define RESUME_PATH "/resume.bin"
+#define RESUME_FLASH_MS 60000
+#define RESUME_RTC_BLOCK 96  // Offset into RTC user memory, 4-byte blocks
+// One seek checkpoint per this many commands: seeking replays at most
+// SEEK_INTERVAL - 1 commands, and the resume point is saved this often.
+// Programs with subroutines or repeats can play more commands than there are
+// checkpoints for; theirs are spread out further.
+#define SEEK_INTERVAL 32
 
-void movePenDown(bool down);
+constexpr char PROGRAM_MAGIC[4] = {'D', 'B', 'P', '1'};
+constexpr uint32_t RESUME_RTC_MAGIC = 0x44425250;  // "DBRP"
 
 class ProgramPlayer {
  public:
@@ -18,43 +45,217 @@ class ProgramPlayer {
         program_size_(0) {}
 
   bool loadProgram(std::string_view input) {
-    program_size_ = GCodeParser::parse(input, program_);
+    startTransform();
+    program_size_ = HpglParser::isHpgl(input)
+                        ? HpglParser::parse(input, program_, loaded_transform_)
+                        : GCodeParser::parse(input, program_, loaded_transform_);
+    has_flow_ = false;
+    played_size_ = 0;
+    for (size_t i = 0; i < program_size_; ++i) noteFlow(program_[i]);
+    analysis_.reset();
+    analyze(0);
+    orientStrokes_();
+    mergeLifts();
+    linkFlow();
     reset();
+    endTransform();
+    refreshAnalysis();
+    buildSeekIndex();
+    newProgram();
+    analysis_.print(program_size_);
     return input.empty();
   }
   void loadLine(std::string_view line) {
-    GCodeParser::parse(line, program_, program_size_);
+    const size_t prev_size = program_size_;
+    GCodeParser::parse(line, program_, program_size_, gcode_context_, loaded_transform_);
+    for (size_t i = prev_size; i < program_size_; ++i) noteFlow(program_[i]);
+    analyze(prev_size);
+  }
+  // The next piece of an HPGL upload, split anywhere.
+  void loadHpgl(std::string_view chunk) {
+    const size_t prev_size = program_size_;
+    hpgl_.feed(chunk, program_, program_size_, loaded_transform_);
+    analyze(prev_size);
   }
   void startUpload() {
     disabled_for_upload_ = true;
     program_size_ = 0;
+    has_flow_ = false;
+    played_size_ = 0;
+    gcode_context_ = GCodeParser::Context();
+    hpgl_.reset();
+    analysis_.reset();
+    startTransform();
     WebSerial.println(F("Upload starting..."));
     reset();
   }
   bool isUploading() const { return disabled_for_upload_; }
   void endUpload() {
     disabled_for_upload_ = false;
+    const size_t prev_size = program_size_;
+    hpgl_.finish(program_, program_size_, loaded_transform_);
+    analyze(prev_size);
+    orientStrokes_();
+    mergeLifts();
+    linkFlow();
     WebSerial.println(F("Upload finished, resetting program player."));
     reset();
+    endTransform();
+    refreshAnalysis();
+    buildSeekIndex();
+    newProgram();
+    analysis_.print(program_size_);
+  }
+  // Re-places the loaded program without re-parsing it: targets go through
+  // `placement_` as they are played, and only the statistics are redone.
+  void setTransform(const ProgramTransform& transform) {
+    place(transform);
+    if (disabled_for_upload_) return;
+    refreshAnalysis();
+    if (program_size_ > 0) save();
+  }
+
+  // Where the pen is, and whether it is down, just before command `n`.
+  struct Checkpoint {
+    Eigen::Vector2d pos;  // As stored, i.e. before the placement
+    bool at_home;         // At the home pose instead (which isn't placed)
+    bool pen_down;
+  };
+  Eigen::Vector2d position(const Checkpoint& cp) const {
+    return cp.at_home ? Eigen::Vector2d::Zero().eval() : (placement_ * cp.pos).eval();
+  }
+  Checkpoint seek(size_t n) const {
+    const SeekPoint& point = checkpoints_[n / seek_interval_];
+    Checkpoint cp = point.at;
+    if (!has_flow_) {
+      for (size_t i = n - n % seek_interval_; i < n; ++i) advance(cp, program_[i]);
+      return cp;
+    }
+    for (ProgramCursor cursor = point.cursor; cursor.step() < n;
+         cursor.next(program_, program_size_)) {
+      advance(cp, cursor.command(program_));
+    }
+    return cp;
+  }
+
+  // Continues from command `n`: lifts the pen, travels to where command n
+  // starts, puts the pen back as it was there, and plays on.
+  bool resume(size_t n) {
+    if (n >= size() || disabled_for_upload_) return false;
+    const Checkpoint cp = seek(n);
+    index_ = n;
+    state_ = -1;
+    dwell_time_start_ = -1;
+    pen_was_down_ = cp.pen_down;
+    resume_move_.type = GCommand::RAPID;
+    resume_move_.target = position(cp);
+    resuming_ = true;
+    char buf[40 + Unsigned<>::kMaxChars + 2 * Fixed<2>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "Resuming at command " << Unsigned<>(n) << " from ("
+        << Fixed<2>(resume_move_.target(0)) << ", " << Fixed<2>(resume_move_.target(1))
+        << "), pen " << (cp.pen_down ? "down" : "up") << "\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+    play();
+    return true;
+  }
+  // The last saved resume point of this program, or -1 if there is none:
+  // from RTC memory if it survived, which is never older than flash.
+  size_t savedResumePoint() const {
+    uint32_t record[4];  // Magic, generation, index, ~(generation ^ index)
+    if (!ESP.rtcUserMemoryRead(RESUME_RTC_BLOCK, record, sizeof(record)) ||
+        record[0] != RESUME_RTC_MAGIC || record[3] != ~(record[1] ^ record[2]) ||
+        record[1] != generation_) {
+      File file = LittleFS.open(RESUME_PATH, "r");
+      if (!file || file.read(reinterpret_cast<uint8_t*>(record + 1), 2 * sizeof(uint32_t)) !=
+                       2 * sizeof(uint32_t)) {
+        return -1;
+      }
+    }
+    if (record[1] != generation_ || record[2] >= size()) return -1;
+    return record[2];
+  }
+  void saveResumePoint() { saveResumePoint(index_); }
+  // To RTC memory, and to flash as well if `flash`.
+  void saveResumePoint(size_t n, bool flash = true) {
+    if (program_size_ == 0 || n >= size()) return;
+    uint32_t record[4] = {RESUME_RTC_MAGIC, generation_, static_cast<uint32_t>(n)};
+    record[3] = ~(record[1] ^ record[2]);
+    ESP.rtcUserMemoryWrite(RESUME_RTC_BLOCK, record, sizeof(record));
+    saved_index_ = n;
+    if (!flash) return;
+    File file = LittleFS.open(RESUME_PATH, "w");
+    file.write(reinterpret_cast<const uint8_t*>(record + 1), 2 * sizeof(uint32_t));
+    file.close();
+    resume_flash_ms_ = millis();
+    ++resume_flash_writes_;
+  }
+  uint32_t resumeFlashWrites() const { return resume_flash_writes_; }
+  // Which saved program this is.
+  uint32_t generation() const { return generation_; }
+
+  // Reloads the program saved by the last load, paused.  Call at boot.
+  bool restore() {
+    File file = LittleFS.open(PROGRAM_PATH, "r");
+    char magic[4];
+    uint32_t size;
+    auto read = [&file](auto& v) {
+      return file.read(reinterpret_cast<uint8_t*>(&v), sizeof(v)) == sizeof(v);
+    };
+    if (!file || !read(magic) || memcmp(magic, PROGRAM_MAGIC, 4) != 0 ||
+        !read(generation_) || !read(size) || size > MAX_COMMANDS ||
+        !read(loaded_transform_) || !read(placement_) || !read(raw_min_) ||
+        !read(raw_max_)) {
+      return false;
+    }
+    program_size_ = 0;
+    for (; program_size_ < size && read(program_[program_size_]);) ++program_size_;
+    has_flow_ = false;
+    for (size_t i = 0; i < program_size_; ++i) noteFlow(program_[i]);
+    buildSeekIndex();
+    analysis_.reset();
+    analyze(0);
+    reset();
+    const size_t resume_at = savedResumePoint();
+    WebSerial.printf("Restored program (%zu commands).\n", this->size());
+    if (resume_at != static_cast<size_t>(-1)) {
+      WebSerial.printf("Interrupted at command %zu: J to resume from there.\n",
+                       resume_at);
+    }
+    return program_size_ == size;
   }
+  const ProgramAnalysis& analysis() const { return analysis_; }
+  void setMergeTolerance(double tolerance) { merge_tolerance_ = tolerance; }
+  // Commands played, counting every pass through subroutines and repeats;
+  // index(), command() and seek() count the same way.
+  size_t size() const { return has_flow_ ? played_size_ : program_size_; }
+  // Commands stored.
+  size_t stored() const { return program_size_; }
+  size_t index() const { return index_; }
+  // Command `i` as it will be played, i.e. with the placement applied.
+  GCommand command(size_t i) const { return played(i, cursor_); }
   size_t printLine(size_t i, char* buf, size_t max_chars) const;
   void printProgram() const;
   size_t printProgram(char* buf, size_t max_chars, size_t index) const;
   void print() const {
     WebSerial.printf(R"(
 GCodePlayer state:
-  program size: %zu
+  program size: %zu (%zu stored)
   paused: %d
   index: %zu
   state: %d
   disabled_for_upload: %d
   pen_was_down: %d
   dwell_time_start: %zu
+  pen transitions: %u, waited %ums
+  resume point: command %d, %u flash writes
   Current program line:
 )",
-                     program_size_, paused_, index_, state_,
-                     disabled_for_upload_, pen_was_down_, dwell_time_start_);
-    if (index_ >= 0 && index_ < program_size_) {
+                     size(), program_size_, paused_, index_, state_,
+                     disabled_for_upload_, pen_was_down_, dwell_time_start_,
+                     pen_transitions_, pen_wait_ms_, static_cast<int>(saved_index_),
+                     resume_flash_writes_);
+    if (index_ >= 0 && index_ < size()) {
       char buf[128];
       size_t cmd_written = printLine(index_, buf, sizeof(buf));
       WebSerial.write(reinterpret_cast<uint8_t*>(buf), cmd_written);
@@ -63,18 +264,33 @@ GCodePlayer state:
     }
   }
 
+  bool isPlaying() const { return !paused_; }
   void play() { paused_ = false; }
-  void pause() { paused_ = true; }
+  void pause() {
+    paused_ = true;
+    if (!isFinished()) saveResumePoint();
+  }
   void reset() {
     index_ = 0;
+    state_ = -1;
+    resuming_ = false;
+    saved_index_ = -1;
     paused_ = true;
+    pen_transitions_ = 0;
+    pen_wait_ms_ = 0;
     controller_.reset();
+    travel_planner.cancel();
+    path_speed.reset();
   }
 
   void update(const State& state) {
-    if (paused_ || disabled_for_upload_ || index_ >= program_size_) return;
+    if (paused_ || disabled_for_upload_ || index_ >= size()) return;
+    if (index_ % SEEK_INTERVAL == 0 && index_ != saved_index_) {
+      saveResumePoint(index_, millis() - resume_flash_ms_ >= RESUME_FLASH_MS);
+    }
 
-    const auto& cmd = program_[index_];
+    const GCommand cmd = resuming_ ? resume_move_ : command(index_);
+    if (cmd.type != GCommand::LINEAR) path_speed.reset();  // Wheels stop here
     switch (cmd.type) {
       case GCommand::RAPID: {  // lift pen, move, restore pen
         bool advance = [this, &cmd, &state](int& state_) {
@@ -82,22 +298,35 @@ GCodePlayer state:
             case -1:
               return true;
             case 0:
-              movePenDown(false);
+              // Travel can start as soon as the pen clears the paper; the
+              // rest of the lift overlaps with the move.
+              transition_ms_ = std::min(movePenDown(false), penClearMs());
+              if (travel_settings.plan) travel_planner.begin(state, cmd.target);
+              step_mode.request(false);  // Switched while the pen lifts
               return true;
             case 1:
-              return (!pen_was_down_) || (PEN_STATE_DELAY_MS);
+              return penWait();
             case 2:
+              if (!step_mode.request(false)) return false;
               controller_.setSetpoint(cmd.target);
+              travel_planner.go();
               return true;
             case 3:
-              return controller_.done(state);
+              return (!travel_planner.isMoving() || travel_planner.isArriving()) &&
+                     controller_.done(state);
             case 4:
-              if (pen_was_down_) movePenDown(true);
+              transition_ms_ = pen_was_down_ ? movePenDown(true) : 0;
+              step_mode.request(pen_was_down_);
               return true;
             case 5:
-              return (!pen_was_down_) || dwell(PEN_STATE_DELAY_MS);
+              return penWait();
             case 6:
-              ++index_;
+              if (!step_mode.request(pen_was_down_)) return false;
+              if (resuming_) {
+                resuming_ = false;  // Now at the start of command index_
+              } else {
+                ++index_;
+              }
               state_ = -1;
               return false;
             default:
@@ -112,17 +341,27 @@ GCodePlayer state:
       case GCommand::LINEAR:
         // move (leaving pen at whatever state it was at before this move)
         controller_.setSetpoint(cmd.target);
+        if (motion_params.speed_profile) planPathSpeed(state);
         if (controller_.done(state)) ++index_;
         break;
       case GCommand::PEN_DOWN:
-        movePenDown_(true);
-        if (dwell(PEN_STATE_DELAY_MS)) ++index_;
-        break;
-      case GCommand::PEN_UP:
-        movePenDown_(false);
-        if (dwell(PEN_STATE_DELAY_MS)) ++index_;
-        ++index_;
+      case GCommand::PEN_UP: {
+        const bool down = cmd.type == GCommand::PEN_DOWN;
+        if (state_ == -1) {
+          // Lowering has to finish before drawing; lifting only has to clear
+          // the paper before whatever comes next.
+          transition_ms_ = movePenDown_(down);
+          if (!down) transition_ms_ = std::min(transition_ms_, penClearMs());
+          step_mode.request(down);
+          state_ = 0;
+        }
+        if (state_ == 0 && penWait()) state_ = 1;
+        if (state_ == 1 && step_mode.request(down)) {
+          ++index_;
+          state_ = -1;
+        }
         break;
+      }
       case GCommand::DWELL:
         if (dwell(cmd.dwell_ms)) ++index_;
         break;
@@ -133,12 +372,17 @@ GCodePlayer state:
       case GCommand::END:
         ++index_;
         paused_ = true;
+        forgetResumePoint();  // Job done, nothing to resume
+        break;
+      default:  // Program flow, followed by command()
+        ++index_;
         break;
     }
   }
 
   // Returns true if finished
   bool dwell(size_t duration_ms) {
+    if (duration_ms == 0) return true;
     if (dwell_time_start_ == static_cast<size_t>(-1)) {
       dwell_time_start_ = millis();
     }
@@ -147,12 +391,23 @@ GCodePlayer state:
     return ret;
   }
 
-  void movePenDown_(bool down) {
-    movePenDown(down);
+  // Dwell for the current pen transition, keeping stats.
+  bool penWait() {
+    if (!dwell(transition_ms_)) return false;
+    if (transition_ms_ > 0) ++pen_transitions_;
+    pen_wait_ms_ += transition_ms_;
+    return true;
+  }
+
+  uint32_t movePenDown_(bool down) {
     pen_was_down_ = down;
+    return movePenDown(down);
   }
 
-  bool isFinished() const { return index_ >= program_size_; }
+  uint32_t penWaitMs() const { return pen_wait_ms_; }
+  uint32_t penTransitions() const { return pen_transitions_; }
+
+  bool isFinished() const { return index_ >= size(); }
 
  private:
   std::array<GCommand, MAX_COMMANDS> program_;
@@ -164,42 +419,264 @@ GCodePlayer state:
   size_t dwell_time_start_ = -1;
   size_t program_size_;
   bool disabled_for_upload_ = false;  // Used to disable execution during upload
+  GCodeParser::Context gcode_context_;  // Between the lines of an upload
+  HpglParser hpgl_;  // State of an HPGL upload between chunks
+  double merge_tolerance_ = PEN_MERGE_TOLERANCE;
+  uint32_t transition_ms_ = 0;
+  uint32_t pen_transitions_ = 0;
+  uint32_t pen_wait_ms_ = 0;
+
+  ProgramAnalysis analysis_;
+  bool analysis_stale_ = false;
+  // Stored targets are raw program coordinates mapped by loaded_transform_;
+  // playback maps them on through placement_.  raw_min_/raw_max_ bound the
+  // pen-down moves in raw coordinates, for fitting to the page.
+  Eigen::Affine2d loaded_transform_ = Eigen::Affine2d::Identity();
+  Eigen::Affine2d placement_ = Eigen::Affine2d::Identity();
+  Eigen::Vector2d raw_min_ = Eigen::Vector2d::Zero();
+  Eigen::Vector2d raw_max_ = Eigen::Vector2d::Zero();
+
+  // With subroutines or repeats, where the cursor was as well.
+  struct SeekPoint {
+    Checkpoint at;
+    ProgramCursor cursor;
+  };
+  static constexpr size_t NUM_SEEK_POINTS = (MAX_COMMANDS + SEEK_INTERVAL - 1) / SEEK_INTERVAL;
+  std::array<SeekPoint, NUM_SEEK_POINTS> checkpoints_;
+  size_t seek_interval_ = SEEK_INTERVAL;
+  bool has_flow_ = false;  // Subroutines or repeats: played through cursors
+  size_t played_size_ = 0;
+  // Where command() and the path speed lookahead last were, so that walking
+  // on from there is cheap.
+  mutable ProgramCursor cursor_, ahead_;
+  GCommand resume_move_{};
+  bool resuming_ = false;  // Travelling to resume_move_ before index_
+  size_t saved_index_ = -1;
+  uint32_t resume_flash_ms_ = 0;
+  uint32_t resume_flash_writes_ = 0;
+  uint32_t generation_ = 0;  // Which saved program a resume point is for
+
+  static void advance(Checkpoint& cp, const GCommand& cmd) {
+    switch (cmd.type) {
+      case GCommand::RAPID:  // Pen comes back down where it was
+      case GCommand::LINEAR:
+        cp.pos = cmd.target;
+        cp.at_home = false;
+        break;
+      case GCommand::HOME:
+        cp.at_home = true;
+        break;
+      case GCommand::PEN_DOWN:
+      case GCommand::PEN_UP:
+        cp.pen_down = cmd.type == GCommand::PEN_DOWN;
+        break;
+      default:
+        break;
+    }
+  }
+  void buildSeekIndex() {
+    Checkpoint cp{Eigen::Vector2d::Zero(), true, false};
+    seek_interval_ = SEEK_INTERVAL;
+    if (!has_flow_) {
+      for (size_t i = 0; i < program_size_; ++i) {
+        if (i % SEEK_INTERVAL == 0) checkpoints_[i / SEEK_INTERVAL].at = cp;
+        advance(cp, program_[i]);
+      }
+      return;
+    }
+    ProgramCursor cursor;
+    for (cursor.begin(program_, program_size_); !cursor.done(program_size_);) {
+      cursor.next(program_, program_size_);
+    }
+    played_size_ = cursor.step();
+    seek_interval_ = std::max<size_t>(
+        SEEK_INTERVAL, (played_size_ + NUM_SEEK_POINTS - 1) / NUM_SEEK_POINTS);
+    for (cursor.begin(program_, program_size_); !cursor.done(program_size_);
+         cursor.next(program_, program_size_)) {
+      if (cursor.step() % seek_interval_ == 0) {
+        checkpoints_[cursor.step() / seek_interval_] = {cp, cursor};
+      }
+      advance(cp, cursor.command(program_));
+    }
+    cursor_ = ahead_ = checkpoints_[0].cursor;
+    if (cursor.overflows() > 0) {
+      WebSerial.printf("Calls or repeats nested deeper than %d skipped %u times\n",
+                       PROGRAM_STACK_DEPTH, cursor.overflows());
+    }
+    if (played_size_ >= MAX_PLAYED_COMMANDS) {
+      WebSerial.printf("Stopping after %d played commands\n", MAX_PLAYED_COMMANDS);
+    }
+  }
+  // Command `i` as played, walking `cursor` there.
+  GCommand played(size_t i, ProgramCursor& cursor) const {
+    GCommand cmd{};
+    if (has_flow_) {
+      if (cursor.step() > i || i - cursor.step() >= seek_interval_) {
+        cursor = checkpoints_[i / seek_interval_].cursor;
+      }
+      while (cursor.step() < i) cursor.next(program_, program_size_);
+      cmd = cursor.command(program_);
+    } else {
+      cmd = program_[i];
+    }
+    if (cmd.type == GCommand::RAPID || cmd.type == GCommand::LINEAR) {
+      cmd.target = placement_ * cmd.target;
+    }
+    return cmd;
+  }
+  void noteFlow(const GCommand& cmd) {
+    if (cmd.type >= GCommand::SUB) has_flow_ = true;
+  }
+  // Once the stored program is final: resolves the flow commands, and
+  // analyzes the program as played, which streaming couldn't.
+  void linkFlow() {
+    if (!has_flow_) return;
+    const size_t errors = linkProgram(program_, program_size_);
+    buildSeekIndex();
+    analysis_.reset();
+    analyze(0);
+    WebSerial.printf("%zu commands stored play as %zu%s.\n", program_size_,
+                     played_size_, errors ? " (with errors)" : "");
+  }
+  void newProgram() {
+    ++generation_;
+    forgetResumePoint();
+    save();
+  }
+  void forgetResumePoint() {
+    uint32_t zeros[4] = {};
+    ESP.rtcUserMemoryWrite(RESUME_RTC_BLOCK, zeros, sizeof(zeros));
+    LittleFS.remove(RESUME_PATH);
+  }
+  void save() {
+    File file = LittleFS.open(PROGRAM_PATH, "w");
+    if (!file) return;
+    const uint32_t size = program_size_;
+    auto write = [&file](const auto& v) {
+      file.write(reinterpret_cast<const uint8_t*>(&v), sizeof(v));
+    };
+    file.write(reinterpret_cast<const uint8_t*>(PROGRAM_MAGIC), 4);
+    write(generation_);
+    write(size);
+    write(loaded_transform_);
+    write(placement_);
+    write(raw_min_);
+    write(raw_max_);
+    file.write(reinterpret_cast<const uint8_t*>(program_.data()),
+               program_size_ * sizeof(GCommand));
+    file.close();
+  }
+
+  void analyze(size_t from) {
+    if (has_flow_ && played_size_ == 0) return;  // Until linkFlow()
+    for (size_t i = from; i < size(); ++i) analysis_.add(command(i));
+  }
+  // Steps that change the program after it has streamed in only mark the
+  // statistics stale, so a load redoes them once, at the end.
+  void refreshAnalysis() {
+    if (!analysis_stale_) return;
+    analysis_stale_ = false;
+    analysis_.reset();
+    analyze(0);
+  }
+  void place(const ProgramTransform& transform) {
+    placement_ = transform.matrix(raw_min_, raw_max_) * loaded_transform_.inverse();
+    analysis_stale_ = true;
+  }
+  // A manual transform is applied as the program is parsed.  Fitting needs
+  // the bounding box first, so the program is parsed as is; the analysis
+  // collects the box while it streams in and endTransform() places it.
+  void startTransform() {
+    loaded_transform_ = program_transform.fit
+                            ? Eigen::Affine2d::Identity()
+                            : program_transform.matrix();
+    placement_ = Eigen::Affine2d::Identity();
+  }
+  void endTransform() {
+    const Eigen::Vector2d min = analysis_.boundsMin(), max = analysis_.boundsMax();
+    raw_min_ = raw_max_ = Eigen::Vector2d::Zero();
+    if (min(0) <= max(0)) {
+      // Bounds of the box's corners, which is exact unless the manual
+      // transform the program was loaded with rotated it.
+      const Eigen::Affine2d inverse = loaded_transform_.inverse();
+      raw_min_ = Eigen::Vector2d::Constant(INFINITY);
+      raw_max_ = Eigen::Vector2d::Constant(-INFINITY);
+      for (const auto& corner : {min, max, Eigen::Vector2d(min(0), max(1)),
+                                 Eigen::Vector2d(max(0), min(1))}) {
+        raw_min_ = raw_min_.cwiseMin(inverse * corner);
+        raw_max_ = raw_max_.cwiseMax(inverse * corner);
+      }
+    }
+    if (program_transform.fit) place(program_transform);
+  }
+  void orientStrokes_() {
+    // Reversing strokes would change every pass of a subroutine or repeat.
+    if (!travel_settings.orient_strokes || has_flow_) return;
+    const size_t reversed = orientStrokes(program_, program_size_);
+    if (reversed == 0) return;
+    analysis_stale_ = true;
+    WebSerial.printf("Reversed %u strokes.\n", reversed);
+  }
+  void mergeLifts() {
+    if (merge_tolerance_ <= 0) return;
+    size_t merged =
+        mergeStrokes(program_, program_size_, merge_tolerance_, &analysis_);
+    if (merged) WebSerial.printf("Merged %u pen lifts.\n", merged);
+  }
+  // Slides the speed profile's window on to the current command and fills it
+  // with the LINEAR moves that follow.
+  void planPathSpeed(const State& state) {
+    if (path_speed.covers(index_)) {
+      if (path_speed.first() == index_) return;
+      path_speed.advance(index_);
+    } else {
+      path_speed.begin(state, index_);
+    }
+    for (size_t i = path_speed.end(); i < size(); ++i) {
+      const GCommand cmd = played(i, ahead_);
+      if (cmd.type != GCommand::LINEAR || !path_speed.append(cmd.target)) break;
+    }
+    path_speed.finish();
+  }
 };
 
 size_t ProgramPlayer::printLine(size_t i, char* buf, size_t max_chars) const {
-  const auto& cmd = program_.at(i);
+  const GCommand cmd = command(i);
+  TextWriter out(buf, max_chars);
   switch (cmd.type) {
     case GCommand::RAPID:
-      return snprintf(buf, max_chars, "%3u: RAPID   (%.2f, %.2f)\n", i,
-                      cmd.target(0), cmd.target(1));
+      out << Unsigned<3>(i) << ": RAPID   (" << Fixed<2>(cmd.target(0)) << ", "
+          << Fixed<2>(cmd.target(1)) << ")\n";
       break;
     case GCommand::LINEAR:
-      return snprintf(buf, max_chars, "%3u: LINEAR  (%.2f, %.2f)\n", i,
-                      cmd.target(0), cmd.target(1));
+      out << Unsigned<3>(i) << ": LINEAR  (" << Fixed<2>(cmd.target(0)) << ", "
+          << Fixed<2>(cmd.target(1)) << ")\n";
       break;
     case GCommand::PEN_DOWN:
-      return snprintf(buf, max_chars, "%3u: PEN DOWN\n", i);
+      out << Unsigned<3>(i) << ": PEN DOWN\n";
       break;
     case GCommand::PEN_UP:
-      return snprintf(buf, max_chars, "%3u: PEN UP\n", i);
+      out << Unsigned<3>(i) << ": PEN UP\n";
       break;
     case GCommand::DWELL:
       // For simplicity, skip timing logic for now
-      return snprintf(buf, max_chars, "%3u: DWELL   (%.2f)\n", i, cmd.dwell_ms);
+      out << Unsigned<3>(i) << ": DWELL   (" << Fixed<2>(cmd.dwell_ms) << ")\n";
       break;
     case GCommand::HOME:
-      return snprintf(buf, max_chars, "%3u: HOME\n", i);
+      out << Unsigned<3>(i) << ": HOME\n";
       break;
     case GCommand::END:
-      return snprintf(buf, max_chars, "%3u: END\n", i);
+      out << Unsigned<3>(i) << ": END\n";
+      break;
+    default:  // Program flow is never played
       break;
   }
-  return 0;
+  return out.size();
 }
 
 void ProgramPlayer::printProgram() const {
   char buf[128];
-  for (size_t i = 0; i < program_size_; ++i) {
+  for (size_t i = 0; i < size(); ++i) {
     size_t cmd_written = printLine(i, buf, sizeof(buf));
     WebSerial.write(reinterpret_cast<uint8_t*>(buf), cmd_written);
   }
@@ -223,8 +700,7 @@ size_t ProgramPlayer::printProgram(char* buf, size_t max_chars,
 
   // If our "cache" is invalid, we need to re-scan from the start.
   if (index != prev_byte) {
-    for (start_cmd_index = 0; start_cmd_index < program_size_;
-         ++start_cmd_index) {
+    for (start_cmd_index = 0; start_cmd_index < size(); ++start_cmd_index) {
       size_t cmd_written = printLine(start_cmd_index, tmp_buf, sizeof(tmp_buf));
       if (cmd_written > sizeof(tmp_buf)) {
         // Failure.  Just return.
@@ -244,7 +720,7 @@ size_t ProgramPlayer::printProgram(char* buf, size_t max_chars,
   }
 
   // Now print the rest of the program.
-  for (; start_cmd_index < program_size_; ++start_cmd_index) {
+  for (; start_cmd_index < size(); ++start_cmd_index) {
     size_t cmd_written = printLine(start_cmd_index, buf, max_chars);
     if (cmd_written > max_chars) {
       // we got truncated.  Just pretend this entire line never got printed.
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+#include <ArduinoEigen.h>
+#include <WebSerial.h>
+
+#include "gcode_parser.h"
+#include "string_parsing.h"
+
+// HPGL front end: the same GCommand stream as GCodeParser from plotter files,
+//   IN;SP1;PU2627,663;PD2625,603,2615,593,...;PU;SP0;
+// which take a fraction of the bytes of one G1 line per point.  Supported:
+//   IN        initialize: pen up, absolute, at the origin
+//   SP n      select pen; SP0 (or SP alone) puts the pen away, i.e. lifts it
+//   PA / PR   absolute / relative coordinates, then moves with the pen as is
+//   PU / PD   lift / lower the pen, then moves (RAPID / LINEAR)
+// DF is accepted and does nothing; LB labels are skipped through their ETX;
+// anything else is counted and skipped.  Coordinates are plotter units, one
+// per HPGL_MM_PER_UNIT, and come out through `transform` like G-code ones.
+//
+// Parsing is a character at a time, so a statement or number may be split
+// anywhere between upload chunks and nothing is buffered beyond one number.
+#define HPGL_MM_PER_UNIT 0.025  // Plotter unit
+#define HPGL_MAX_NUMBER 16      // Characters kept of one parameter
+
+class HpglParser {
+ public:
+  // Whether `input` starts with an HPGL instruction rather than G-code.
+  static bool isHpgl(std::string_view input) {
+    trimFront(input);
+    if (input.size() < 2) return false;
+    const char name[2] = {upper(input[0]), upper(input[1])};
+    for (const char* known : {"IN", "DF", "SP", "PA", "PR", "PU", "PD"}) {
+      if (name[0] == known[0] && name[1] == known[1]) return true;
+    }
+    return false;
+  }
+
+  // Parses a whole program, like GCodeParser::parse.
+  static size_t parse(
+      std::string_view& input, std::array<GCommand, MAX_COMMANDS>& out_program,
+      const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
+    HpglParser parser;
+    size_t program_size = 0;
+    parser.feed(input, out_program, program_size, transform);
+    parser.finish(out_program, program_size, transform);
+    if (program_size < MAX_COMMANDS) {
+      out_program[program_size++].type = GCommand::END;
+    }
+    return program_size;
+  }
+
+  void reset() { *this = HpglParser(); }
+
+  // Parses the next piece of a stream, appending to `out_program`.
+  void feed(std::string_view& input,
+            std::array<GCommand, MAX_COMMANDS>& out_program,
+            size_t& program_size,
+            const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
+    Output out{out_program, program_size, transform};
+    for (; !input.empty() && program_size < MAX_COMMANDS; input.remove_prefix(1)) {
+      const char c = input.front();
+      if (in_label_) {
+        if (c == '\x03') endInstruction(out);
+        continue;
+      }
+      if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+        if (name_len_ == 2) endInstruction(out);  // ';' is optional
+        name_[name_len_++] = upper(c);
+        if (name_len_ == 2) beginInstruction(out);
+      } else if (name_len_ < 2) {
+        continue;  // Stray characters between instructions
+      } else if ((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+') {
+        if (number_len_ < HPGL_MAX_NUMBER) number_[number_len_++] = c;
+      } else if (c == ';') {
+        endInstruction(out);
+      } else {
+        endNumber(out);  // Commas, whitespace
+      }
+    }
+    if (program_size >= MAX_COMMANDS && !input.empty()) {
+      WebSerial.printf(
+          "Ran out of gcode storage space!  Still %u characters remaining.\n",
+          input.size());
+    }
+  }
+
+  // Ends the last instruction, which needs no terminator.
+  void finish(std::array<GCommand, MAX_COMMANDS>& out_program,
+              size_t& program_size,
+              const Eigen::Affine2d& transform = Eigen::Affine2d::Identity()) {
+    Output out{out_program, program_size, transform};
+    if (name_len_ == 2 && !in_label_) endInstruction(out);
+    if (instructions_ > 0) {
+      WebSerial.printf("Parsed %u HPGL instructions.\n", instructions_);
+    }
+    if (skipped_ > 0) {
+      WebSerial.printf("Skipped %u unsupported HPGL instructions.\n", skipped_);
+    }
+  }
+
+ private:
+  struct Output {
+    std::array<GCommand, MAX_COMMANDS>& program;
+    size_t& size;
+    const Eigen::Affine2d& transform;
+  };
+
+  static char upper(char c) { return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c; }
+  bool is(const char* name) const {
+    return name_[0] == name[0] && name_[1] == name[1];
+  }
+  bool isMove() const { return is("PA") || is("PR") || is("PU") || is("PD"); }
+
+  void beginInstruction(Output& out) {
+    ++instructions_;
+    params_ = 0;
+    have_x_ = false;
+    if (is("IN")) {
+      pen(out, false);
+      absolute_ = true;
+      pos_ = Eigen::Vector2d::Zero();
+    } else if (is("PA")) {
+      absolute_ = true;
+    } else if (is("PR")) {
+      absolute_ = false;
+    } else if (is("PU")) {
+      pen(out, false);
+    } else if (is("PD")) {
+      pen(out, true);
+    } else if (is("LB")) {
+      in_label_ = true;
+    } else if (!is("SP") && !is("DF")) {
+      ++skipped_;
+    }
+  }
+
+  void endInstruction(Output& out) {
+    endNumber(out);
+    if (is("SP") && params_ == 0) pen(out, false);
+    name_len_ = 0;
+    in_label_ = false;
+  }
+
+  void endNumber(Output& out) {
+    if (number_len_ == 0) return;
+    std::string_view text(number_, number_len_);
+    number_len_ = 0;
+    const std::optional<double> value = parseFloat<double>(text);
+    if (!value) return;
+    ++params_;
+    if (is("SP") && *value == 0) {
+      pen(out, false);
+    } else if (isMove()) {
+      if (!have_x_) {
+        x_ = *value;
+        have_x_ = true;
+      } else {
+        move(out, Eigen::Vector2d(x_, *value));
+        have_x_ = false;
+      }
+    }
+  }
+
+  void pen(Output& out, bool down) {
+    if (down == pen_down_) return;
+    pen_down_ = down;
+    GCommand cmd{};
+    cmd.type = down ? GCommand::PEN_DOWN : GCommand::PEN_UP;
+    push(out, cmd);
+  }
+
+  void move(Output& out, const Eigen::Vector2d& xy) {
+    pos_ = absolute_ ? xy : (pos_ + xy).eval();
+    GCommand cmd{};
+    cmd.type = pen_down_ ? GCommand::LINEAR : GCommand::RAPID;
+    cmd.target = out.transform * (pos_ * HPGL_MM_PER_UNIT);
+    push(out, cmd);
+  }
+
+  static void push(Output& out, const GCommand& cmd) {
+    if (out.size < MAX_COMMANDS) out.program[out.size++] = cmd;
+  }
+
+  char name_[2] = {};
+  uint8_t name_len_ = 0;
+  char number_[HPGL_MAX_NUMBER];
+  uint8_t number_len_ = 0;
+  bool in_label_ = false;
+  bool have_x_ = false;
+  double x_ = 0;
+  uint16_t params_ = 0;
+
+  bool absolute_ = true;
+  bool pen_down_ = false;
+  Eigen::Vector2d pos_ = Eigen::Vector2d::Zero();  // Plotter units
+
+  uint32_t instructions_ = 0, skipped_ = 0;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <LittleFS.h>
+#include <WebSerial.h>
+
+#define INPUT_LOG_PATH "/inputs.log"
+
+constexpr char INPUT_LOG_MAGIC[4] = {'D', 'B', 'I', '1'};
+
+// Records every external input (WebSerial messages and upload chunks) with
+// its arrival time, so a session can be replayed bit-for-bit on the host
+// (`doodlesim replay`).
+//
+// Layout: magic, uint32 micros() at start, then records:
+//   MESSAGE  varint(dt_us) varint(len) bytes
+//   UPLOAD   varint(dt_us) varint(index) final(u8) varint(len) bytes
+// where dt_us is the time since the previous record (or the start).
+class InputRecorder {
+ public:
+  enum Op : uint8_t { MESSAGE, UPLOAD };
+
+  void start() {
+    stop();
+    file_ = LittleFS.open(INPUT_LOG_PATH, "w");
+    if (!file_) return;
+    last_us_ = micros();
+    file_.write(reinterpret_cast<const uint8_t*>(INPUT_LOG_MAGIC),
+                sizeof(INPUT_LOG_MAGIC));
+    file_.write(reinterpret_cast<const uint8_t*>(&last_us_), sizeof(last_us_));
+    WebSerial.println(F("Recording inputs to " INPUT_LOG_PATH));
+  }
+  void stop() {
+    if (!file_) return;
+    WebSerial.printf("Recorded %u input bytes.\n", file_.size());
+    file_.close();
+  }
+  bool isRecording() const { return static_cast<bool>(file_); }
+  // Bytes in the log so far, flushed so that they can be read back while
+  // recording carries on.
+  size_t snapshot() {
+    if (file_) {
+      file_.flush();
+      return file_.size();
+    }
+    File file = LittleFS.open(INPUT_LOG_PATH, "r");
+    return file ? file.size() : 0;
+  }
+
+  void recordMessage(const uint8_t* data, size_t len) {
+    if (!file_) return;
+    writeHeader(MESSAGE);
+    writeVarint(len);
+    file_.write(data, len);
+  }
+  void recordUpload(size_t index, const uint8_t* data, size_t len,
+                    bool final) {
+    if (!file_) return;
+    writeHeader(UPLOAD);
+    writeVarint(index);
+    file_.write(final ? 1 : 0);
+    writeVarint(len);
+    file_.write(data, len);
+  }
+
+ private:
+  void writeHeader(Op op) {
+    const uint32_t now_us = micros();
+    file_.write(op);
+    writeVarint(now_us - last_us_);
+    last_us_ = now_us;
+  }
+  void writeVarint(uint32_t v) {
+    while (v >= 0x80) {
+      file_.write(static_cast<uint8_t>(v | 0x80));
+      v >>= 7;
+    }
+    file_.write(static_cast<uint8_t>(v));
+  }
+
+  File file_;
+  uint32_t last_us_ = 0;
+};
+
+InputRecorder input_recorder{};
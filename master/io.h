@@ -9,11 +9,18 @@
 #include <WebSerial.h>
 
 #include "Metro.h"
+#include "boot_log.h"
 #include "kinematics.h"
 #include "controller.h"
+#include "fixed_format.h"
 #include "motors.h"
 #include "string_parsing.h"
 #include "gcode_player.h"
+#include "input_recorder.h"
+#include "scheduler.h"
+#include "step_replay.h"
+#include "warm_restart.h"
+#include "wifi.h"
 
 Metro io_timer(15000);
 
@@ -37,12 +44,15 @@ void updateIo() {
 
 bool parseLine(std::string_view line);
 bool parseP(const std::string_view& input);
+void echoMove(const char* kind, double x, double y);
 
 void recvMsg(uint8_t* data, size_t len) {
+  input_recorder.recordMessage(data, len);
   std::string_view input(reinterpret_cast<char*>(data), len);
 
-  if (starts_with(input, "GCODE")) {
+  if (starts_with(input, "GCODE")) {  // G-code or HPGL, told apart on load
     std::string_view remaining = input.substr(5);
+    step_replay.unload();
     gcode_player.loadProgram(remaining);
     return;
   }
@@ -96,11 +106,12 @@ bool parseLine(std::string_view line) {
     case 'R':  // reset
       controller.reset();
       gcode_player.reset();
+      step_replay.reset();
       return true;
     case 'm': {
       double dx, dy;
       if (parseNumbers(line, dx, dy)) {
-        WebSerial.printf("Calling move relative on %.2f, %.2f\n", dx, dy);
+        echoMove("relative", dx, dy);
         controller.setSetpoint(controller.setpoint() + Eigen::Vector2d(dx, dy));
         return true;
       }
@@ -109,17 +120,36 @@ bool parseLine(std::string_view line) {
     case 'M': {
       Eigen::Vector2d xy;
       if (parseNumbers(line, xy(0), xy(1))) {
-        WebSerial.printf("Calling move absolute on %.2f, %.2f\n", xy(0), xy(1));
+        echoMove("absolute", xy(0), xy(1));
         controller.setSetpoint(xy);
         return true;
       }
       return false;
     }
+    case 'L': {  // pen lift merge tolerance, applied on the next load
+      double tolerance;
+      if (parseNumbers(line, tolerance)) {
+        gcode_player.setMergeTolerance(tolerance);
+        return true;
+      }
+      return false;
+    }
     case '>':
-      gcode_player.play();
+      if (step_replay.isLoaded()) {
+        step_replay.play();
+      } else {
+        gcode_player.play();
+      }
       return true;
+    case 'J': {  // resume: J<n> from command n, J alone from the saved point
+      size_t n = gcode_player.savedResumePoint();
+      if (!line.empty() && !parseNumbers(line, n)) return false;
+      step_replay.unload();
+      return gcode_player.resume(n);
+    }
     case '|':
       gcode_player.pause();
+      step_replay.pause();
       return true;
     case 'p':
       gcode_player.printProgram();
@@ -128,15 +158,128 @@ bool parseLine(std::string_view line) {
       estimator.print();
       controller.print();
       gcode_player.print();
+      if (step_replay.isLoaded()) step_replay.print();
+      return true;
+    case 'Q':  // record inputs: Q1 starts, Q0 stops (download /inputs.log)
+      if (line == "1") {
+        input_recorder.start();
+        return true;
+      } else if (line == "0") {
+        input_recorder.stop();
+        return true;
+      }
+      return false;
+    case 'K': {  // motion params: K alone prints them
+      if (line.empty()) {
+        motion_params.print();
+        path_speed.print();
+        return true;
+      }
+      MotionParams p = motion_params;
+      // The speed profile switch came later: 8 numbers leave it as it is.
+      if (!parseNumbersNotInPlace(line, p.max_steps_per_s, p.acceleration,
+                                  p.max_replan_ms, p.min_replan_ms,
+                                  p.lookahead_steps, p.max_step_unit,
+                                  p.done_tol_unit, p.servo_ms_per_deg,
+                                  p.speed_profile) &&
+          !parseNumbers(line, p.max_steps_per_s, p.acceleration,
+                        p.max_replan_ms, p.min_replan_ms, p.lookahead_steps,
+                        p.max_step_unit, p.done_tol_unit,
+                        p.servo_ms_per_deg)) {
+        return false;
+      }
+      motion_params = p;
+      applyMotionParams();
+      return true;
+    }
+    case 'V': {  // travel: V<plan pen-up moves>,<orient strokes>; V alone prints
+      if (line.empty()) {
+        travel_settings.print();
+        travel_planner.print();
+        return true;
+      }
+      int plan, orient;
+      if (!parseNumbers(line, plan, orient)) return false;
+      travel_settings.plan = plan;
+      travel_settings.orient_strokes = orient;
+      return true;
+    }
+    case 'W': {  // step mode: W<0 full, 1 half, 2 auto>[,<max half steps/s>]
+      if (line.empty()) {
+        step_mode.print();
+        return true;
+      }
+      int mode;
+      double half_rate = step_mode.max_half_steps_per_s;
+      if (!parseNumbersNotInPlace(line, mode, half_rate) &&
+          !parseNumbers(line, mode)) {
+        return false;
+      }
+      if (mode < STEP_MODE_FULL || mode > STEP_MODE_AUTO || half_rate <= 0) {
+        return false;
+      }
+      step_mode.setting = mode;
+      step_mode.max_half_steps_per_s = half_rate;
+      applyMotionParams();
+      return true;
+    }
+    case 'A': {  // placement: A alone prints it
+      if (line.empty()) {
+        program_transform.print();
+        return true;
+      }
+      ProgramTransform t = program_transform;
+      if (line.front() == 'F') {  // AF<page w>,<page h>,<margin>
+        line.remove_prefix(1);
+        if (!parseNumbers(line, t.page_w, t.page_h, t.margin)) return false;
+        t.fit = true;
+      } else {  // A<scale>,<rotation deg>,<dx>,<dy>
+        if (!parseNumbers(line, t.scale, t.rotation_deg, t.dx, t.dy)) {
+          return false;
+        }
+        t.fit = false;
+      }
+      program_transform = t;
+      program_transform.print();
+      gcode_player.setTransform(program_transform);
+      gcode_player.analysis().print(gcode_player.stored());
+      return true;
+    }
+    case 'N': {  // warm restart snapshots: N1 on, N0 off and forget them
+      if (line.empty()) {
+        warm_restart.print();
+        return true;
+      }
+      int on;
+      if (!parseNumbers(line, on)) return false;
+      warm_restart.enabled = on;
+      if (!on) warm_restart.discard();
+      return true;
+    }
+    case 'B':  // boot: time of each setup stage, and Wi-Fi since
+      boot_log.print();
+      wifi_link.print();
+      return true;
+    case 'T':  // scheduler timing stats
+      scheduler.print();
+      scheduler.resetStats();
       return true;
   }
   return false;
 }
 
+void echoMove(const char* kind, double x, double y) {
+  char buf[32 + 2 * Fixed<2>::kMaxChars];  // `kind` is "relative" or "absolute"
+  TextWriter out(buf, sizeof(buf));
+  out << "Calling move " << kind << " on " << Fixed<2>(x) << ", " << Fixed<2>(y) << "\n";
+  WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+}
+
 bool parseP(const std::string_view& input) {
   if (!input.empty()) {
     if (input.front() == '0') {
       motors_disabled = true;
+      gcode_player.saveResumePoint();
       return true;
     } else if (input.front() == '1') {
       motors_disabled = false;
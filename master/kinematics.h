@@ -4,12 +4,16 @@
 #include <ArduinoEigen.h>
 
 #include "constants.h"
+#include "robot_config.h"
 
 using Matrix32d = Eigen::Matrix<double, 3, 2>;
 using Matrix23d = Eigen::Matrix<double, 2, 3>;
 using Q = Eigen::Vector2d;  // right wheel, left wheel
 
-struct State {
+template <typename RobotT>
+struct StateT {
+  using Robot = RobotT;
+
   double x;
   double y;
   double cos, sin;
@@ -29,26 +33,35 @@ struct State {
   }
 
   Eigen::Vector2d pen() const {
-    return { x + cos * LENGTH_UNIT, y + sin * LENGTH_UNIT };
+    return { x + cos * Robot::length_unit, y + sin * Robot::length_unit };
+  }
+
+  // Starting pose: pen at the origin, facing +x.
+  static StateT home() {
+    return StateT{ .x = -Robot::length_unit, .y = 0, .cos = 1, .sin = 0 };
   }
 };
 
+using State = StateT<Robot>;
+
 /***** Jacobians: *****/
 
-Matrix32d state_D_q(const State& state) {
+template <typename RobotT>
+Matrix32d state_D_q(const StateT<RobotT>& state) {
   Matrix32d ret;
   ret.row(0) << state.cos / 2, state.cos / 2;
   ret.row(1) << state.sin / 2, state.sin / 2;
   // jacobian should be: limit_{dl -> 0} [atan(dl / WIDTH) / dl]
   //                   = limit_{dl -> 0} [atan(dl / WIDTH) / (dl / WIDTH)] / WIDTH
   //                   = 1 / WIDTH
-  ret.row(2) << 1.0 / WIDTH_UNIT, -1.0 / WIDTH_UNIT;
+  ret.row(2) << RobotT::inv_width_unit, -RobotT::inv_width_unit;
   return ret;
 }
 
-Matrix23d pen_D_state(const State& state) {
+template <typename RobotT>
+Matrix23d pen_D_state(const StateT<RobotT>& state) {
   Matrix23d ret;
-  ret.row(0) << 1, 0, -state.sin * LENGTH_UNIT;
-  ret.row(1) << 0, 1, state.cos * LENGTH_UNIT;
+  ret.row(0) << 1, 0, -state.sin * RobotT::length_unit;
+  ret.row(1) << 0, 1, state.cos * RobotT::length_unit;
   return ret;
 }
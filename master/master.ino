@@ -1,24 +1,45 @@
 #include <WebSerial.h>
 
+#include "boot_log.h"
 #include "motors.h"
 #include "wifi.h"
 #include "ota.h"
 #include "io.h"
 #include "ui.h"
+#include "scheduler.h"
+#include "storage.h"
+#include "telemetry.h"
+#include "warm_restart.h"
 
 void setup() {
+  // Offline first: the motors, servo and stored program come up before any
+  // network, which then connects in the background (updateWifi), so nothing
+  // here waits on the access point.  'B' prints the time of each stage.
+  boot_log.stage("storage", setupStorage);
+  boot_log.stage("motors", setupMotors);
+  boot_log.stage("program", [] { gcode_player.restore(); });
+  // Pose, step mode and job from before a reset, if any (see WarmRestart).
+  boot_log.stage("snapshot", [] { warm_restart.restore(); });
   // WebSerial is accessible at "<IP Address>/webserial" in browser
-  setupWifi();
-  setupOta();
-  setupIo();
-  setupUi();
-  setupMotors();
+  boot_log.stage("io", setupIo);
+  boot_log.stage("ui", setupUi);
+  boot_log.stage("ota", setupOta);
+  boot_log.stage("telemetry", setupTelemetry);
+  boot_log.stage("wifi", setupWifi);
+
+  // Steppers are serviced between every other task.  Periods and budgets are
+  // in microseconds; higher priority wins when several tasks are due.
+  scheduler.setStepTask(serviceSteppers);
+  scheduler.addTask("motors", updateMotors, 2000, 1500, 3);
+  scheduler.addTask("ota", updateOta, 20000, 2000, 2);
+  scheduler.addTask("io", updateIo, 100000, 5000, 1);
+  scheduler.addTask("ui", updateUi, 100000, 1000, 1);
+  scheduler.addTask("wifi", updateWifi, 100000, 1000, 0);
+  scheduler.addTask("telemetry", updateTelemetry, 10000, 1000, 1);
+  scheduler.addTask("snapshot", updateWarmRestart, SNAPSHOT_RTC_MS * 1000, 1000, 1);
+  boot_log.ready();
 }
 
 void loop() {
-  updateWifi();
-  updateOta();
-  updateIo();
-  updateUi();
-  updateMotors();
+  scheduler.update();
 }
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include <WebSerial.h>
+
+#include "constants.h"
+#include "fixed_format.h"
+
+// Servo slew time per degree (with load and margin).
+#define SERVO_MS_PER_DEG 3
+
+// Motion tuning knobs that interact (speed vs. tracking error vs. job time),
+// kept at runtime so they can be swept in simulation (host/tune.cpp) and set
+// from WebSerial with 'K' without reflashing.
+struct MotionParams {
+  double max_steps_per_s = MAX_STEPS_PER_S;
+  double acceleration = 100000.0;           // steps/s^2
+  uint32_t max_replan_ms = MOTOR_TICK_MS;   // Replan at least this often
+  uint32_t min_replan_ms = REPLAN_MIN_MS;   // ... and at most this often
+  long lookahead_steps = REPLAN_LOOKAHEAD_STEPS;
+  double max_step_unit = 5.0;               // Per wheel command
+  double done_tol_unit = 1.0;               // Setpoint reached
+  uint32_t servo_ms_per_deg = SERVO_MS_PER_DEG;
+  uint32_t speed_profile = 0;               // Pen speed from limits ahead (path_speed.h)
+
+  void print() const {
+    char buf[144 + 2 * Fixed<1>::kMaxChars + 4 * Unsigned<>::kMaxChars +
+             Fixed<0>::kMaxChars + 2 * Fixed<3>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nMotion params:\n  K" << Fixed<1>(max_steps_per_s) << "," << Fixed<1>(acceleration)
+        << "," << Unsigned<>(max_replan_ms) << "," << Unsigned<>(min_replan_ms) << ","
+        << Fixed<0>(lookahead_steps) << "," << Fixed<3>(max_step_unit) << ","
+        << Fixed<3>(done_tol_unit) << "," << Unsigned<>(servo_ms_per_deg) << ","
+        << Unsigned<>(speed_profile)
+        << "\n  (speed, accel, max/min replan ms, lookahead steps, max step, done tol,\n"
+           "   servo ms/deg, speed profile)\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+  }
+};
+
+MotionParams motion_params{};
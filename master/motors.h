@@ -5,34 +5,46 @@
 #include <Servo.h>
 
 #include "constants.h"
+#include "motion_params.h"
 #include "estimator.h"
 #include "controller.h"
 #include "gcode_player.h"
+#include "step_mode.h"
+#include "step_replay.h"
 #include "Metro.h"
 
 #define SERVO_UP_ANGLE 160
 #define SERVO_DOWN_ANGLE 60
+// How far the pen has to lift before it clears the paper.
+#define SERVO_CLEAR_DEG 30
 
-Metro motor_timer(50);
 Metro servo_timer(100);
 Metro motor_report_timer(5000);
 
 bool motors_disabled = false;
 int servo_target = SERVO_UP_ANGLE;
+uint32_t last_plan_ms = 0;
+Eigen::Vector2d planned_setpoint = Eigen::Vector2d::Zero();
 
-AccelStepper stepper1(AccelStepper::FULL4WIRE, D4, D2, D3, D1);
-AccelStepper stepper2(AccelStepper::FULL4WIRE, D8, D6, D7, D5);
+DriveStepper stepper1(D4, D2, D3, D1);
+DriveStepper stepper2(D8, D6, D7, D5);
 Servo servo;
 
-void applyDq(int64_t d1, int64_t d2);
-void movePenDown(bool down);
+void applyDq(int64_t d1, int64_t d2,
+             double max_speed = step_mode.maxStepsPerS());
+void applyDq(int64_t d1, int64_t d2, double speed1, double speed2);
+void applyMotionParams();
+void moveWheelsTo(long s1, long s2);
+uint32_t movePenDown(bool down);
+uint32_t penClearMs();
+uint32_t penSlewMs();
+bool runningOut(const AccelStepper& stepper);
+void serviceSteppers();
+bool switchStepMode(bool half);
+void updateControl();
 
 void setupMotors() {
-  stepper1.setMaxSpeed(500.0);
-  stepper1.setAcceleration(100000.0);
-
-  stepper2.setMaxSpeed(500.0);
-  stepper2.setAcceleration(100000.0);
+  applyMotionParams();
 
   servo.attach(TX);
 
@@ -40,40 +52,149 @@ void setupMotors() {
 }
 
 void updateMotors() {
+  // Replay: wheel targets come precompiled, so skip estimation and control.
+  if (step_replay.isPlaying()) {
+    // Streams are compiled in full steps.
+    if (!motors_disabled && switchStepMode(false)) {
+      step_replay.update(stepper1.currentPosition(),
+                         stepper2.currentPosition());
+    }
+  } else {
+    updateControl();
+  }
+  if (servo_timer.check() && !motors_disabled) {
+    servo.write(servo_target);
+  }
+}
+
+void updateControl() {
   // Estimate
   const int64_t cur_stepper1 = stepper1.currentPosition();
   const int64_t cur_stepper2 = stepper2.currentPosition();
   estimator.update(Eigen::Vector2d(cur_stepper1, cur_stepper2) *
-                   UNITS_PER_STEP);
-  // Control
-  if (motor_timer.check() && !motors_disabled) {
-    gcode_player.update(estimator.state());
-    if (!controller.done(estimator.state())) {
-      Eigen::Vector2d dq =
-          controller.getAction(estimator.state()) * STEPS_PER_UNIT;
-      // estimator.print();
-      // controller.print();
+                   step_mode.unitsPerStep());
+  if (motors_disabled) return;
+  gcode_player.update(estimator.state());
+  if (travel_planner.update(stepper1.currentPosition(),
+                            stepper2.currentPosition())) {
+    return;
+  }
+  switchStepMode(step_mode.wantsHalf());
+
+  // Control: replan before the wheels run out of command rather than on a
+  // fixed tick, so they don't sit idle waiting for it.
+  const uint32_t since_ms = millis() - last_plan_ms;
+  if (since_ms < motion_params.min_replan_ms) return;
+  const bool running_out = runningOut(stepper1) || runningOut(stepper2);
+  const bool new_setpoint = controller.setpoint() != planned_setpoint;
+  if (!running_out && !new_setpoint &&
+      since_ms < motion_params.max_replan_ms) {
+    return;
+  }
+  last_plan_ms = millis();
+  planned_setpoint = controller.setpoint();
+  if (!controller.done(estimator.state())) {
+    Eigen::Vector2d dq =
+        controller.getAction(estimator.state()) * step_mode.stepsPerUnit();
+    // estimator.print();
+    // controller.print();
+    if (motion_params.speed_profile) {
+      const Eigen::Vector2d speeds = path_speed.wheelSpeeds(
+          estimator.state(), gcode_player.index(), dq,
+          Eigen::Vector2d(stepper1.speed(), stepper2.speed()));
+      applyDq(dq(0), dq(1), speeds(0), speeds(1));
+    } else {
       applyDq(dq(0), dq(1));
     }
   }
-  if (servo_timer.check() && !motors_disabled) {
-    servo.write(servo_target);
+}
+
+// Near enough the end of its command that it should get the next one.  With
+// the speed profile, that is before the wheel would start braking for the
+// end: the profile, not the command length, decides when to slow down.
+bool runningOut(const AccelStepper& stepper) {
+  long lookahead = motion_params.lookahead_steps;
+  if (motion_params.speed_profile) {
+    lookahead += stepper.speed() * stepper.speed() / (2 * step_mode.acceleration());
   }
+  return std::abs(stepper.distanceToGo()) <= lookahead;
+}
+
+// Called by the scheduler between every other task, so keep this lean.
+void serviceSteppers() {
   stepper1.run();
   stepper2.run();
 }
 
-// Applies delta-wheel motions
-void applyDq(int64_t d1, int64_t d2) {
+// Switches both wheels to half or full steps once they rest, first taking
+// a half step onto a two-coil phase if full steps need one.  Not while a
+// travel plan owns the wheels.  Returns true once in that mode.
+bool switchStepMode(bool half) {
+  if (half == step_mode.half()) return true;
+  if (!stepper1.atRest() || !stepper2.atRest()) return false;
+  if (!half && !(stepper1.onFullStep() && stepper2.onFullStep())) {
+    applyDq(!stepper1.onFullStep(), !stepper2.onFullStep());
+    return false;
+  }
+  stepper1.setHalfStep(half);
+  stepper2.setHalfStep(half);
+  step_mode.switched(half);
+  applyMotionParams();
+  path_speed.reset();  // Planned in the old mode's steps
+  return true;
+}
+
+// Applies delta-wheel motions, the faster wheel at `max_speed` steps/s.
+void applyDq(int64_t d1, int64_t d2, double max_speed) {
   int64_t a1 = std::abs(d1), a2 = std::abs(d2);
   int64_t max = std::max(a1, a2);
-  stepper1.setMaxSpeed(500.0 * a1 / max);
-  stepper2.setMaxSpeed(500.0 * a2 / max);
+  if (max == 0) {
+    stepper1.move(0);
+    stepper2.move(0);
+    return;
+  }
+  applyDq(d1, d2, max_speed * a1 / max, max_speed * a2 / max);
+}
+
+// Applies delta-wheel motions, each wheel at its own top speed (steps/s).
+void applyDq(int64_t d1, int64_t d2, double speed1, double speed2) {
+  stepper1.setMaxSpeed(speed1);
+  stepper2.setMaxSpeed(speed2);
   // Now update the setpoints
   stepper1.move(d1);
   stepper2.move(d2);
 }
 
-void movePenDown(bool down) {
-  servo_target = down ? SERVO_DOWN_ANGLE : SERVO_UP_ANGLE;
+// Moves both wheels to absolute step targets, keeping them in sync.
+void moveWheelsTo(long s1, long s2) {
+  applyDq(s1 - stepper1.currentPosition(), s2 - stepper2.currentPosition());
+}
+
+// Pushes motion_params settings that the steppers hold themselves.
+void applyMotionParams() {
+  stepper1.setMaxSpeed(step_mode.maxStepsPerS());
+  stepper1.setAcceleration(step_mode.acceleration());
+
+  stepper2.setMaxSpeed(step_mode.maxStepsPerS());
+  stepper2.setAcceleration(step_mode.acceleration());
+}
+
+// Returns how long (ms) the servo needs to reach the new angle.
+uint32_t movePenDown(bool down) {
+  const int target = down ? SERVO_DOWN_ANGLE : SERVO_UP_ANGLE;
+  const uint32_t transition_ms =
+      std::abs(target - servo_target) * motion_params.servo_ms_per_deg;
+  servo_target = target;
+  if (!motors_disabled) servo.write(servo_target);
+  return transition_ms;
+}
+
+uint32_t penClearMs() {
+  return SERVO_CLEAR_DEG * motion_params.servo_ms_per_deg;
+}
+
+// Full up <-> down transition.
+uint32_t penSlewMs() {
+  return std::abs(SERVO_UP_ANGLE - SERVO_DOWN_ANGLE) *
+         motion_params.servo_ms_per_deg;
 }
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <ArduinoEigen.h>
+
+#include "kinematics.h"
+#include "motion_params.h"
+
+// Seconds a wheel takes over `distance` starting at `from` (updated to its
+// speed at the end), speeding up and slowing down at `accel`, at most `top`
+// and slowing to at most `end` by the end.
+inline double rampTime(double distance, double& from, double top, double end,
+                       double accel) {
+  if (distance <= 0) return 0;
+  const double v0 = from;
+  const double v1 = std::min({end, top, std::sqrt(v0 * v0 + 2 * accel * distance)});
+  const double peak =
+      std::max({v0, v1, std::min(top, std::sqrt(accel * distance + (v0 * v0 + v1 * v1) / 2))});
+  const double ramps = (2 * peak * peak - v0 * v0 - v1 * v1) / (2 * accel);
+  from = v1;
+  return (2 * peak - v0 - v1) / accel + std::max(0.0, distance - ramps) / peak;
+}
+
+// A wheel's acceleration, and the speed AccelStepper starts (and stops) at,
+// in units/s^2 and units/s.
+inline double wheelAccel() {
+  return motion_params.acceleration / Robot::steps_per_unit;
+}
+inline double wheelStartSpeed() {
+  return 0.676 * std::sqrt(2.0 * motion_params.acceleration) / Robot::steps_per_unit;
+}
+
+// Seconds for a wheel move from a standstill to a standstill, as
+// moveWheelsTo runs one: up to speed `top` and back down to the start speed.
+inline double stoppingMoveTime(double distance, double top) {
+  const double start = std::min(wheelStartSpeed(), top);
+  double from = start;
+  return rampTime(distance, from, top, start, wheelAccel());
+}
+
+// Time for the controller to bring the pen to a target, worked out in closed
+// form rather than by replaying Controller::getAction.
+//
+// The controller drives the pen straight at its setpoint.  With beta the
+// angle from the heading to that line, the pen moving ds turns the robot
+// by sin(beta) ds / L and the axle forwards cos(beta) ds, so
+//   tan(beta / 2) = tan(beta0 / 2) * exp(-s / L)
+// and the travel integrates exactly.  The busier wheel covers
+// |cos beta| + (W / L) |sin beta| per unit of pen travel; that is split into
+// the wheel commands the controller would send (max_step_unit each) and
+// timed as ProgramAnalysis describes, from the wheel speeds the last move
+// left.
+class MoveTiming {
+ public:
+  void stop() { speeds_.setZero(); }
+
+  // Seconds for the pen to go straight from where `state` puts it to
+  // `target` with the wheels capped at `v_max` units/s; `state` is moved on
+  // to the pose at the end.
+  double steer(State& state, const Eigen::Vector2d& target, double v_max) {
+    const Eigen::Vector2d line = target - state.pen();
+    const double d = line.norm();
+    if (d < motion_params.done_tol_unit) return 0;
+
+    constexpr double L = Robot::length_unit, W = Robot::half_width_unit;
+    const Eigen::Vector2d u = line / d;
+    const double cos0 = state.cos * u(0) + state.sin * u(1);
+    const double sin0 = state.cos * u(1) - state.sin * u(0);
+    // t = tan(beta / 2) from t0 to t1, through 1 where the axle stops
+    // reversing.  Straight behind is taken as just off it.
+    const double t0 = std::clamp(sin0 / std::max(1 + cos0, 1e-16), -1e8, 1e8);
+    const double t1 = t0 * std::exp(-d / L);
+    const double tc = std::abs(t0) > 1 && std::abs(t1) < 1 ? std::copysign(1.0, t0) : t1;
+    Eigen::Vector2d wheels = Eigen::Vector2d::Zero();  // |travel| per wheel
+    double busy = 0;
+    const auto piece = [&](double ta, double tb, double length) {
+      const double forward = length + L * std::log((1 + tb * tb) / (1 + ta * ta));
+      const double turned = 2 * W * std::atan((ta - tb) / (1 + ta * tb));
+      wheels += Eigen::Vector2d(std::abs(forward + turned), std::abs(forward - turned));
+      busy += std::abs(forward) + std::abs(turned);
+    };
+    if (t0 == 0) {
+      wheels = Eigen::Vector2d::Constant(d);
+      busy = d;
+    } else {
+      const double first = tc == t1 ? d : L * std::log(std::abs(t0));
+      piece(t0, tc, first);
+      if (tc != t1) piece(tc, t1, d - first);
+    }
+
+    const double accel = wheelAccel();
+    const double start = wheelStartSpeed();
+    const double end = motion_params.speed_profile
+                           ? INFINITY
+                           : std::sqrt(2.0 * motion_params.acceleration *
+                                       motion_params.lookahead_steps) /
+                                 Robot::steps_per_unit;
+    const double min_s = motion_params.min_replan_ms / 1e3;
+    const int commands =
+        std::max(1, int(std::ceil(wheels.norm() / motion_params.max_step_unit)));
+
+    // Starting on the wheel that leads, stopping it first if it must reverse
+    const Eigen::Vector2d rates0 = rates(cos0, sin0);
+    const int w = std::abs(rates0(0)) >= std::abs(rates0(1)) ? 0 : 1;
+    double now = std::copysign(1.0, rates0(w)) * speeds_(w);
+    double seconds = 0;
+    if (now < 0) {
+      seconds = -now / accel;
+      now = 0;
+    }
+    double from = std::min(std::max(now, std::min(start, v_max)), v_max);
+    for (int i = 0; i < commands; ++i) {
+      const double was = from;
+      const double s = std::max(min_s, rampTime(busy / commands, from, v_max, end, accel));
+      seconds += s;
+      if (from == was) {  // The rest go the same
+        seconds += s * (commands - i - 1);
+        break;
+      }
+    }
+
+    // beta1 from t1, and the heading it leaves
+    const double cos1 = (1 - t1 * t1) / (1 + t1 * t1), sin1 = 2 * t1 / (1 + t1 * t1);
+    const Eigen::Vector2d rates1 = rates(cos1, sin1);
+    speeds_ = rates1 * from / rates1.cwiseAbs().maxCoeff();
+    const Eigen::Vector2d heading(u(0) * cos1 + u(1) * sin1, u(1) * cos1 - u(0) * sin1);
+    state = State{target(0) - L * heading(0), target(1) - L * heading(1), heading(0),
+                  heading(1)};
+    return seconds;
+  }
+
+ private:
+  // Wheel travel (right, left) per unit of pen travel
+  static Eigen::Vector2d rates(double cos_beta, double sin_beta) {
+    const double turn = Robot::half_width_unit / Robot::length_unit * sin_beta;
+    return Eigen::Vector2d(cos_beta + turn, cos_beta - turn);
+  }
+
+  Eigen::Vector2d speeds_ = Eigen::Vector2d::Zero();  // Units/s, signed
+};
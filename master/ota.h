@@ -4,6 +4,44 @@
 #include <ESP8266mDNS.h>
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
+#include <ESPAsyncWebServer.h>
+
+#include "ota_delta.h"
+#include "warm_restart.h"
+#include "wifi.h"
+
+// Credentials for ArduinoOTA and the /update page; set them in secrets.h.
+#ifndef OTA_USER
+#define OTA_USER "admin"
+#endif
+#ifndef OTA_PASSWORD
+#define OTA_PASSWORD "admin"
+#endif
+
+void handleFirmwareUpload(AsyncWebServerRequest* request, String filename,
+                          size_t index, uint8_t* data, size_t len, bool final);
+
+static const auto kFirmwarePage PROGMEM = R"rawliteral(
+<!DOCTYPE html>
+<html>
+<head>
+  <title>DoodleBot Firmware Update</title>
+  <meta name="viewport" content="width=device-width, initial-scale=1">
+</head>
+<body>
+  <h1>DoodleBot Firmware Update</h1>
+  <form action="/update" method="post" enctype="multipart/form-data">
+    <input type="file" name="firmware" accept=".bin,.gz,.dbd" required>
+    <input type="submit" value="Update">
+  </form>
+  <p>.bin or .bin.gz: full image.  .dbd: compressed or delta image from otapack.</p>
+</body>
+</html>
+)rawliteral";
+
+// Set once a web upload has committed a new image; the restart happens from
+// the loop so the HTTP response gets out first.
+bool ota_restart_pending = false;
 
 void setupOta() {
   // Port defaults to 8266
@@ -12,8 +50,7 @@ void setupOta() {
   // Hostname defaults to esp8266-[ChipID]
   ArduinoOTA.setHostname("doodlebot");
 
-  // No authentication by default
-  ArduinoOTA.setPassword("admin");
+  ArduinoOTA.setPassword(OTA_PASSWORD);
 
   // Password can be set with it's md5 value as well
   // MD5(admin) = 21232f297a57a5a743894a0e4a801fc3
@@ -27,6 +64,8 @@ void setupOta() {
       type = "filesystem";
     }
 
+    // Carry on from here after the restart.
+    warm_restart.save(true, true);
     // NOTE: if updating FS this would be the place to unmount FS using FS.end()
     WebSerial.println("Start updating " + type);
   });
@@ -37,6 +76,7 @@ void setupOta() {
     WebSerial.printf("Progress: %u%%\r", (progress / (total / 100)));
   });
   ArduinoOTA.onError([](ota_error_t error) {
+    warm_restart.hold(false);  // No restart coming
     WebSerial.printf("Error[%u]: ", error);
     if (error == OTA_AUTH_ERROR) {
       WebSerial.println("Auth Failed");
@@ -50,9 +90,86 @@ void setupOta() {
       WebSerial.println("End Failed");
     }
   });
-  ArduinoOTA.begin();
+
+  server.on("/update", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (!request->authenticate(OTA_USER, OTA_PASSWORD)) return request->requestAuthentication();
+    request->send(200, "text/html", kFirmwarePage);
+  });
+  // The upload handler drops chunks without the credentials; the completion
+  // handler asks for them.
+  server.on(
+      "/update", HTTP_POST,
+      [](AsyncWebServerRequest* request) {
+        if (!request->authenticate(OTA_USER, OTA_PASSWORD)) request->requestAuthentication();
+      },
+      handleFirmwareUpload);
 }
 
+// ArduinoOTA answers on the network, so it starts with the first connection.
+bool ota_started = false;
+
 void updateOta() {
+  if (!ota_started) {
+    if (!wifi_link.isConnected()) return;
+    ArduinoOTA.begin();
+    ota_started = true;
+  }
   ArduinoOTA.handle();
+  if (ota_restart_pending) {
+    ota_restart_pending = false;
+    warm_restart.save(true, true);
+    ESP.restart();
+  }
+}
+
+// DBD images go through OtaDeltaDecoder; anything else is handed to the
+// Updater as is (the core unpacks .bin.gz images itself).
+void handleFirmwareUpload(AsyncWebServerRequest* request, String filename,
+                          size_t index, uint8_t* data, size_t len, bool final) {
+  (void)filename;
+  enum Mode : uint8_t { RAW, DBD, FAILED };
+  static Mode mode = FAILED;
+  if (!request->authenticate(OTA_USER, OTA_PASSWORD)) {
+    mode = FAILED;  // Nothing is written; answered once the upload ends
+    return;
+  }
+  if (!index) {
+    mode = ota_delta::isDelta(data, len) ? DBD : RAW;
+    if (mode == RAW) {
+      Update.runAsync(true);
+      Update.begin((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000, U_FLASH);
+    } else {
+      ota_delta_decoder.begin();
+    }
+    WebSerial.printf("Firmware upload started (%s)\n",
+                     mode == RAW ? "raw" : "DBD");
+  }
+  if (mode == FAILED) return;  // Already answered
+
+  bool ok;
+  const char* error;
+  if (mode == RAW) {
+    ok = Update.isRunning() && Update.write(data, len) == len &&
+         (!final || Update.end(true));
+    error = "Updater failed";
+  } else {
+    ok = ota_delta_decoder.write(data, len) &&
+         (!final || ota_delta_decoder.end());
+    error = ota_delta_decoder.error();
+  }
+
+  if (!ok) {
+    if (Update.isRunning()) Update.end();  // Discards the partial image
+    WebSerial.printf("Firmware update failed: %s\n", error);
+    request->send(500, "text/plain", error);
+    mode = FAILED;
+    return;
+  }
+  if (final) {
+    WebSerial.printf("Firmware update done (%zu bytes received), restarting\n",
+                     index + len);
+    request->send(200, "text/plain", "Update done, restarting");
+    warm_restart.hold();
+    ota_restart_pending = true;
+  }
 }
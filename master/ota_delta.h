@@ -0,0 +1,246 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Updater.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Compressed / delta firmware images ("DBD" files), produced on the host by
+// `otapack` and streamed into flash by OtaDeltaDecoder.
+//
+// Layout: an OtaDeltaHeader, then a sequence of ops.  Each op starts with a
+// varint tag `len << 2 | kind`:
+//   LITERAL   bytes[len]   Copy the next `len` bytes of the file
+//   COPY_OUT  dist         Repeat `len` bytes from `dist` bytes back in the
+//                          output (dist <= OTA_DELTA_WINDOW)
+//   COPY_SRC  zz(delta)    Copy `len` bytes of the running firmware, starting
+//                          `delta` bytes after where the previous COPY_SRC
+//                          ended
+// `zz` is a zigzag varint.  A header with src_size == 0 is a plain compressed
+// image; otherwise the image is a delta that only applies on top of the
+// firmware whose size and CRC match.
+
+#define OTA_DELTA_WINDOW 4096  // Output history kept in RAM, bytes
+#define OTA_DELTA_FLUSH 1024   // Bytes handed to Update.write() at a time
+
+constexpr char OTA_DELTA_MAGIC[4] = {'D', 'B', 'D', '1'};
+
+struct OtaDeltaHeader {
+  char magic[4];
+  uint32_t out_size;  // Size of the new image
+  uint32_t src_size;  // Size of the image the delta applies to, or 0
+  uint32_t src_crc;
+  uint32_t out_crc;
+};
+
+namespace ota_delta {
+
+enum Kind : uint8_t { LITERAL, COPY_OUT, COPY_SRC };
+
+inline bool isDelta(const uint8_t* data, size_t len) {
+  return len >= sizeof(OTA_DELTA_MAGIC) &&
+         memcmp(data, OTA_DELTA_MAGIC, sizeof(OTA_DELTA_MAGIC)) == 0;
+}
+
+// Standard CRC-32 (as zlib), bitwise: no table to keep in RAM.
+inline uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// CRC of the running firmware's first `size` bytes of flash.
+inline uint32_t runningCrc(uint32_t size) {
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < size; offset += sizeof(buf)) {
+    const size_t n = std::min<uint32_t>(sizeof(buf), size - offset);
+    if (!ESP.flashRead(offset, buf, n)) return ~crc;  // Won't match
+    crc = crc32(crc, buf, n);
+  }
+  return crc;
+}
+
+}  // namespace ota_delta
+
+// Streams a DBD file into the OTA partition.  Input can arrive in chunks of
+// any size; RAM use is the fixed output window plus a small flash read buffer.
+// The last partial block is held back until the CRC checks out, so a corrupt
+// or mismatched image never gets marked bootable.
+class OtaDeltaDecoder {
+ public:
+  enum Status : uint8_t { IDLE, RUNNING, DONE, FAILED };
+
+  void begin() {
+    status_ = RUNNING;
+    state_ = HEADER;
+    header_fill_ = 0;
+    out_pos_ = flushed_ = src_pos_ = 0;
+    crc_ = 0;
+    varint_ = 0;
+    shift_ = 0;
+    error_ = "";
+  }
+
+  // Feeds the next chunk of the file.  Returns false once decoding has failed.
+  bool write(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len && status_ == RUNNING;) {
+      if (state_ == HEADER) {
+        const size_t n = std::min(len - i, sizeof(header_) - header_fill_);
+        memcpy(reinterpret_cast<uint8_t*>(&header_) + header_fill_, data + i, n);
+        header_fill_ += n;
+        i += n;
+        if (header_fill_ == sizeof(header_)) start();
+      } else if (state_ == LITERAL_BYTES) {
+        const size_t n = std::min<size_t>(len - i, remaining_);
+        for (size_t k = 0; k < n; ++k) put(data[i + k]);
+        i += n;
+        remaining_ -= n;
+        if (remaining_ == 0) state_ = TAG;
+      } else {
+        const uint8_t c = data[i++];
+        varint_ |= static_cast<uint32_t>(c & 0x7f) << shift_;
+        shift_ += 7;
+        if (c & 0x80) {
+          if (shift_ >= 35) fail("bad varint");
+          continue;
+        }
+        const uint32_t v = varint_;
+        varint_ = 0;
+        shift_ = 0;
+        op(v);
+      }
+    }
+    return status_ != FAILED;
+  }
+
+  // Call after the last chunk.  Verifies the image and commits it.
+  bool end() {
+    if (status_ != RUNNING) return false;
+    if (state_ != TAG || shift_ != 0) return fail("truncated");
+    if (out_pos_ != header_.out_size) return fail("size mismatch");
+    if (crc_ != header_.out_crc) return fail("CRC mismatch");
+    flush(out_pos_ - flushed_);
+    if (status_ != RUNNING) return false;
+    if (!Update.end()) return fail("Update.end failed");
+    status_ = DONE;
+    return true;
+  }
+
+  Status status() const { return status_; }
+  bool isRunning() const { return status_ == RUNNING; }
+  const char* error() const { return error_; }
+  uint32_t outSize() const { return header_.out_size; }
+  uint32_t written() const { return out_pos_; }
+  bool isDelta() const { return header_.src_size != 0; }
+
+ private:
+  enum State : uint8_t { HEADER, TAG, ARG, LITERAL_BYTES };
+
+  // Ending the Updater with bytes still outstanding discards the partition.
+  bool fail(const char* why) {
+    if (status_ == RUNNING && Update.isRunning()) Update.end();
+    status_ = FAILED;
+    error_ = why;
+    return false;
+  }
+
+  void start() {
+    state_ = TAG;
+    if (!ota_delta::isDelta(reinterpret_cast<const uint8_t*>(header_.magic), 4)) {
+      fail("not a DBD image");
+      return;
+    }
+    if (header_.src_size != 0 &&
+        (header_.src_size != ESP.getSketchSize() ||
+         ota_delta::runningCrc(header_.src_size) != header_.src_crc)) {
+      fail("delta is for a different firmware");
+      return;
+    }
+    Update.runAsync(true);  // Called from the web server's context
+    if (!Update.begin(header_.out_size, U_FLASH)) fail("Update.begin failed");
+  }
+
+  void op(uint32_t v) {
+    if (state_ == TAG) {
+      kind_ = v & 3;
+      remaining_ = v >> 2;
+      if (out_pos_ + remaining_ > header_.out_size) {
+        fail("output overrun");
+      } else if (kind_ == ota_delta::LITERAL) {
+        state_ = remaining_ ? LITERAL_BYTES : TAG;
+      } else if (kind_ == ota_delta::COPY_OUT || kind_ == ota_delta::COPY_SRC) {
+        state_ = ARG;
+      } else {
+        fail("bad op");
+      }
+      return;
+    }
+    state_ = TAG;
+    if (kind_ == ota_delta::COPY_OUT) {
+      if (v == 0 || v > OTA_DELTA_WINDOW || v > out_pos_) {
+        fail("bad distance");
+        return;
+      }
+      // Byte at a time: overlapping copies (dist < len) repeat a pattern.
+      for (; remaining_ > 0; --remaining_) put(window_[(out_pos_ - v) % OTA_DELTA_WINDOW]);
+    } else {
+      const int32_t delta = static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+      src_pos_ += delta;
+      if (src_pos_ + remaining_ > header_.src_size) {
+        fail("source overrun");
+        return;
+      }
+      uint8_t buf[64];
+      while (remaining_ > 0 && status_ == RUNNING) {
+        const size_t n = std::min<uint32_t>(sizeof(buf), remaining_);
+        if (!ESP.flashRead(src_pos_, buf, n)) {
+          fail("flash read failed");
+          return;
+        }
+        for (size_t k = 0; k < n; ++k) put(buf[k]);
+        src_pos_ += n;
+        remaining_ -= n;
+      }
+    }
+  }
+
+  void put(uint8_t c) {
+    crc_ = ota_delta::crc32(crc_, &c, 1);
+    window_[out_pos_ % OTA_DELTA_WINDOW] = c;
+    ++out_pos_;
+    if (out_pos_ % OTA_DELTA_FLUSH == 0 && out_pos_ < header_.out_size) {
+      flush(OTA_DELTA_FLUSH);
+    }
+  }
+
+  // Hands the next `n` unwritten bytes (within one window lap) to the Updater.
+  void flush(uint32_t n) {
+    if (n == 0 || status_ != RUNNING) return;
+    if (Update.write(&window_[flushed_ % OTA_DELTA_WINDOW], n) != n) {
+      fail("Update.write failed");
+      return;
+    }
+    flushed_ += n;
+  }
+
+  Status status_ = IDLE;
+  State state_ = HEADER;
+  OtaDeltaHeader header_{};
+  size_t header_fill_ = 0;
+  uint8_t kind_ = 0;
+  uint32_t remaining_ = 0;
+  uint32_t varint_ = 0;
+  uint8_t shift_ = 0;
+  uint32_t out_pos_ = 0, flushed_ = 0, src_pos_ = 0;
+  uint32_t crc_ = 0;
+  const char* error_ = "";
+  uint8_t window_[OTA_DELTA_WINDOW];
+};
+
+OtaDeltaDecoder ota_delta_decoder;
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <ArduinoEigen.h>
+#include <WebSerial.h>
+
+#include "fixed_format.h"
+#include "kinematics.h"
+#include "motion_params.h"
+#include "step_mode.h"
+
+// Pen speed limits along the drawing ahead, so that the wheels are never
+// asked for more than they can do.
+//
+// With the pen LENGTH ahead of the axle, the axle trails the pen like a
+// trailer: the pose along a pen path follows from the path alone, so the
+// wheel travel per unit of pen travel, rho = q_H_pen * direction, is known
+// before the robot gets there.  The window ahead is cut into samples of at
+// most PATH_SPEED_STEP_UNIT; on each, the pen speed v is bounded by
+//   |rho_i| dv/dt  <= acceleration       (wheel acceleration)
+// and where rho jumps between samples (corners) by
+//   |rho_i' - rho_i| v <= start speed + acceleration * tol / v
+// i.e. what a stepper changes at once, plus what it gains while the
+// controller rounds the corner: it heads for the next target from done_tol
+// out.
+// A forward and a backward pass over the window give the fastest profile
+// that can stop at the end of the window.  Wheel speed, and speeding up, are
+// limited as the commands go out, from the command itself and what the
+// wheels are actually doing.  The window slides on one command at a time, so
+// only the samples entering it are integrated.
+//
+// Wheel commands then run at the profile's speed for the stretch they cover
+// instead of with the faster wheel flat out, which is what the steppers'
+// acceleration ramps used to smear across corners.
+#define PATH_SPEED_COMMANDS 16    // Commands ahead in the window
+#define PATH_SPEED_SAMPLES 32     // Samples in the window
+#define PATH_SPEED_STEP_UNIT 2.0  // Longest sample
+
+class PathSpeed {
+ public:
+  void reset() {
+    num_commands_ = 0;
+    num_samples_ = 0;
+    speed_ = 0;
+  }
+
+  // The window holds command `index`.
+  bool covers(size_t index) const {
+    return index >= first_ && index < first_ + num_commands_;
+  }
+  size_t first() const { return first_; }
+  // Next command to append.
+  size_t end() const { return first_ + num_commands_; }
+
+  // Starts a window at command `first` with the robot at `state`.
+  void begin(const State& state, size_t first) {
+    first_ = first;
+    num_commands_ = 0;
+    num_samples_ = 0;
+    end_state_ = state;
+    end_pen_ = state.pen();
+  }
+
+  // Drops the commands before `index`.
+  void advance(size_t index) {
+    const size_t drop = std::min(index - first_, size_t{num_commands_});
+    size_t keep_from = 0;
+    while (keep_from < num_samples_ && samples_[keep_from].command < drop) ++keep_from;
+    std::copy(samples_ + keep_from, samples_ + num_samples_, samples_);
+    num_samples_ -= keep_from;
+    for (size_t i = 0; i < num_samples_; ++i) samples_[i].command -= drop;
+    std::copy(targets_ + drop, targets_ + num_commands_, targets_);
+    num_commands_ -= drop;
+    first_ += drop;
+  }
+
+  // Appends the LINEAR move to `target` at end().  Returns false when the
+  // window is full.
+  bool append(const Eigen::Vector2d& target) {
+    const size_t room = PATH_SPEED_SAMPLES - num_samples_;
+    if (num_commands_ == PATH_SPEED_COMMANDS || room == 0) return false;
+    const Eigen::Vector2d to_go = target - end_pen_;
+    const double length = to_go.norm();
+    const size_t pieces = std::min<size_t>(
+        room, std::max(1.0, std::ceil(length / PATH_SPEED_STEP_UNIT)));
+    const Eigen::Vector2d step = to_go / pieces;
+    for (size_t j = 0; j < pieces && length > 1e-9; ++j) {
+      const Eigen::Matrix2d q_H_pen =
+          (pen_D_state(end_state_) * state_D_q(end_state_)).inverse();
+      const Eigen::Vector2d dq = q_H_pen * step;
+      Sample& sample = samples_[num_samples_++];
+      sample.command = num_commands_;
+      sample.to_go = length * (pieces - j) / pieces;
+      sample.length = length / pieces;
+      const Eigen::Vector2d rho = dq * (step_mode.stepsPerUnit() / sample.length);
+      sample.rho[0] = rho(0);
+      sample.rho[1] = rho(1);
+      end_state_.update(state_D_q(end_state_) * dq);
+    }
+    targets_[num_commands_++] = target;
+    end_pen_ = target;
+    return true;
+  }
+
+  // Recomputes the profile after begin/advance/append.
+  void finish() {
+    const double v_max = step_mode.maxStepsPerS();
+    const double a_max = step_mode.acceleration();
+    const double jump = startSpeed();
+    const double blend = a_max * motion_params.done_tol_unit;
+    const size_t n = num_samples_;
+    if (n == 0) return;
+    // Boundary speeds: before sample 0, between samples, after the last.
+    bound_[0] = INFINITY;
+    for (size_t i = 1; i < n; ++i) {
+      const double change = std::max(std::abs(samples_[i].rho[0] - samples_[i - 1].rho[0]),
+                                     std::abs(samples_[i].rho[1] - samples_[i - 1].rho[1]));
+      // Positive root of  change * v^2 - jump * v - blend = 0.
+      bound_[i] = change > 0
+                      ? (jump + std::sqrt(jump * jump + 4 * change * blend)) / (2 * change)
+                      : INFINITY;
+    }
+    bound_[n] = std::min(v_max, jump) / rate(n - 1);  // Stopping from here is immediate
+    for (size_t i = 0; i < n; ++i) {
+      bound_[i + 1] = std::min<double>(
+          bound_[i + 1], std::sqrt(bound_[i] * bound_[i] +
+                                   2 * a_max / rate(i) * samples_[i].length));
+    }
+    for (size_t i = n; i-- > 0;) {
+      bound_[i] = std::min<double>(
+          bound_[i], std::sqrt(bound_[i + 1] * bound_[i + 1] +
+                               2 * a_max / rate(i) * samples_[i].length));
+    }
+  }
+
+  // Speeds (steps/s) for each wheel of wheel command `dq` (steps) at `state`
+  // on command `index`, with the wheels now turning at `wheel_speeds`
+  // (steps/s): what the profile allows over the pen travel the command
+  // covers before the next replan replaces it, then each wheel's brought
+  // within reach of what it is doing.  A wheel that can't turn round yet has
+  // its part of `dq` changed to braking the way it is going.
+  Eigen::Vector2d wheelSpeeds(const State& state, size_t index, Eigen::Vector2d& dq,
+                              const Eigen::Vector2d& wheel_speeds) {
+    const double wheel = profileSpeed(state, index, dq);
+    const double steps = dq.cwiseAbs().maxCoeff();
+    if (wheel < step_mode.maxStepsPerS()) ++limited_;
+    ++commands_;
+
+    // Wheel w is asked for wheel * u_w, u_w = |dq_w| / steps, which must be
+    // within reach of its speed now: a change of up to its start speed at
+    // once, and what it gains by the soonest replan.  And not a crawl that
+    // takes no step before the latest replan: AccelStepper only looks at a
+    // new speed after the next step.  Where some speed keeps both wheels in
+    // reach, the command stays on course at the one nearest the profile's;
+    // otherwise each wheel gets as near its part as it can, and one that
+    // can't turn round (or stop) yet brakes the way it is going.
+    const double v_max = step_mode.maxStepsPerS();
+    const double a_max = step_mode.acceleration();
+    const double reach = startSpeed() + a_max * motion_params.min_replan_ms / 1e3;
+    const double crawl = std::min(1e3 / motion_params.max_replan_ms, reach);
+    double lo[2], hi[2];  // Speeds wheel w can have the way dq_w turns it
+    bool brake[2];
+    double low = 0, high = v_max;
+    for (int w = 0; w < 2; ++w) {
+      const bool moves = std::abs(dq(w)) >= 1;
+      const double now = moves ? std::copysign(1.0, dq(w)) * wheel_speeds(w)
+                               : -std::abs(wheel_speeds(w));
+      lo[w] = std::max(0.0, now - reach);
+      hi[w] = std::min(v_max, now + reach);
+      brake[w] = hi[w] < (moves ? crawl : 0);
+      if (!moves || brake[w]) continue;
+      const double u = std::abs(dq(w)) / steps;
+      low = std::max(low, lo[w] / u);
+      high = std::min(high, hi[w] / u);
+    }
+    const bool on_course = !brake[0] && !brake[1] && low <= high;
+    Eigen::Vector2d speeds;
+    for (int w = 0; w < 2; ++w) {
+      const double u = steps > 0 ? std::abs(dq(w)) / steps : 0;
+      if (brake[w]) {
+        const double now = wheel_speeds(w);
+        dq(w) = std::copysign(std::ceil(now * now / (2 * a_max)), now);
+        speeds(w) = std::max(std::abs(now) - reach, crawl);
+        continue;
+      }
+      speeds(w) = on_course ? std::min(std::max(wheel, low), high) * u
+                            : std::min(std::max(wheel * u, lo[w]), hi[w]);
+      if (std::abs(dq(w)) >= 1) speeds(w) = std::max(speeds(w), crawl);
+    }
+    return speeds;
+  }
+
+  void print() const {
+    char buf[96 + 5 * Unsigned<>::kMaxChars + Fixed<1>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nPath speed:\n  window: commands " << Unsigned<>(first_) << ".."
+        << Unsigned<>(end()) << ", " << Unsigned<>(num_samples_) << " samples, "
+        << Fixed<1>(speed_) << " units/s now\n  wheel commands slowed: "
+        << Unsigned<>(limited_) << " of " << Unsigned<>(commands_) << "\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+  }
+
+ private:
+  struct Sample {
+    uint8_t command;  // In the window
+    float to_go;      // Pen distance to the command's target at the start
+    float length;
+    float rho[2];     // Wheel steps per unit of pen travel (right, left)
+  };
+
+  // Speed (steps/s) for the faster wheel of wheel command `dq`: the slowest
+  // the profile allows over the pen travel the command covers before the
+  // next replan, and no faster than that wheel can stop by its end.
+  double profileSpeed(const State& state, size_t index, const Eigen::Vector2d& dq) {
+    const double v_max = step_mode.maxStepsPerS();
+    if (!covers(index) || num_samples_ == 0) {
+      speed_ = 0;
+      return v_max;
+    }
+    const Eigen::Matrix2d pen_H_q = pen_D_state(state) * state_D_q(state);
+    const double travel = (pen_H_q * dq * step_mode.unitsPerStep()).norm();
+    if (travel < 1e-9) return v_max;
+
+    // Where the pen is on the window: the first sample of its command that
+    // still has the pen's distance to go ahead of it.
+    const uint8_t command = index - first_;
+    const double to_go = (targets_[command] - state.pen()).norm();
+    size_t i = 0;
+    while (i < num_samples_ && samples_[i].command < command) ++i;
+    while (i + 1 < num_samples_ && samples_[i + 1].command == command &&
+           samples_[i + 1].to_go >= to_go) {
+      ++i;
+    }
+    double x = 0;
+    if (i < num_samples_ && samples_[i].command == command) {
+      x = std::max(0.0, std::min<double>(samples_[i].length, samples_[i].to_go - to_go));
+    }
+    if (i == num_samples_) return v_max;
+
+    double v = speedAt(i, x);
+    const double horizon = std::min(travel, v * motion_params.max_replan_ms / 1e3);
+    for (double left = horizon; left > 0 && i < num_samples_;) {
+      const double room = samples_[i].length - x;
+      if (left <= room) {
+        v = std::min(v, speedAt(i, x + left));
+        break;
+      }
+      left -= room;
+      v = std::min<double>(v, bound_[++i]);
+      x = 0;
+    }
+    const double steps = dq.cwiseAbs().maxCoeff();
+    const double wheel = std::min({v_max, steps * v / travel,
+                                   std::sqrt(2 * step_mode.acceleration() * steps)});
+    speed_ = wheel * travel / steps;
+    return wheel;
+  }
+
+  // What AccelStepper starts (or stops) a wheel at without ramping.
+  static double startSpeed() {
+    return 0.676 * std::sqrt(2.0 * step_mode.acceleration());
+  }
+  // Steps of the busier wheel per unit of pen travel.
+  double rate(size_t i) const {
+    return std::max({std::abs(samples_[i].rho[0]), std::abs(samples_[i].rho[1]), 1e-6f});
+  }
+  // Pen speed `x` into sample i.
+  double speedAt(size_t i, double x) const {
+    const double a = 2 * step_mode.acceleration() / rate(i);
+    return std::min(std::sqrt(bound_[i] * bound_[i] + a * x),
+                    std::sqrt(bound_[i + 1] * bound_[i + 1] +
+                              a * std::max(0.0, samples_[i].length - x)));
+  }
+
+  size_t first_ = 0;
+  uint8_t num_commands_ = 0;
+  uint8_t num_samples_ = 0;
+  Eigen::Vector2d targets_[PATH_SPEED_COMMANDS];
+  Sample samples_[PATH_SPEED_SAMPLES];
+  float bound_[PATH_SPEED_SAMPLES + 1];  // Pen speed at sample boundaries
+  State end_state_;                      // Predicted pose at end()
+  Eigen::Vector2d end_pen_;
+  double speed_ = 0;  // Pen speed (units/s) last given
+  uint32_t commands_ = 0, limited_ = 0;
+};
+
+PathSpeed path_speed;
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+
+#include <WebSerial.h>
+
+#include "constants.h"
+#include "fixed_format.h"
+#include "gcode_parser.h"
+#include "kinematics.h"
+#include "move_timing.h"
+#include "step_mode.h"
+#include "travel_planner.h"
+
+uint32_t penClearMs();
+uint32_t penSlewMs();
+
+// Running statistics over a program, fed one command at a time as it is
+// parsed, so uploading a program also analyzes it without a second pass.
+//
+// The time estimate follows each move as the controller steers it
+// (MoveTiming, in closed form: a few dozen flops per move, so parsing keeps
+// up with the upload), with wheel speed capped at the step rate of the step
+// mode the move runs in and wheel commands at least
+// motion_params.min_replan_ms apart.  Each wheel speeds up and slows down at
+// motion_params.acceleration from where the last command left it, stopping
+// to turn round.  Without the speed profile (path_speed.h) a wheel also slows
+// for the end of every command, as AccelStepper does when the next command
+// comes lookahead_steps before the end; with it, wheels carry their speed on.
+class ProgramAnalysis {
+ public:
+  // Segment-length histogram buckets: < 0.25, < 0.5, < 1, ..., >= 16 units.
+  static constexpr size_t NUM_BUCKETS = 8;
+
+  ProgramAnalysis() { reset(); }
+
+  void reset() {
+    state_ = State::home();
+    pos_ = Eigen::Vector2d::Zero();
+    pen_down_ = false;
+    commands_ = 0;
+    lifts_ = 0;
+    pen_down_dist_ = pen_up_dist_ = 0;
+    min_ = Eigen::Vector2d::Constant(INFINITY);
+    max_ = Eigen::Vector2d::Constant(-INFINITY);
+    histogram_.fill(0);
+    time_ms_ = 0;
+    timing_.stop();
+  }
+
+  void add(const GCommand& cmd) {
+    ++commands_;
+    switch (cmd.type) {
+      case GCommand::RAPID:
+        // Lift (until clear), travel, lower again
+        if (pen_down_) {
+          time_ms_ += penClearMs() + penSlewMs();
+          ++lifts_;
+          timing_.stop();
+        }
+        addMove(cmd.target, false, travel_settings.plan);
+        break;
+      case GCommand::LINEAR:
+        addMove(cmd.target, pen_down_);
+        break;
+      case GCommand::HOME:
+        addMove(Eigen::Vector2d::Zero(), false);
+        break;
+      case GCommand::PEN_DOWN:
+        if (!pen_down_) time_ms_ += penSlewMs();
+        pen_down_ = true;
+        timing_.stop();  // The wheels wait for the pen
+        break;
+      case GCommand::PEN_UP:
+        if (pen_down_) {
+          time_ms_ += penClearMs();
+          ++lifts_;
+        }
+        pen_down_ = false;
+        timing_.stop();
+        break;
+      case GCommand::DWELL:
+        time_ms_ += cmd.dwell_ms;
+        timing_.stop();
+        break;
+      default:  // END; program flow is never played
+        break;
+    }
+  }
+
+  // A lift across a `gap` was merged into a pen-down move (see mergeStrokes).
+  void mergedLift(double gap) {
+    --lifts_;
+    pen_up_dist_ -= gap;
+    pen_down_dist_ += gap;
+    time_ms_ -= penClearMs() + penSlewMs();
+  }
+
+  double timeMs() const { return time_ms_; }
+  // Pen-down bounding box; min > max while nothing has been drawn.
+  const Eigen::Vector2d& boundsMin() const { return min_; }
+  const Eigen::Vector2d& boundsMax() const { return max_; }
+
+  // Room for toJson's text and numbers.
+  static constexpr size_t kJsonMaxChars =
+      192 + 3 * Fixed<1>::kMaxChars + 4 * Fixed<2>::kMaxChars +
+      (NUM_BUCKETS + 5) * Unsigned<>::kMaxChars;
+
+  size_t toJson(char* buf, size_t max_chars, size_t program_size) const {
+    const bool empty = min_(0) > max_(0);
+    const double bbox[] = {min_(0), min_(1), max_(0), max_(1)};
+    TextWriter out(buf, max_chars);
+    out << "{\"commands\":" << Unsigned<>(commands_)
+        << ",\"est_time_s\":" << Fixed<1>(time_ms_ / 1000.0)
+        << ",\"pen_down_dist\":" << Fixed<1>(pen_down_dist_)
+        << ",\"pen_up_dist\":" << Fixed<1>(pen_up_dist_) << ",\"lifts\":" << Unsigned<>(lifts_)
+        << ",\"bbox\":[";
+    for (size_t i = 0; i < 4; ++i) out << (i ? "," : "") << Fixed<2>(empty ? 0.0 : bbox[i]);
+    out << "],\"segment_histogram\":[";
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) out << (i ? "," : "") << Unsigned<>(histogram_[i]);
+    out << "],\"program_bytes\":" << Unsigned<>(program_size * sizeof(GCommand))
+        << ",\"program_capacity_bytes\":" << Unsigned<>(MAX_COMMANDS * sizeof(GCommand))
+        << ",\"free_heap\":" << Unsigned<>(ESP.getFreeHeap()) << "}";
+    return out.size();
+  }
+
+  void print(size_t program_size) const {
+    char buf[kJsonMaxChars];
+    const size_t n = toJson(buf, sizeof(buf), program_size);
+    WebSerial.write(reinterpret_cast<uint8_t*>(buf), std::min(n, sizeof(buf) - 1));
+    WebSerial.println();
+  }
+
+ private:
+  void addMove(const Eigen::Vector2d& target, bool drawing, bool planned = false) {
+    const double length = (target - pos_).norm();
+    (drawing ? pen_down_dist_ : pen_up_dist_) += length;
+    if (drawing) {
+      size_t bucket = 0;
+      for (double edge = 0.25; bucket + 1 < NUM_BUCKETS && length >= edge;
+           edge *= 2) {
+        ++bucket;
+      }
+      ++histogram_[bucket];
+      min_ = min_.cwiseMin(pos_).cwiseMin(target);
+      max_ = max_.cwiseMax(pos_).cwiseMax(target);
+    }
+    pos_ = target;
+
+    if (planned) {  // As the TravelPlanner would run it
+      const TravelPlan& plan = travel_search_.solve(state_, target);
+      if (plan.shape != TravelPlan::STEER) {
+        time_ms_ += plan.time_s * 1000.0;
+        state_ = plan.end;
+        timing_.stop();
+        return;
+      }
+    }
+
+    time_ms_ += timing_.steer(state_, target, step_mode.maxUnitsPerS(drawing)) * 1000.0;
+  }
+
+  State state_;
+  TravelSearch travel_search_;
+  Eigen::Vector2d pos_;
+  MoveTiming timing_;
+  bool pen_down_;
+  uint32_t commands_;
+  uint32_t lifts_;
+  double pen_down_dist_, pen_up_dist_;
+  Eigen::Vector2d min_, max_;  // Bounding box of pen-down moves
+  std::array<uint32_t, NUM_BUCKETS> histogram_;
+  double time_ms_;
+};
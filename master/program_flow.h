@@ -0,0 +1,324 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <ArduinoEigen.h>
+#include <WebSerial.h>
+
+#include "gcode_parser.h"
+#include "stroke_font.h"
+
+// Subroutines and repeat blocks (see GCodeParser) are stored as written and
+// played through a call stack, so a fill pattern takes the slots of one pass
+// however often it is drawn.
+//
+// The player, analysis and seek index only ever see the program as played:
+// ProgramCursor walks the stored commands in that order, skipping the flow
+// commands and moving each target by the origin of the call or pass it is
+// in.  TEXT commands play as their glyphs' strokes, read from the font as
+// the cursor gets there: for each stroke a RAPID to its start, PEN_DOWN,
+// LINEARs along it and PEN_UP.  A program without flow or text commands
+// plays in stored order.
+#define FLOW_NO_LINK 0xFFFF
+// Stop playing beyond this many commands (and four times as many flow
+// commands), e.g. for runaway nested repeats.
+#define MAX_PLAYED_COMMANDS 20000
+
+// Resolves the links between flow commands, after any pass that moves
+// commands around: a SUB to just past its RETURN, a CALL to the start of its
+// subroutine's body, and a REPEAT and its REPEAT_END to each other.  Broken
+// structure is reported; the commands involved are then skipped.  Returns
+// the number of errors.
+size_t linkProgram(std::array<GCommand, MAX_COMMANDS>& program,
+                   size_t program_size) {
+  size_t errors = 0;
+  uint16_t repeats[PROGRAM_STACK_DEPTH];
+  size_t num_repeats = 0, sub_repeats = 0;
+  size_t sub = FLOW_NO_LINK;
+  for (size_t i = 0; i < program_size; ++i) {
+    GCommand& cmd = program[i];
+    switch (cmd.type) {
+      case GCommand::SUB:
+        cmd.flow.link = program_size;  // Unless a RETURN turns up
+        sub = i;
+        sub_repeats = num_repeats;
+        break;
+      case GCommand::RETURN:
+        if (sub == FLOW_NO_LINK) break;  // Played as nothing
+        if (num_repeats != sub_repeats) {
+          WebSerial.printf("O%u ENDSUB inside a repeat block\n", program[sub].flow.id);
+          ++errors;
+          num_repeats = sub_repeats;
+        }
+        program[sub].flow.link = i + 1;
+        sub = FLOW_NO_LINK;
+        break;
+      case GCommand::REPEAT:
+        cmd.flow.link = FLOW_NO_LINK;
+        if (num_repeats == PROGRAM_STACK_DEPTH) {
+          WebSerial.printf("Repeat blocks nested deeper than %d\n", PROGRAM_STACK_DEPTH);
+          ++errors;
+          break;
+        }
+        repeats[num_repeats++] = i;
+        break;
+      case GCommand::REPEAT_END:
+        cmd.flow.link = FLOW_NO_LINK;
+        if (num_repeats == (sub == FLOW_NO_LINK ? 0 : sub_repeats) ||
+            program[repeats[num_repeats - 1]].flow.id != cmd.flow.id) {
+          WebSerial.printf("O%u ENDREPEAT without its REPEAT\n", cmd.flow.id);
+          ++errors;
+          break;
+        }
+        cmd.flow.link = repeats[--num_repeats];
+        program[cmd.flow.link].flow.link = i;
+        break;
+      default:
+        break;
+    }
+  }
+  if (sub != FLOW_NO_LINK) {
+    WebSerial.printf("O%u SUB without its ENDSUB\n", program[sub].flow.id);
+    ++errors;
+  }
+  for (size_t i = 0; i < num_repeats; ++i) {
+    WebSerial.printf("O%u REPEAT without its ENDREPEAT\n", program[repeats[i]].flow.id);
+    ++errors;
+  }
+
+  for (size_t i = 0; i < program_size; ++i) {
+    GCommand& call = program[i];
+    if (call.type != GCommand::CALL) continue;
+    call.flow.link = FLOW_NO_LINK;
+    for (size_t j = 0; j < program_size; ++j) {
+      if (program[j].type == GCommand::SUB && program[j].flow.id == call.flow.id) {
+        call.flow.link = j + 1;
+        break;
+      }
+    }
+    if (call.flow.link == FLOW_NO_LINK) {
+      WebSerial.printf("M98 P%u: no such subroutine\n", call.flow.id);
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+class ProgramCursor {
+ public:
+  // The CALL or REPEAT that opened a frame; for a REPEAT, passes left after
+  // this one.
+  struct Frame {
+    uint16_t from;
+    uint16_t left;
+  };
+
+  // At the first command played.
+  void begin(const std::array<GCommand, MAX_COMMANDS>& program, size_t program_size) {
+    *this = ProgramCursor();
+    settle(program, program_size);
+  }
+
+  // Commands played before this one.
+  size_t step() const { return step_; }
+  // The stored command.
+  size_t pc() const { return pc_; }
+  bool done(size_t program_size) const { return pc_ >= program_size; }
+  uint8_t depth() const { return depth_; }
+  // Calls or repeats skipped as too deeply nested.
+  uint32_t overflows() const { return overflows_; }
+
+  // The command as played: moves are placed by the frames' origins.
+  GCommand command(const std::array<GCommand, MAX_COMMANDS>& program) const {
+    GCommand cmd = program[pc_];
+    if (cmd.type == GCommand::TEXT) return stroke(cmd);
+    if (cmd.type == GCommand::RAPID || cmd.type == GCommand::LINEAR) {
+      cmd.target += origin_;
+    }
+    return cmd;
+  }
+
+  // On to the next command played.  Nothing is played after an END.
+  void next(const std::array<GCommand, MAX_COMMANDS>& program, size_t program_size) {
+    if (done(program_size)) return;
+    const GCommand& cmd = program[pc_];
+    ++step_;
+    if (step_ >= MAX_PLAYED_COMMANDS) {
+      pc_ = program_size;
+    } else if (cmd.type != GCommand::TEXT || !nextStroke(cmd)) {
+      pc_ = cmd.type == GCommand::END ? program_size : pc_ + 1;
+      settle(program, program_size);
+    }
+  }
+
+ private:
+  enum StrokeOp : uint8_t { MOVE_TO, LOWER, LINE_TO, LIFT };
+
+  // The command played at the text cursor of a TEXT command.
+  GCommand stroke(const GCommand& text) const {
+    GCommand cmd{};
+    cmd.type = op_ == MOVE_TO   ? GCommand::RAPID
+               : op_ == LOWER   ? GCommand::PEN_DOWN
+               : op_ == LINE_TO ? GCommand::LINEAR
+                                : GCommand::PEN_UP;
+    cmd.target = Eigen::Vector2d::Zero();
+    if (op_ == MOVE_TO || op_ == LINE_TO) {
+      const Eigen::Vector2d p = StrokeFont::point(point_);
+      cmd.target = origin_ + text.target + (advance_ + p(0)) * font_ +
+                   p(1) * Eigen::Vector2d(-font_(1), font_(0));
+    }
+    return cmd;
+  }
+
+  // Moves the text cursor to the first stroke of glyph `i` or after.  Returns
+  // false if the rest of the text has none.
+  bool beginGlyph(const GCommand& text, uint8_t i) {
+    for (; i < TEXT_CHUNK_CHARS && text.text[i] != '\0'; ++i) {
+      if (i > char_) advance_ += StrokeFont::width(text.text[char_]);
+      char_ = i;
+      if (StrokeFont::begin(text.text[i]) < StrokeFont::end(text.text[i])) {
+        point_ = StrokeFont::begin(text.text[i]);
+        op_ = MOVE_TO;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the text cursor on by one command.  Returns false at the end of
+  // the text.
+  bool nextStroke(const GCommand& text) {
+    const uint16_t next = StrokeFont::next(point_);
+    const bool at_end = next >= StrokeFont::end(text.text[char_]);
+    switch (op_) {
+      case MOVE_TO:
+        op_ = LOWER;
+        return true;
+      case LOWER:
+      case LINE_TO:
+        if (at_end || StrokeFont::penUp(next)) {
+          op_ = LIFT;
+        } else {
+          point_ = next;
+          op_ = LINE_TO;
+        }
+        return true;
+      case LIFT:
+        if (at_end) return beginGlyph(text, char_ + 1);
+        point_ = StrokeFont::next(next);
+        op_ = MOVE_TO;
+        return true;
+    }
+    return false;
+  }
+
+  // Follows flow commands from pc_ to the next command that is played.
+  void settle(const std::array<GCommand, MAX_COMMANDS>& program, size_t program_size) {
+    while (pc_ < program_size) {
+      // Repeats of nothing still take time to walk.
+      if (++flow_steps_ > 4 * MAX_PLAYED_COMMANDS) {
+        pc_ = program_size;
+        break;
+      }
+      const GCommand& cmd = program[pc_];
+      switch (cmd.type) {
+        case GCommand::SUB:  // Definitions are skipped where they stand
+          pc_ = cmd.flow.link;
+          break;
+        case GCommand::RETURN:
+          if (depth_ > 0 && program[frames_[depth_ - 1].from].type == GCommand::CALL) {
+            pc_ = frames_[--depth_].from + 1;
+            updateOrigin(program);
+          } else {
+            ++pc_;
+          }
+          break;
+        case GCommand::CALL:
+          if (cmd.flow.link == FLOW_NO_LINK || !push(pc_, 0)) {
+            ++pc_;
+            break;
+          }
+          origin_ += cmd.target;
+          pc_ = cmd.flow.link;
+          break;
+        case GCommand::REPEAT:
+          if (cmd.flow.link == FLOW_NO_LINK) {
+            ++pc_;  // Unmatched: the body once
+          } else if (cmd.flow.count == 0 || !push(pc_, cmd.flow.count - 1)) {
+            pc_ = cmd.flow.link + 1;
+          } else {
+            ++pc_;
+          }
+          break;
+        case GCommand::FONT:
+          font_ = cmd.target;
+          ++pc_;
+          break;
+        case GCommand::TEXT:
+          char_ = 0;
+          advance_ = 0;
+          if (beginGlyph(cmd, 0)) {
+            --flow_steps_;
+            return;
+          }
+          ++pc_;
+          break;
+        case GCommand::REPEAT_END: {
+          Frame* frame = depth_ > 0 ? &frames_[depth_ - 1] : nullptr;
+          if (cmd.flow.link == FLOW_NO_LINK || !frame || frame->from != cmd.flow.link) {
+            ++pc_;
+          } else if (frame->left > 0) {
+            --frame->left;
+            updateOrigin(program);
+            pc_ = frame->from + 1;
+          } else {
+            --depth_;
+            updateOrigin(program);
+            ++pc_;
+          }
+          break;
+        }
+        default:
+          --flow_steps_;
+          return;
+      }
+    }
+  }
+
+  bool push(uint16_t from, uint16_t left) {
+    if (depth_ == PROGRAM_STACK_DEPTH) {
+      ++overflows_;
+      return false;
+    }
+    frames_[depth_++] = {from, left};
+    return true;
+  }
+
+  // From the frames, rather than undoing sums.
+  void updateOrigin(const std::array<GCommand, MAX_COMMANDS>& program) {
+    origin_ = Eigen::Vector2d::Zero();
+    for (uint8_t i = 0; i < depth_; ++i) {
+      const GCommand& cmd = program[frames_[i].from];
+      origin_ += cmd.type == GCommand::CALL
+                     ? cmd.target
+                     : (cmd.flow.count - 1 - frames_[i].left) * cmd.target;
+    }
+  }
+
+  uint16_t pc_ = 0;
+  uint8_t depth_ = 0;
+  Frame frames_[PROGRAM_STACK_DEPTH];
+  size_t step_ = 0;
+  Eigen::Vector2d origin_ = Eigen::Vector2d::Zero();
+  uint32_t overflows_ = 0;
+  uint32_t flow_steps_ = 0;
+  // Text: one font unit along the baseline, and where in the TEXT command
+  // at pc_ the cursor is (glyph, its offset along the baseline in font
+  // units, point in kFontStrokes).
+  Eigen::Vector2d font_ = Eigen::Vector2d::Zero();
+  uint8_t char_ = 0;
+  int16_t advance_ = 0;
+  uint16_t point_ = 0;
+  StrokeOp op_ = MOVE_TO;
+};
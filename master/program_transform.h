@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+
+#include <ArduinoEigen.h>
+#include <WebSerial.h>
+
+#include "fixed_format.h"
+
+// Placement of a drawing on the page, set with the 'A' WebSerial command.
+//
+// Manual mode maps program point p to  scale * R(rotation) * p + (dx, dy).
+// Fit mode keeps the rotation but picks scale and offset so that the pen-down
+// bounding box fills a page_w x page_h page (lower-left corner at (dx, dy)),
+// less `margin` on every side, centred.
+struct ProgramTransform {
+  double scale = 1;
+  double rotation_deg = 0;
+  double dx = 0, dy = 0;
+  bool fit = false;
+  double page_w = 0, page_h = 0, margin = 0;
+
+  // The map for a program whose pen-down extent is `min`..`max` (only used
+  // in fit mode; an empty box leaves the drawing unscaled).
+  Eigen::Affine2d matrix(const Eigen::Vector2d& min = Eigen::Vector2d::Zero(),
+                         const Eigen::Vector2d& max = Eigen::Vector2d::Zero()) const {
+    const Eigen::Rotation2Dd rotation(rotation_deg * M_PI / 180.0);
+    Eigen::Affine2d m = Eigen::Affine2d::Identity();
+    if (!fit) {
+      m.translate(Eigen::Vector2d(dx, dy)).rotate(rotation).scale(scale);
+      return m;
+    }
+    const bool empty = !(min(0) <= max(0));
+    Eigen::Vector2d lo = Eigen::Vector2d::Constant(INFINITY);
+    Eigen::Vector2d hi = Eigen::Vector2d::Constant(-INFINITY);
+    for (const auto& corner : {min, max, Eigen::Vector2d(min(0), max(1)),
+                               Eigen::Vector2d(max(0), min(1))}) {
+      const Eigen::Vector2d p = rotation * (empty ? Eigen::Vector2d::Zero() : corner);
+      lo = lo.cwiseMin(p);
+      hi = hi.cwiseMax(p);
+    }
+    const Eigen::Vector2d size = hi - lo;
+    const Eigen::Vector2d room(page_w - 2 * margin, page_h - 2 * margin);
+    double s = INFINITY;
+    if (size(0) > 0) s = std::min(s, room(0) / size(0));
+    if (size(1) > 0) s = std::min(s, room(1) / size(1));
+    if (!std::isfinite(s) || s <= 0) s = 1;
+    const Eigen::Vector2d page_centre(dx + page_w / 2, dy + page_h / 2);
+    m.translate(page_centre).scale(s).translate(-(lo + hi) / 2).rotate(rotation);
+    return m;
+  }
+
+  void print() const {
+    char buf[96 + Fixed<3>::kMaxChars + 6 * Fixed<1>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "Transform: scale " << Fixed<3>(scale) << ", rotate " << Fixed<1>(rotation_deg)
+        << " deg, offset (" << Fixed<1>(dx) << ", " << Fixed<1>(dy) << ")";
+    if (fit) {
+      out << ", fit to " << Fixed<1>(page_w) << " x " << Fixed<1>(page_h) << " page, margin "
+          << Fixed<1>(margin);
+    }
+    out << "\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+  }
+};
+
+ProgramTransform program_transform{};
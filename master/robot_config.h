@@ -0,0 +1,44 @@
+#pragma once
+
+// Robot geometry and calibration.  Each chassis is a struct of constexpr
+// measurements; RobotGeometry derives everything the kinematics need from it
+// at compile time, so no reciprocals or unit conversions are left for runtime.
+// Pick the chassis with -DROBOT_CONFIG=<struct> (default DoodleBotV2).
+
+struct DoodleBotV2 {
+  static constexpr const char* name = "DoodleBotV2";
+  // 183mm = 3000 steps
+  static constexpr double steps_per_mm = 3000.0 / 183.0;
+  static constexpr double width_mm = 117.0;   // Wheel separation
+  static constexpr double length_mm = 125.0;  // Axle to pen
+  // For conditioning reasons, state could be kept in e.g. cm
+  static constexpr double mm_per_unit = 1.0;
+};
+
+// Larger chassis: same motors and wheels, wider track and longer pen arm.
+struct DoodleBotV2Large {
+  static constexpr const char* name = "DoodleBotV2Large";
+  static constexpr double steps_per_mm = 3000.0 / 183.0;
+  static constexpr double width_mm = 160.0;
+  static constexpr double length_mm = 170.0;
+  static constexpr double mm_per_unit = 1.0;
+};
+
+template <typename Config>
+struct RobotGeometry : Config {
+  static constexpr double width_unit = Config::width_mm / Config::mm_per_unit;
+  static constexpr double length_unit = Config::length_mm / Config::mm_per_unit;
+  static constexpr double half_width_unit = width_unit / 2;
+  static constexpr double inv_width_unit = 1.0 / width_unit;
+  static constexpr double steps_per_unit = Config::steps_per_mm * Config::mm_per_unit;
+  static constexpr double units_per_step = 1.0 / steps_per_unit;
+
+  static_assert(width_unit > 0 && length_unit > 0 && steps_per_unit > 0,
+                "Robot dimensions must be positive");
+};
+
+#ifndef ROBOT_CONFIG
+#define ROBOT_CONFIG DoodleBotV2
+#endif
+
+using Robot = RobotGeometry<ROBOT_CONFIG>;
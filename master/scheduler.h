@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <WebSerial.h>
+
+constexpr size_t MAX_TASKS = 8;
+
+// Cooperative scheduler with microsecond deadlines.
+//
+// Each call to `update()` runs at most one task -- the highest-priority task
+// whose deadline has passed (earliest deadline breaks ties) -- and then
+// services the step task.  So the steppers get a `run()` between every other
+// task, and the worst-case step jitter is bounded by the slowest single task
+// instead of the sum of all of them.
+class Scheduler {
+ public:
+  using TaskFn = void (*)();
+
+  struct Task {
+    const char* name = "";
+    TaskFn fn = nullptr;
+    uint32_t period_us = 0;  // 0 = run whenever nothing more urgent is due
+    uint32_t budget_us = 0;  // Runs longer than this count as overruns
+    uint8_t priority = 0;    // Higher runs first
+    uint32_t next_us = 0;
+
+    // Stats
+    uint32_t runs = 0;
+    uint32_t overruns = 0;
+    uint32_t missed = 0;  // Whole periods skipped because we fell behind
+    uint32_t max_run_us = 0;
+    uint32_t max_late_us = 0;
+  };
+
+  bool addTask(const char* name, TaskFn fn, uint32_t period_us,
+               uint32_t budget_us, uint8_t priority) {
+    if (num_tasks_ >= MAX_TASKS) return false;
+    Task& task = tasks_[num_tasks_++];
+    task = Task();
+    task.name = name;
+    task.fn = fn;
+    task.period_us = period_us;
+    task.budget_us = budget_us;
+    task.priority = priority;
+    task.next_us = now();
+    return true;
+  }
+  void setStepTask(TaskFn fn) { step_fn_ = fn; }
+
+  void update() {
+    const uint32_t cur_us = now();
+    Task* next = nullptr;
+    for (size_t i = 0; i < num_tasks_; ++i) {
+      Task& task = tasks_[i];
+      if (!due(task, cur_us)) continue;
+      if (!next || task.priority > next->priority ||
+          (task.priority == next->priority &&
+           static_cast<int32_t>(task.next_us - next->next_us) < 0)) {
+        next = &task;
+      }
+    }
+    if (next) run(*next, cur_us);
+    serviceSteps();
+  }
+
+  void serviceSteps() {
+    const uint32_t cur_us = now();
+    if (step_runs_ > 0) {
+      max_step_gap_us_ = std::max(max_step_gap_us_, cur_us - last_step_us_);
+    }
+    last_step_us_ = cur_us;
+    ++step_runs_;
+    if (step_fn_) step_fn_();
+  }
+
+  size_t numTasks() const { return num_tasks_; }
+  Task& task(size_t i) { return tasks_[i]; }
+  TaskFn stepTask() const { return step_fn_; }
+  uint32_t maxStepGapUs() const { return max_step_gap_us_; }
+
+  void resetStats() {
+    for (size_t i = 0; i < num_tasks_; ++i) {
+      Task& task = tasks_[i];
+      task.runs = task.overruns = task.missed = 0;
+      task.max_run_us = task.max_late_us = 0;
+    }
+    step_runs_ = 0;
+    max_step_gap_us_ = 0;
+  }
+
+  void print() const {
+    WebSerial.printf(R"(
+Scheduler:
+  step runs: %u, max step gap: %uus
+)",
+                     step_runs_, max_step_gap_us_);
+    for (size_t i = 0; i < num_tasks_; ++i) {
+      const Task& task = tasks_[i];
+      WebSerial.printf(
+          "  %-8s prio %u period %uus budget %uus: runs %u, overruns %u, "
+          "missed %u, max run %uus, max late %uus\n",
+          task.name, task.priority, task.period_us, task.budget_us, task.runs,
+          task.overruns, task.missed, task.max_run_us, task.max_late_us);
+    }
+  }
+
+ private:
+  static uint32_t now() { return static_cast<uint32_t>(micros()); }
+
+  static bool due(const Task& task, uint32_t cur_us) {
+    return static_cast<int32_t>(cur_us - task.next_us) >= 0;
+  }
+
+  void run(Task& task, uint32_t cur_us) {
+    task.max_late_us = std::max(task.max_late_us, cur_us - task.next_us);
+    task.fn();
+    const uint32_t elapsed_us = now() - cur_us;
+    ++task.runs;
+    task.max_run_us = std::max(task.max_run_us, elapsed_us);
+    if (elapsed_us > task.budget_us) ++task.overruns;
+
+    // Keep a fixed cadence, but don't try to "catch up" on periods we missed.
+    const uint32_t end_us = cur_us + elapsed_us;
+    if (task.period_us == 0) {
+      task.next_us = end_us;
+      return;
+    }
+    task.next_us += task.period_us;
+    const int32_t behind_us = static_cast<int32_t>(end_us - task.next_us);
+    if (behind_us >= static_cast<int32_t>(task.period_us)) {
+      task.missed += behind_us / task.period_us;
+      task.next_us = end_us;
+    }
+  }
+
+  std::array<Task, MAX_TASKS> tasks_{};
+  size_t num_tasks_ = 0;
+  TaskFn step_fn_ = nullptr;
+  uint32_t step_runs_ = 0;
+  uint32_t last_step_us_ = 0;
+  uint32_t max_step_gap_us_ = 0;
+};
+
+Scheduler scheduler{};
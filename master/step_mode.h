@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+
+#include <AccelStepper.h>
+#include <WebSerial.h>
+
+#include "constants.h"
+#include "fixed_format.h"
+#include "motion_params.h"
+#include "robot_config.h"
+
+// Wheel step sequencing, switchable at runtime.  Half steps (alternately one
+// and two coils on) double the resolution, which smooths slow lines; full
+// steps (always two coils) are faster, since the motors can't take half steps
+// at twice the full-step rate.
+//
+// Positions count steps of the active mode, so a switch rescales them: full
+// step P is half step 2P.  The half-step sequence runs one phase on from the
+// position so that full-step phase k (two coils) is half-step phase 2k + 1;
+// going back to full steps then needs an even half-step position.  Setting
+// an AccelStepper's position stops it, so switches wait for both wheels to
+// rest, and wheel positions in units (what the estimator sees) carry on
+// unchanged.
+#define STEP_MODE_FULL 0
+#define STEP_MODE_HALF 1
+#define STEP_MODE_AUTO 2  // Half steps with the pen down, full steps for travel
+
+class DriveStepper : public AccelStepper {
+ public:
+  DriveStepper(uint8_t pin1, uint8_t pin2, uint8_t pin3, uint8_t pin4)
+      : AccelStepper(AccelStepper::FULL4WIRE, pin1, pin2, pin3, pin4) {}
+
+  bool halfStep() const { return half_; }
+  bool atRest() { return distanceToGo() == 0 && speed() == 0; }
+  // On a phase full steps can take over from.
+  bool onFullStep() { return !half_ || currentPosition() % 2 == 0; }
+
+  void setHalfStep(bool half) {
+    if (half == half_) return;
+    const long pos = currentPosition();
+    setCurrentPosition(half ? pos * 2 : pos / 2);
+    half_ = half;
+  }
+
+ protected:
+  void step(long step) override {
+    if (half_) {
+      step8(step + 1);
+    } else {
+      step4(step);
+    }
+  }
+
+ private:
+  bool half_ = false;
+};
+
+// Set with the 'W' WebSerial command.  Rates and acceleration are in steps of
+// the active mode: the half-step rate is its own setting, and acceleration
+// doubles with half steps so that the wheels accelerate the same.
+class StepMode {
+ public:
+  uint8_t setting = STEP_MODE_FULL;
+  double max_half_steps_per_s = MAX_HALF_STEPS_PER_S;
+
+  bool half() const { return half_; }
+  uint32_t switches() const { return switches_; }
+  bool wantsHalf() const {
+    return setting == STEP_MODE_AUTO ? want_half_ : setting == STEP_MODE_HALF;
+  }
+
+  double stepsPerUnit() const { return stepsPerUnit(half_); }
+  double unitsPerStep() const {
+    return half_ ? Robot::units_per_step / 2 : Robot::units_per_step;
+  }
+  double maxStepsPerS() const {
+    return half_ ? max_half_steps_per_s : motion_params.max_steps_per_s;
+  }
+  double acceleration() const {
+    return half_ ? 2 * motion_params.acceleration : motion_params.acceleration;
+  }
+
+  // Top wheel speed (units/s) of a move with the pen down or up, for timing
+  // moves before they run.
+  double maxUnitsPerS(bool pen_down) const {
+    const bool half = halfFor(pen_down);
+    return (half ? max_half_steps_per_s : motion_params.max_steps_per_s) /
+           stepsPerUnit(half);
+  }
+
+  // Asks for the mode for moves with the pen down or up.  Returns true once
+  // the wheels run in it; until then they are switched as soon as they rest.
+  bool request(bool pen_down) {
+    want_half_ = pen_down;
+    return half_ == wantsHalf();
+  }
+
+  // Called once both wheels have been switched.
+  void switched(bool half) {
+    half_ = half;
+    ++switches_;
+  }
+
+  void print() const {
+    char buf[112 + 2 * Unsigned<>::kMaxChars + Fixed<1>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nStep mode:\n  W" << Unsigned<>(setting) << "," << Fixed<1>(max_half_steps_per_s)
+        << "\n  (0 full, 1 half, 2 half while drawing; max half steps/s)\n  now "
+        << (half_ ? "half" : "full") << " steps, " << Unsigned<>(switches_) << " switches\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+  }
+
+ private:
+  static double stepsPerUnit(bool half) {
+    return half ? 2 * Robot::steps_per_unit : Robot::steps_per_unit;
+  }
+  bool halfFor(bool pen_down) const {
+    return setting == STEP_MODE_AUTO ? pen_down : setting == STEP_MODE_HALF;
+  }
+
+  bool half_ = false;
+  bool want_half_ = false;  // Pen down, for STEP_MODE_AUTO
+  uint32_t switches_ = 0;
+};
+
+StepMode step_mode;
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <LittleFS.h>
+#include <WebSerial.h>
+
+#include "controller.h"
+#include "estimator.h"
+#include "step_mode.h"
+#include "step_stream.h"
+
+#define STEP_REPLAY_PATH "/replay.dbs"
+
+void moveWheelsTo(long s1, long s2);
+uint32_t movePenDown(bool down);
+
+// Streams a precompiled wheel-step file (see step_stream.h) from flash to the
+// motors, one record per stream tick.  No estimation or control math runs while
+// playing; the estimator and controller are resynced from the final pose.
+class StepReplay {
+ public:
+  // Upload: the raw file arrives in chunks and is written straight to flash.
+  void startUpload() {
+    close();
+    file_ = LittleFS.open(STEP_REPLAY_PATH, "w");
+    loaded_ = false;
+    WebSerial.println(F("Step stream upload starting..."));
+  }
+  bool isUploading() const { return static_cast<bool>(file_) && !loaded_; }
+  void appendUpload(const uint8_t* data, size_t len) { file_.write(data, len); }
+  bool endUpload() {
+    file_.close();
+    loaded_ = open();
+    WebSerial.printf("Step stream upload %s (%u ticks).\n",
+                     loaded_ ? "finished" : "FAILED", header_.num_ticks);
+    return loaded_;
+  }
+  void unload() {
+    close();
+    loaded_ = false;
+  }
+
+  bool isLoaded() const { return loaded_; }
+  bool isPlaying() const { return loaded_ && !paused_; }
+  uint32_t tick() const { return tick_; }
+  uint32_t numTicks() const { return header_.num_ticks; }
+  void play() { paused_ = false; }
+  void pause() { paused_ = true; }
+  void reset() {
+    if (loaded_) loaded_ = open();
+  }
+
+  // Call from the motor task with the current wheel positions (steps);
+  // advances one record every `tick_ms` of the stream.
+  void update(long cur_s1, long cur_s2) {
+    if (!isPlaying()) return;
+    if (!started_) {
+      target1_ = cur_s1;
+      target2_ = cur_s2;
+      tick_ms_ = millis();
+      started_ = true;
+    } else if (millis() - tick_ms_ < header_.tick_ms) {
+      return;
+    } else {
+      tick_ms_ += header_.tick_ms;
+    }
+    if (idle_ticks_ > 0) {
+      --idle_ticks_;
+      return;
+    }
+    auto next = [this] { return nextByte(); };
+    while (true) {
+      uint32_t a, b;
+      switch (nextByte()) {
+        case step_stream::STEP:
+          if (!step_stream::getVarint(next, a) ||
+              !step_stream::getVarint(next, b)) {
+            return fail();
+          }
+          target1_ += step_stream::unzigzag(a);
+          target2_ += step_stream::unzigzag(b);
+          moveWheelsTo(target1_, target2_);
+          ++tick_;
+          return;
+        case step_stream::IDLE:
+          if (!step_stream::getVarint(next, a) || a == 0) return fail();
+          idle_ticks_ = a - 1;  // This tick is the first idle one
+          tick_ += a;
+          return;
+        case step_stream::PEN: {
+          const int down = nextByte();
+          if (down < 0) return fail();
+          movePenDown(down == 1);
+          break;
+        }
+        case step_stream::END:
+          return finish();
+        default:
+          return fail();
+      }
+    }
+  }
+
+  void print() const {
+    WebSerial.printf(R"(
+StepReplay:
+  loaded: %d, paused: %d, tick %u of %u (%ums)
+)",
+                     loaded_, paused_, tick_, header_.num_ticks,
+                     header_.tick_ms);
+  }
+
+ private:
+  bool open() {
+    close();
+    file_ = LittleFS.open(STEP_REPLAY_PATH, "r");
+    if (!file_ ||
+        file_.read(reinterpret_cast<uint8_t*>(&header_), sizeof(header_)) !=
+            sizeof(header_) ||
+        !step_stream::isStepStream(reinterpret_cast<uint8_t*>(&header_),
+                                   sizeof(header_))) {
+      close();
+      return false;
+    }
+    paused_ = true;
+    started_ = false;
+    idle_ticks_ = 0;
+    tick_ = 0;
+    buf_len_ = buf_pos_ = 0;
+    return true;
+  }
+  void close() {
+    if (file_) file_.close();
+  }
+
+  // The next byte of the stream, or -1 at the end of the file.
+  int nextByte() {
+    if (buf_pos_ == buf_len_) {
+      buf_len_ = file_.read(buf_, sizeof(buf_));
+      buf_pos_ = 0;
+      if (buf_len_ == 0) return -1;
+    }
+    return buf_[buf_pos_++];
+  }
+
+  void finish() {
+    float pose[4];
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(pose);
+    for (size_t i = 0; i < sizeof(pose); ++i) {
+      const int byte = nextByte();
+      if (byte < 0) return fail();  // Cut off inside the end pose
+      bytes[i] = byte;
+    }
+    const State state{.x = pose[0], .y = pose[1], .cos = pose[2], .sin = pose[3]};
+    estimator.setState(state, Q(target1_, target2_) * step_mode.unitsPerStep());
+    controller.setSetpoint(state.pen());
+    WebSerial.printf("Step stream finished after %u ticks.\n", tick_);
+    loaded_ = open();  // Rewind, paused
+  }
+  void fail() {
+    WebSerial.printf("Corrupt step stream at tick %u, stopping.\n", tick_);
+    unload();
+  }
+
+  File file_;
+  StepStreamHeader header_{};
+  uint8_t buf_[64];
+  size_t buf_len_ = 0, buf_pos_ = 0;
+  bool loaded_ = false;
+  bool paused_ = true;
+  bool started_ = false;
+  uint32_t idle_ticks_ = 0;
+  uint32_t tick_ = 0;
+  uint32_t tick_ms_ = 0;  // millis() of the current tick
+  long target1_ = 0, target2_ = 0;
+};
+
+StepReplay step_replay{};
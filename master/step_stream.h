@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Precompiled wheel-step stream ("DBS" file), produced on the host by
+// `doodlesim compile` and played back by StepReplay.
+//
+// Layout: a StepStreamHeader, then a sequence of records, one op byte each:
+//   STEP  zz(d1) zz(d2)   Wheel targets move by (d1, d2) steps this tick
+//   IDLE  n               No new wheel targets for n ticks
+//   PEN   down            Pen down (1) or up (0)
+//   END   x y cos sin     Final pose (floats) so the estimator can resync
+// `zz` is a zigzag varint and `n` a plain varint.  Ticks are `tick_ms` apart,
+// and the stream assumes the robot starts at the home pose.
+
+constexpr char STEP_STREAM_MAGIC[4] = {'D', 'B', 'S', '1'};
+
+struct StepStreamHeader {
+  char magic[4];
+  uint16_t tick_ms;
+  uint16_t reserved;
+  uint32_t num_ticks;
+};
+
+namespace step_stream {
+
+enum Op : uint8_t { STEP, IDLE, PEN, END };
+
+inline bool isStepStream(const uint8_t* data, size_t len) {
+  return len >= sizeof(STEP_STREAM_MAGIC) &&
+         memcmp(data, STEP_STREAM_MAGIC, sizeof(STEP_STREAM_MAGIC)) == 0;
+}
+
+inline uint32_t zigzag(int32_t v) {
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+inline int32_t unzigzag(uint32_t v) {
+  return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+inline void putVarint(std::string& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+// Reads a varint using `next()`, which returns the next byte or -1 at EOF.
+template <typename NextByte>
+bool getVarint(NextByte&& next, uint32_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    const int c = next();
+    if (c < 0) return false;
+    v |= static_cast<uint32_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+// Host-side writer.
+class Writer {
+ public:
+  explicit Writer(uint16_t tick_ms) : tick_ms_(tick_ms) {}
+
+  // Record the wheel-target change that happened at `tick`.  Ticks must be
+  // non-decreasing; at most one STEP per tick.
+  void step(uint32_t tick, int32_t d1, int32_t d2) {
+    idleUntil(tick);
+    body_.push_back(STEP);
+    putVarint(body_, zigzag(d1));
+    putVarint(body_, zigzag(d2));
+    next_tick_ = tick + 1;
+  }
+  void pen(uint32_t tick, bool down) {
+    idleUntil(tick);
+    body_.push_back(PEN);
+    body_.push_back(down ? 1 : 0);
+  }
+  std::string finish(uint32_t tick, float x, float y, float cos, float sin) {
+    idleUntil(tick);
+    body_.push_back(END);
+    for (float f : {x, y, cos, sin}) {
+      body_.append(reinterpret_cast<const char*>(&f), sizeof(f));
+    }
+    StepStreamHeader header{};
+    memcpy(header.magic, STEP_STREAM_MAGIC, sizeof(header.magic));
+    header.tick_ms = tick_ms_;
+    header.num_ticks = tick;
+    return std::string(reinterpret_cast<const char*>(&header), sizeof(header)) +
+           body_;
+  }
+
+ private:
+  void idleUntil(uint32_t tick) {
+    if (tick <= next_tick_) return;
+    body_.push_back(IDLE);
+    putVarint(body_, tick - next_tick_);
+    next_tick_ = tick;
+  }
+
+  uint16_t tick_ms_;
+  uint32_t next_tick_ = 0;
+  std::string body_;
+};
+
+}  // namespace step_stream
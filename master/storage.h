@@ -0,0 +1,12 @@
+#pragma once
+
+#include <LittleFS.h>
+#include <WebSerial.h>
+
+void setupStorage() {
+  if (!LittleFS.begin()) {
+    WebSerial.println(F("LittleFS mount failed, formatting."));
+    LittleFS.format();
+    LittleFS.begin();
+  }
+}
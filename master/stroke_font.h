@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstdint>
+
+#include <Arduino.h>
+#include <ArduinoEigen.h>
+
+// Single-stroke font for the text command (M800, see GCodeParser): the
+// Hershey simplex roman glyphs for ' ' to '~', kept in flash and read a point
+// at a time as text plays.  Coordinates are font units with the glyph's
+// origin at the left end of its baseline; capitals are FONT_CAP_HEIGHT tall
+// and the next glyph starts `width` further on.  Each glyph is a run of x, y
+// bytes, with FONT_PEN_UP between strokes.
+#define FONT_FIRST_CHAR ' '
+#define FONT_LAST_CHAR '~'
+#define FONT_CAP_HEIGHT 21
+#define FONT_PEN_UP (-128)
+
+static const int8_t kFontStrokes[] PROGMEM = {
+    // ' '
+    // '!'
+    5, 21, 5, 7, FONT_PEN_UP, 5, 2, 4, 1, 5, 0, 6, 1, 5, 2,
+    // '"'
+    4, 21, 4, 14, FONT_PEN_UP, 12, 21, 12, 14,
+    // '#'
+    11, 25, 4, -7, FONT_PEN_UP, 17, 25, 10, -7, FONT_PEN_UP, 4, 12, 18, 12, FONT_PEN_UP,
+    3, 6, 17, 6,
+    // '$'
+    8, 25, 8, -4, FONT_PEN_UP, 12, 25, 12, -4, FONT_PEN_UP, 17, 18, 15, 20, 12, 21,
+    8, 21, 5, 20, 3, 18, 3, 16, 4, 14, 5, 13, 7, 12, 13, 10, 15, 9, 16, 8, 17, 6, 17, 3,
+    15, 1, 12, 0, 8, 0, 5, 1, 3, 3,
+    // '%'
+    21, 21, 3, 0, FONT_PEN_UP, 8, 21, 10, 19, 10, 17, 9, 15, 7, 14, 5, 14, 3, 16, 3, 18,
+    4, 20, 6, 21, 8, 21, 10, 20, 13, 19, 16, 19, 19, 20, 21, 21, FONT_PEN_UP, 17, 7,
+    15, 6, 14, 4, 14, 2, 16, 0, 18, 0, 20, 1, 21, 3, 21, 5, 19, 7, 17, 7,
+    // '&'
+    23, 12, 23, 13, 22, 14, 21, 14, 20, 13, 19, 11, 17, 6, 15, 3, 13, 1, 11, 0, 7, 0,
+    5, 1, 4, 2, 3, 4, 3, 6, 4, 8, 5, 9, 12, 13, 13, 14, 14, 16, 14, 18, 13, 20, 11, 21,
+    9, 20, 8, 18, 8, 16, 9, 13, 11, 10, 16, 3, 18, 1, 20, 0, 22, 0, 23, 1, 23, 2,
+    // '\''
+    5, 19, 4, 20, 5, 21, 6, 20, 6, 18, 5, 16, 4, 15,
+    // '('
+    11, 25, 9, 23, 7, 20, 5, 16, 4, 11, 4, 7, 5, 2, 7, -2, 9, -5, 11, -7,
+    // ')'
+    3, 25, 5, 23, 7, 20, 9, 16, 10, 11, 10, 7, 9, 2, 7, -2, 5, -5, 3, -7,
+    // '*'
+    8, 21, 8, 9, FONT_PEN_UP, 3, 18, 13, 12, FONT_PEN_UP, 13, 18, 3, 12,
+    // '+'
+    13, 18, 13, 0, FONT_PEN_UP, 4, 9, 22, 9,
+    // ','
+    6, 1, 5, 0, 4, 1, 5, 2, 6, 1, 6, -1, 5, -3, 4, -4,
+    // '-'
+    4, 9, 22, 9,
+    // '.'
+    5, 2, 4, 1, 5, 0, 6, 1, 5, 2,
+    // '/'
+    20, 25, 2, -7,
+    // '0'
+    9, 21, 6, 20, 4, 17, 3, 12, 3, 9, 4, 4, 6, 1, 9, 0, 11, 0, 14, 1, 16, 4, 17, 9,
+    17, 12, 16, 17, 14, 20, 11, 21, 9, 21,
+    // '1'
+    6, 17, 8, 18, 11, 21, 11, 0,
+    // '2'
+    4, 16, 4, 17, 5, 19, 6, 20, 8, 21, 12, 21, 14, 20, 15, 19, 16, 17, 16, 15, 15, 13,
+    13, 10, 3, 0, 17, 0,
+    // '3'
+    5, 21, 16, 21, 10, 13, 13, 13, 15, 12, 16, 11, 17, 8, 17, 6, 16, 3, 14, 1, 11, 0,
+    8, 0, 5, 1, 4, 2, 3, 4,
+    // '4'
+    13, 21, 3, 7, 18, 7, FONT_PEN_UP, 13, 21, 13, 0,
+    // '5'
+    15, 21, 5, 21, 4, 12, 5, 13, 8, 14, 11, 14, 14, 13, 16, 11, 17, 8, 17, 6, 16, 3,
+    14, 1, 11, 0, 8, 0, 5, 1, 4, 2, 3, 4,
+    // '6'
+    16, 18, 15, 20, 12, 21, 10, 21, 7, 20, 5, 17, 4, 12, 4, 7, 5, 3, 7, 1, 10, 0, 11, 0,
+    14, 1, 16, 3, 17, 6, 17, 7, 16, 10, 14, 12, 11, 13, 10, 13, 7, 12, 5, 10, 4, 7,
+    // '7'
+    17, 21, 7, 0, FONT_PEN_UP, 3, 21, 17, 21,
+    // '8'
+    8, 21, 5, 20, 4, 18, 4, 16, 5, 14, 7, 13, 11, 12, 14, 11, 16, 9, 17, 7, 17, 4,
+    16, 2, 15, 1, 12, 0, 8, 0, 5, 1, 4, 2, 3, 4, 3, 7, 4, 9, 6, 11, 9, 12, 13, 13,
+    15, 14, 16, 16, 16, 18, 15, 20, 12, 21, 8, 21,
+    // '9'
+    16, 14, 15, 11, 13, 9, 10, 8, 9, 8, 6, 9, 4, 11, 3, 14, 3, 15, 4, 18, 6, 20, 9, 21,
+    10, 21, 13, 20, 15, 18, 16, 14, 16, 9, 15, 4, 13, 1, 10, 0, 8, 0, 5, 1, 4, 3,
+    // ':'
+    5, 14, 4, 13, 5, 12, 6, 13, 5, 14, FONT_PEN_UP, 5, 2, 4, 1, 5, 0, 6, 1, 5, 2,
+    // ';'
+    5, 14, 4, 13, 5, 12, 6, 13, 5, 14, FONT_PEN_UP, 6, 1, 5, 0, 4, 1, 5, 2, 6, 1, 6, -1,
+    5, -3, 4, -4,
+    // '<'
+    20, 18, 4, 9, 20, 0,
+    // '='
+    4, 12, 22, 12, FONT_PEN_UP, 4, 6, 22, 6,
+    // '>'
+    4, 18, 20, 9, 4, 0,
+    // '?'
+    3, 16, 3, 17, 4, 19, 5, 20, 7, 21, 11, 21, 13, 20, 14, 19, 15, 17, 15, 15, 14, 13,
+    13, 12, 9, 10, 9, 7, FONT_PEN_UP, 9, 2, 8, 1, 9, 0, 10, 1, 9, 2,
+    // '@'
+    18, 13, 17, 15, 15, 16, 12, 16, 10, 15, 9, 14, 8, 11, 8, 8, 9, 6, 11, 5, 14, 5,
+    16, 6, 17, 8, FONT_PEN_UP, 12, 16, 10, 14, 9, 11, 9, 8, 10, 6, 11, 5, FONT_PEN_UP,
+    18, 16, 17, 8, 17, 6, 19, 5, 21, 5, 23, 7, 24, 10, 24, 12, 23, 15, 22, 17, 20, 19,
+    18, 20, 15, 21, 12, 21, 9, 20, 7, 19, 5, 17, 4, 15, 3, 12, 3, 9, 4, 6, 5, 4, 7, 2,
+    9, 1, 12, 0, 15, 0, 18, 1, 20, 2, 21, 3, FONT_PEN_UP, 19, 16, 18, 8, 18, 6, 19, 5,
+    // 'A'
+    9, 21, 1, 0, FONT_PEN_UP, 9, 21, 17, 0, FONT_PEN_UP, 4, 7, 14, 7,
+    // 'B'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 13, 21, 16, 20, 17, 19, 18, 17, 18, 15, 17, 13,
+    16, 12, 13, 11, FONT_PEN_UP, 4, 11, 13, 11, 16, 10, 17, 9, 18, 7, 18, 4, 17, 2,
+    16, 1, 13, 0, 4, 0,
+    // 'C'
+    18, 16, 17, 18, 15, 20, 13, 21, 9, 21, 7, 20, 5, 18, 4, 16, 3, 13, 3, 8, 4, 5, 5, 3,
+    7, 1, 9, 0, 13, 0, 15, 1, 17, 3, 18, 5,
+    // 'D'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 11, 21, 14, 20, 16, 18, 17, 16, 18, 13, 18, 8,
+    17, 5, 16, 3, 14, 1, 11, 0, 4, 0,
+    // 'E'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 17, 21, FONT_PEN_UP, 4, 11, 12, 11, FONT_PEN_UP,
+    4, 0, 17, 0,
+    // 'F'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 17, 21, FONT_PEN_UP, 4, 11, 12, 11,
+    // 'G'
+    18, 16, 17, 18, 15, 20, 13, 21, 9, 21, 7, 20, 5, 18, 4, 16, 3, 13, 3, 8, 4, 5, 5, 3,
+    7, 1, 9, 0, 13, 0, 15, 1, 17, 3, 18, 5, 18, 8, FONT_PEN_UP, 13, 8, 18, 8,
+    // 'H'
+    4, 21, 4, 0, FONT_PEN_UP, 18, 21, 18, 0, FONT_PEN_UP, 4, 11, 18, 11,
+    // 'I'
+    4, 21, 4, 0,
+    // 'J'
+    12, 21, 12, 5, 11, 2, 10, 1, 8, 0, 6, 0, 4, 1, 3, 2, 2, 5, 2, 7,
+    // 'K'
+    4, 21, 4, 0, FONT_PEN_UP, 18, 21, 4, 7, FONT_PEN_UP, 9, 12, 18, 0,
+    // 'L'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 0, 16, 0,
+    // 'M'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 12, 0, FONT_PEN_UP, 20, 21, 12, 0, FONT_PEN_UP,
+    20, 21, 20, 0,
+    // 'N'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 18, 0, FONT_PEN_UP, 18, 21, 18, 0,
+    // 'O'
+    9, 21, 7, 20, 5, 18, 4, 16, 3, 13, 3, 8, 4, 5, 5, 3, 7, 1, 9, 0, 13, 0, 15, 1,
+    17, 3, 18, 5, 19, 8, 19, 13, 18, 16, 17, 18, 15, 20, 13, 21, 9, 21,
+    // 'P'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 13, 21, 16, 20, 17, 19, 18, 17, 18, 14, 17, 12,
+    16, 11, 13, 10, 4, 10,
+    // 'Q'
+    9, 21, 7, 20, 5, 18, 4, 16, 3, 13, 3, 8, 4, 5, 5, 3, 7, 1, 9, 0, 13, 0, 15, 1,
+    17, 3, 18, 5, 19, 8, 19, 13, 18, 16, 17, 18, 15, 20, 13, 21, 9, 21, FONT_PEN_UP,
+    12, 4, 18, -2,
+    // 'R'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 21, 13, 21, 16, 20, 17, 19, 18, 17, 18, 15, 17, 13,
+    16, 12, 13, 11, 4, 11, FONT_PEN_UP, 11, 11, 18, 0,
+    // 'S'
+    17, 18, 15, 20, 12, 21, 8, 21, 5, 20, 3, 18, 3, 16, 4, 14, 5, 13, 7, 12, 13, 10,
+    15, 9, 16, 8, 17, 6, 17, 3, 15, 1, 12, 0, 8, 0, 5, 1, 3, 3,
+    // 'T'
+    8, 21, 8, 0, FONT_PEN_UP, 1, 21, 15, 21,
+    // 'U'
+    4, 21, 4, 6, 5, 3, 7, 1, 10, 0, 12, 0, 15, 1, 17, 3, 18, 6, 18, 21,
+    // 'V'
+    1, 21, 9, 0, FONT_PEN_UP, 17, 21, 9, 0,
+    // 'W'
+    2, 21, 7, 0, FONT_PEN_UP, 12, 21, 7, 0, FONT_PEN_UP, 12, 21, 17, 0, FONT_PEN_UP,
+    22, 21, 17, 0,
+    // 'X'
+    3, 21, 17, 0, FONT_PEN_UP, 17, 21, 3, 0,
+    // 'Y'
+    1, 21, 9, 11, 9, 0, FONT_PEN_UP, 17, 21, 9, 11,
+    // 'Z'
+    17, 21, 3, 0, FONT_PEN_UP, 3, 21, 17, 21, FONT_PEN_UP, 3, 0, 17, 0,
+    // '['
+    4, 25, 4, -7, FONT_PEN_UP, 5, 25, 5, -7, FONT_PEN_UP, 4, 25, 11, 25, FONT_PEN_UP,
+    4, -7, 11, -7,
+    // '\\'
+    0, 21, 14, -3,
+    // ']'
+    9, 25, 9, -7, FONT_PEN_UP, 10, 25, 10, -7, FONT_PEN_UP, 3, 25, 10, 25, FONT_PEN_UP,
+    3, -7, 10, -7,
+    // '^'
+    2, 12, 8, 18, 14, 12,
+    // '_'
+    0, -2, 16, -2,
+    // '`'
+    6, 21, 5, 20, 4, 18, 4, 16, 5, 15, 6, 16, 5, 17,
+    // 'a'
+    15, 14, 15, 0, FONT_PEN_UP, 15, 11, 13, 13, 11, 14, 8, 14, 6, 13, 4, 11, 3, 8, 3, 6,
+    4, 3, 6, 1, 8, 0, 11, 0, 13, 1, 15, 3,
+    // 'b'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 11, 6, 13, 8, 14, 11, 14, 13, 13, 15, 11, 16, 8, 16, 6,
+    15, 3, 13, 1, 11, 0, 8, 0, 6, 1, 4, 3,
+    // 'c'
+    15, 11, 13, 13, 11, 14, 8, 14, 6, 13, 4, 11, 3, 8, 3, 6, 4, 3, 6, 1, 8, 0, 11, 0,
+    13, 1, 15, 3,
+    // 'd'
+    15, 21, 15, 0, FONT_PEN_UP, 15, 11, 13, 13, 11, 14, 8, 14, 6, 13, 4, 11, 3, 8, 3, 6,
+    4, 3, 6, 1, 8, 0, 11, 0, 13, 1, 15, 3,
+    // 'e'
+    3, 8, 15, 8, 15, 10, 14, 12, 13, 13, 11, 14, 8, 14, 6, 13, 4, 11, 3, 8, 3, 6, 4, 3,
+    6, 1, 8, 0, 11, 0, 13, 1, 15, 3,
+    // 'f'
+    10, 21, 8, 21, 6, 20, 5, 17, 5, 0, FONT_PEN_UP, 2, 14, 9, 14,
+    // 'g'
+    15, 14, 15, -2, 14, -5, 13, -6, 11, -7, 8, -7, 6, -6, FONT_PEN_UP, 15, 11, 13, 13,
+    11, 14, 8, 14, 6, 13, 4, 11, 3, 8, 3, 6, 4, 3, 6, 1, 8, 0, 11, 0, 13, 1, 15, 3,
+    // 'h'
+    4, 21, 4, 0, FONT_PEN_UP, 4, 10, 7, 13, 9, 14, 12, 14, 14, 13, 15, 10, 15, 0,
+    // 'i'
+    3, 21, 4, 20, 5, 21, 4, 22, 3, 21, FONT_PEN_UP, 4, 14, 4, 0,
+    // 'j'
+    5, 21, 6, 20, 7, 21, 6, 22, 5, 21, FONT_PEN_UP, 6, 14, 6, -3, 5, -6, 3, -7, 1, -7,
+    // 'k'
+    4, 21, 4, 0, FONT_PEN_UP, 14, 14, 4, 4, FONT_PEN_UP, 8, 8, 15, 0,
+    // 'l'
+    4, 21, 4, 0,
+    // 'm'
+    4, 14, 4, 0, FONT_PEN_UP, 4, 10, 7, 13, 9, 14, 12, 14, 14, 13, 15, 10, 15, 0,
+    FONT_PEN_UP, 15, 10, 18, 13, 20, 14, 23, 14, 25, 13, 26, 10, 26, 0,
+    // 'n'
+    4, 14, 4, 0, FONT_PEN_UP, 4, 10, 7, 13, 9, 14, 12, 14, 14, 13, 15, 10, 15, 0,
+    // 'o'
+    8, 14, 6, 13, 4, 11, 3, 8, 3, 6, 4, 3, 6, 1, 8, 0, 11, 0, 13, 1, 15, 3, 16, 6,
+    16, 8, 15, 11, 13, 13, 11, 14, 8, 14,
+    // 'p'
+    4, 14, 4, -7, FONT_PEN_UP, 4, 11, 6, 13, 8, 14, 11, 14, 13, 13, 15, 11, 16, 8,
+    16, 6, 15, 3, 13, 1, 11, 0, 8, 0, 6, 1, 4, 3,
+    // 'q'
+    15, 14, 15, -7, FONT_PEN_UP, 15, 11, 13, 13, 11, 14, 8, 14, 6, 13, 4, 11, 3, 8,
+    3, 6, 4, 3, 6, 1, 8, 0, 11, 0, 13, 1, 15, 3,
+    // 'r'
+    4, 14, 4, 0, FONT_PEN_UP, 4, 8, 5, 11, 7, 13, 9, 14, 12, 14,
+    // 's'
+    14, 11, 13, 13, 10, 14, 7, 14, 4, 13, 3, 11, 4, 9, 6, 8, 11, 7, 13, 6, 14, 4, 14, 3,
+    13, 1, 10, 0, 7, 0, 4, 1, 3, 3,
+    // 't'
+    5, 21, 5, 4, 6, 1, 8, 0, 10, 0, FONT_PEN_UP, 2, 14, 9, 14,
+    // 'u'
+    4, 14, 4, 4, 5, 1, 7, 0, 10, 0, 12, 1, 15, 4, FONT_PEN_UP, 15, 14, 15, 0,
+    // 'v'
+    2, 14, 8, 0, FONT_PEN_UP, 14, 14, 8, 0,
+    // 'w'
+    3, 14, 7, 0, FONT_PEN_UP, 11, 14, 7, 0, FONT_PEN_UP, 11, 14, 15, 0, FONT_PEN_UP,
+    19, 14, 15, 0,
+    // 'x'
+    3, 14, 14, 0, FONT_PEN_UP, 14, 14, 3, 0,
+    // 'y'
+    2, 14, 8, 0, FONT_PEN_UP, 14, 14, 8, 0, 6, -4, 4, -6, 2, -7, 1, -7,
+    // 'z'
+    14, 14, 3, 0, FONT_PEN_UP, 3, 14, 14, 14, FONT_PEN_UP, 3, 0, 14, 0,
+    // '{'
+    9, 25, 7, 24, 6, 23, 5, 21, 5, 19, 6, 17, 7, 16, 8, 14, 8, 12, 6, 10, FONT_PEN_UP,
+    7, 24, 6, 22, 6, 20, 7, 18, 8, 17, 9, 15, 9, 13, 8, 11, 4, 9, 8, 7, 9, 5, 9, 3,
+    8, 1, 7, 0, 6, -2, 6, -4, 7, -6, FONT_PEN_UP, 6, 8, 8, 6, 8, 4, 7, 2, 6, 1, 5, -1,
+    5, -3, 6, -5, 7, -6, 9, -7,
+    // '|'
+    4, 25, 4, -7,
+    // '}'
+    5, 25, 7, 24, 8, 23, 9, 21, 9, 19, 8, 17, 7, 16, 6, 14, 6, 12, 8, 10, FONT_PEN_UP,
+    7, 24, 8, 22, 8, 20, 7, 18, 6, 17, 5, 15, 5, 13, 6, 11, 10, 9, 6, 7, 5, 5, 5, 3,
+    6, 1, 7, 0, 8, -2, 8, -4, 7, -6, FONT_PEN_UP, 8, 8, 6, 6, 6, 4, 7, 2, 8, 1, 9, -1,
+    9, -3, 8, -5, 7, -6, 5, -7,
+    // '~'
+    3, 6, 3, 8, 4, 11, 6, 12, 8, 12, 10, 11, 14, 8, 16, 7, 18, 7, 20, 8, 21, 10,
+    FONT_PEN_UP, 3, 8, 4, 10, 6, 11, 8, 11, 10, 10, 14, 7, 16, 6, 18, 6, 20, 7, 21, 10,
+    21, 12,
+};
+
+// Where each glyph's strokes start in kFontStrokes, and where the last ends.
+static const uint16_t kFontStart[] PROGMEM = {
+    0, 0, 15, 24, 43, 93, 153, 221, 235, 255, 275, 289,
+    298, 314, 318, 328, 332, 366, 374, 402, 432, 443, 477, 523,
+    532, 590, 636, 657, 684, 690, 699, 705, 744, 851, 865, 909,
+    945, 974, 993, 1007, 1050, 1064, 1068, 1088, 1102, 1111, 1130, 1144,
+    1186, 1211, 1258, 1288, 1328, 1337, 1357, 1366, 1385, 1394, 1405, 1419,
+    1438, 1442, 1461, 1467, 1471, 1485, 1518, 1551, 1579, 1612, 1646, 1661,
+    1704, 1723, 1738, 1759, 1773, 1777, 1811, 1830, 1864, 1897, 1930, 1945,
+    1979, 1994, 2013, 2022, 2041, 2050, 2067, 2081, 2157, 2161, 2237, 2282,
+};
+
+static const uint8_t kFontWidth[] PROGMEM = {
+    16, 10, 16, 21, 20, 24, 26, 10, 14, 14, 16, 26, 10, 26, 10, 22,
+    20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 10, 10, 24, 26, 24, 18,
+    27, 18, 21, 21, 21, 19, 18, 21, 22, 8, 16, 21, 17, 24, 22, 22,
+    21, 22, 21, 20, 16, 22, 18, 24, 20, 18, 20, 14, 14, 14, 16, 16,
+    10, 19, 19, 18, 19, 18, 12, 19, 19, 8, 10, 17, 8, 30, 19, 19,
+    19, 19, 13, 17, 12, 19, 16, 22, 17, 16, 17, 14, 8, 14, 24,
+};
+
+class StrokeFont {
+ public:
+  // Characters outside the font are drawn as '?'.
+  static uint8_t glyph(char c) {
+    return (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR ? '?' : c) - FONT_FIRST_CHAR;
+  }
+  static uint8_t width(char c) { return pgm_read_byte(&kFontWidth[glyph(c)]); }
+  // The glyph's strokes are points [begin, end) of kFontStrokes.
+  static uint16_t begin(char c) { return pgm_read_word(&kFontStart[glyph(c)]); }
+  static uint16_t end(char c) { return pgm_read_word(&kFontStart[glyph(c) + 1]); }
+
+  static bool penUp(uint16_t i) {
+    return static_cast<int8_t>(pgm_read_byte(&kFontStrokes[i])) == FONT_PEN_UP;
+  }
+  static uint16_t next(uint16_t i) { return i + (penUp(i) ? 1 : 2); }
+  static Eigen::Vector2d point(uint16_t i) {
+    return Eigen::Vector2d(static_cast<int8_t>(pgm_read_byte(&kFontStrokes[i])),
+                           static_cast<int8_t>(pgm_read_byte(&kFontStrokes[i + 1])));
+  }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+#include "gcode_parser.h"
+#include "program_analysis.h"
+
+// Strokes whose end and next start are closer than this (in program units)
+// are joined by a pen-down move instead of a lift, travel and lower.
+#define PEN_MERGE_TOLERANCE 0.5
+
+// Load-time pass over a parsed program that drops pen lifts across tiny gaps:
+//   RAPID p                (pen down, p within tol)  ->  LINEAR p
+//   PEN_UP, RAPID p, PEN_DOWN (p within tol)         ->  LINEAR p
+//   PEN_UP, PEN_DOWN                                 ->  (nothing)
+// Nothing is merged across subroutine, repeat or text boundaries, where
+// the pen could be anywhere.
+// Compacts `program` in place and returns the number of lifts removed.
+// `analysis`, if given, is updated to match.
+size_t mergeStrokes(std::array<GCommand, MAX_COMMANDS>& program,
+                    size_t& program_size, double tolerance,
+                    ProgramAnalysis* analysis = nullptr) {
+  bool pen_down = false;
+  Eigen::Vector2d pos = Eigen::Vector2d::Zero();
+  size_t merged = 0;
+  size_t w = 0;
+  auto near = [&](const GCommand& cmd) {
+    return cmd.type == GCommand::RAPID && (cmd.target - pos).norm() <= tolerance;
+  };
+
+  for (size_t i = 0; i < program_size; ++i) {
+    GCommand cmd = program[i];
+    if (pen_down && cmd.type == GCommand::PEN_UP && i + 1 < program_size) {
+      if (program[i + 1].type == GCommand::PEN_DOWN) {
+        ++i;
+        ++merged;
+        if (analysis) analysis->mergedLift(0);
+        continue;
+      }
+      if (i + 2 < program_size && near(program[i + 1]) &&
+          program[i + 2].type == GCommand::PEN_DOWN) {
+        cmd = program[i + 1];
+        cmd.type = GCommand::LINEAR;
+        i += 2;
+        ++merged;
+        if (analysis) analysis->mergedLift((cmd.target - pos).norm());
+      }
+    } else if (pen_down && near(cmd)) {
+      cmd.type = GCommand::LINEAR;
+      ++merged;
+      if (analysis) analysis->mergedLift((cmd.target - pos).norm());
+    }
+
+    switch (cmd.type) {
+      case GCommand::RAPID:
+      case GCommand::LINEAR:
+        pos = cmd.target;
+        break;
+      case GCommand::HOME:
+        pos = Eigen::Vector2d::Zero();
+        break;
+      case GCommand::PEN_DOWN:
+        pen_down = true;
+        break;
+      case GCommand::PEN_UP:
+        pen_down = false;
+        break;
+      case GCommand::END:
+      case GCommand::DWELL:
+        break;
+      default:  // Program flow
+        pen_down = false;
+        pos = Eigen::Vector2d::Constant(NAN);
+        break;
+    }
+    program[w++] = cmd;
+  }
+  program_size = w;
+  return merged;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+
+#include "gcode_parser.h"
+#include "program_analysis.h"
+
+// Load-time pass that draws each stroke in whichever direction is quicker.
+// A stroke is
+//   RAPID p0, [PEN_DOWN], LINEAR p1, ..., LINEAR pn
+// drawn with the pen down; reversing it gives RAPID pn, [PEN_DOWN], LINEAR
+// pn-1, ..., LINEAR p0.  Both directions are timed with ProgramAnalysis (so
+// with the travel planner and the controller, heading changes included) from
+// the pose the program so far leaves the robot in, through the travel to the
+// next stroke.  Greedy, in program order: the order of strokes never changes.
+// Returns the number of strokes reversed.
+void reverseStroke(std::array<GCommand, MAX_COMMANDS>& program, size_t rapid,
+                   size_t first, size_t end) {
+  // Targets of RAPID, LINEAR, ..., LINEAR, skipping a PEN_DOWN in between.
+  for (size_t a = rapid, b = end - 1; a < b;) {
+    std::swap(program[a].target, program[b].target);
+    a = a == rapid ? first : a + 1;
+    --b;
+  }
+}
+
+size_t orientStrokes(std::array<GCommand, MAX_COMMANDS>& program,
+                     size_t program_size) {
+  ProgramAnalysis so_far;
+  bool pen_down = false;
+  size_t reversed = 0;
+
+  // Estimated time from here through the stroke [from, end) and on to the
+  // next RAPID.
+  auto cost = [&](size_t from, size_t end) {
+    ProgramAnalysis analysis = so_far;
+    const double start_ms = analysis.timeMs();
+    size_t i = from;
+    for (; i < end; ++i) analysis.add(program[i]);
+    for (; i < program_size && program[i].type != GCommand::END; ++i) {
+      analysis.add(program[i]);
+      if (program[i].type == GCommand::RAPID) break;
+    }
+    return analysis.timeMs() - start_ms;
+  };
+
+  for (size_t i = 0; i < program_size; ++i) {
+    const GCommand& cmd = program[i];
+    size_t end = i + 1;
+    if (cmd.type == GCommand::RAPID) {
+      size_t first = i + 1;
+      const bool lowers =
+          first < program_size && program[first].type == GCommand::PEN_DOWN;
+      if (lowers) ++first;
+      end = first;
+      while (end < program_size && program[end].type == GCommand::LINEAR) ++end;
+      if (end > first && (pen_down || lowers)) {
+        const double forward_ms = cost(i, end);
+        reverseStroke(program, i, first, end);
+        if (cost(i, end) < forward_ms) {
+          ++reversed;
+        } else {
+          reverseStroke(program, i, first, end);
+        }
+      } else {
+        end = i + 1;
+      }
+    }
+    for (; i < end; ++i) {
+      so_far.add(program[i]);
+      if (program[i].type == GCommand::PEN_DOWN) pen_down = true;
+      if (program[i].type == GCommand::PEN_UP) pen_down = false;
+    }
+    --i;
+  }
+  return reversed;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include "fixed_format.h"
+#include "gcode_player.h"
+#include "kinematics.h"
+
+// SVG rendering of the loaded program for /preview.svg, generated on the fly
+// a chunk at a time.  Every command renders to a record of the same length
+// (blank padding for commands that don't move), so any byte offset maps
+// straight to a command and the pen position there comes from the player's
+// seek index: resuming a chunk costs at most one seek, and nothing is kept
+// between chunks beyond this snapshot.
+//
+// Pen-down moves are solid (grey once drawn), travel is dashed red.  The pose
+// and program index are those at the time of the request.
+class SvgPreview {
+ public:
+  SvgPreview(const ProgramPlayer& player, const State& pose)
+      : player_(&player),
+        size_(player.size()),
+        index_(player.index()),
+        axle_(pose.x, pose.y),
+        pen_(pose.pen()) {
+    // Everything the drawing visits, plus home and the robot.
+    min_ = max_ = Eigen::Vector2d::Zero();
+    for (const auto& p : {axle_, pen_}) {
+      min_ = min_.cwiseMin(p);
+      max_ = max_.cwiseMax(p);
+    }
+    for (size_t i = 0; i < size_; ++i) {
+      const GCommand cmd = player.command(i);
+      if (cmd.type == GCommand::RAPID || cmd.type == GCommand::LINEAR) {
+        min_ = min_.cwiseMin(cmd.target);
+        max_ = max_.cwiseMax(cmd.target);
+      }
+    }
+    const double pad = std::max(5.0, 0.02 * (max_ - min_).maxCoeff());
+    min_ -= Eigen::Vector2d::Constant(pad);
+    max_ += Eigen::Vector2d::Constant(pad);
+
+    char tmp[kMaxPiece];
+    header_len_ = header(tmp);
+    Eigen::Vector2d pos = Eigen::Vector2d::Zero();
+    bool pen_down = false;
+    record_len_ = record(GCommand{GCommand::LINEAR, pos, 0}, 0, pos, pen_down, tmp);
+    footer_len_ = footer(tmp);
+  }
+
+  size_t size() const {
+    return header_len_ + size_ * record_len_ + footer_len_;
+  }
+
+  // Writes up to `max_chars` bytes of the document, starting at `offset`.
+  size_t fill(char* buf, size_t max_chars, size_t offset) const {
+    if (player_->size() != size_) return 0;  // Program replaced: stop
+    char tmp[kMaxPiece];
+    size_t written = 0;
+    size_t i = -1;  // Command of the last record rendered
+    Eigen::Vector2d pos;
+    bool pen_down = false;
+    while (written < max_chars && offset < size()) {
+      size_t len, start;
+      if (offset < header_len_) {
+        len = header(tmp);
+        start = offset;
+      } else if (offset < header_len_ + size_ * record_len_) {
+        const size_t next = (offset - header_len_) / record_len_;
+        if (i == static_cast<size_t>(-1) || next != i + 1) {  // Chunk start
+          const auto cp = player_->seek(next);
+          pos = player_->position(cp);
+          pen_down = cp.pen_down;
+        }
+        i = next;
+        len = record(player_->command(i), i, pos, pen_down, tmp);
+        start = offset - header_len_ - i * record_len_;
+      } else {
+        len = footer(tmp);
+        start = offset - header_len_ - size_ * record_len_;
+      }
+      const size_t n = std::min(len - start, max_chars - written);
+      memcpy(buf + written, tmp + start, n);
+      written += n;
+      offset += n;
+    }
+    return written;
+  }
+
+ private:
+  static constexpr size_t kMaxPiece = 512;
+
+  // Fixed width keeps every record the same length.
+  using Coord = Fixed<2, 9>;
+  static Coord clamp(double v) { return Coord(std::max(-99999.0, std::min(99999.0, v))); }
+
+  size_t header(char* buf) const {
+    const Eigen::Vector2d size = max_ - min_;
+    TextWriter out(buf, kMaxPiece);
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"" << clamp(min_(0)) << " "
+        << clamp(-max_(1)) << " " << clamp(size(0)) << " " << clamp(size(1))
+        << "\">\n"
+           "<style>line,circle{fill:none;stroke-width:1.5;"
+           "vector-effect:non-scaling-stroke}"
+           ".p{stroke:#000}.q{stroke:#bbb}.r{stroke:#e33;stroke-dasharray:4 3}"
+           ".b{stroke:#07f;stroke-width:3}</style>\n"
+           "<g transform=\"scale(1,-1)\">\n";
+    return out.size();
+  }
+
+  // Renders command `i` and moves the pen position on past it.
+  size_t record(const GCommand& cmd, size_t i, Eigen::Vector2d& pos,
+                bool& pen_down, char* buf) const {
+    const char* style = nullptr;
+    Eigen::Vector2d to = pos;
+    switch (cmd.type) {
+      case GCommand::RAPID:
+        style = "r";
+        to = cmd.target;
+        break;
+      case GCommand::LINEAR:
+        style = !pen_down ? "r" : i < index_ ? "q" : "p";
+        to = cmd.target;
+        break;
+      case GCommand::HOME:
+        style = "r";
+        to = Eigen::Vector2d::Zero();
+        break;
+      case GCommand::PEN_DOWN:
+      case GCommand::PEN_UP:
+        pen_down = cmd.type == GCommand::PEN_DOWN;
+        break;
+      default:
+        break;
+    }
+    TextWriter out(buf, kMaxPiece);
+    out << "<line class=\"" << (style ? style : "p") << "\" x1=\"" << clamp(pos(0))
+        << "\" y1=\"" << clamp(pos(1)) << "\" x2=\"" << clamp(to(0)) << "\" y2=\""
+        << clamp(to(1)) << "\"/>\n";
+    const size_t n = out.size();
+    if (!style) {  // Same length, but nothing to draw
+      memset(buf, ' ', n - 1);
+    }
+    pos = to;
+    return n;
+  }
+
+  size_t footer(char* buf) const {
+    const double font = 0.04 * (max_ - min_).maxCoeff();
+    TextWriter out(buf, kMaxPiece);
+    out << "<line class=\"b\" x1=\"" << clamp(axle_(0)) << "\" y1=\"" << clamp(axle_(1))
+        << "\" x2=\"" << clamp(pen_(0)) << "\" y2=\"" << clamp(pen_(1))
+        << "\"/>\n<circle class=\"b\" cx=\"" << clamp(pen_(0)) << "\" cy=\""
+        << clamp(pen_(1)) << "\" r=\"" << clamp(font / 3) << "\"/>\n</g>\n<text x=\""
+        << clamp(min_(0) + font / 2) << "\" y=\"" << clamp(-max_(1) + 1.5 * font)
+        << "\" font-size=\"" << clamp(font) << "\" font-family=\"sans-serif\">command "
+        << Unsigned<5>(index_) << " of " << Unsigned<5>(size_) << "</text>\n</svg>\n";
+    return out.size();
+  }
+
+  const ProgramPlayer* player_;
+  size_t size_, index_;
+  Eigen::Vector2d axle_, pen_;
+  Eigen::Vector2d min_, max_;
+  size_t header_len_, record_len_, footer_len_;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+
+#include <ESPAsyncWebServer.h>
+
+#include "estimator.h"
+#include "controller.h"
+#include "gcode_player.h"
+#include "motors.h"
+#include "step_replay.h"
+#include "telemetry_frame.h"
+
+// Push telemetry: while anyone is connected to the /telemetry WebSocket, a
+// TelemetryFrame goes out every telemetry_period_ms.  A client sets the
+// period by sending it as a text message ("50"); "0" stops the stream.
+// Nothing is built or sent without subscribers.
+#define TELEMETRY_PATH "/telemetry"
+#define TELEMETRY_DEFAULT_MS 100
+#define TELEMETRY_MIN_MS 20
+
+AsyncWebSocket telemetry_ws(TELEMETRY_PATH);
+uint32_t telemetry_period_ms = TELEMETRY_DEFAULT_MS;
+uint32_t telemetry_last_ms = 0;
+uint16_t telemetry_seq = 0;
+
+void onTelemetryEvent(AsyncWebSocket* ws, AsyncWebSocketClient* client,
+                      AwsEventType type, void* arg, uint8_t* data, size_t len);
+TelemetryFrame telemetryFrame();
+
+void setupTelemetry() {
+  telemetry_ws.onEvent(onTelemetryEvent);
+  server.addHandler(&telemetry_ws);
+}
+
+void updateTelemetry() {
+  if (telemetry_ws.count() == 0 || telemetry_period_ms == 0) return;
+  if (millis() - telemetry_last_ms < telemetry_period_ms) return;
+  telemetry_last_ms = millis();
+  telemetry_ws.cleanupClients();
+  // A client that can't keep up just misses frames (seq shows the gap).
+  if (!telemetry_ws.availableForWriteAll()) return;
+  TelemetryFrame frame = telemetryFrame();
+  telemetry_ws.binaryAll(reinterpret_cast<uint8_t*>(&frame), sizeof(frame));
+}
+
+TelemetryFrame telemetryFrame() {
+  const State& state = estimator.state();
+  const Eigen::Vector2d setpoint = controller.setpoint();
+  TelemetryFrame f{};
+  f.version = TELEMETRY_VERSION;
+  f.seq = telemetry_seq++;
+  f.ms = millis();
+  f.x = lround(state.x * 100);
+  f.y = lround(state.y * 100);
+  f.cos = lround(state.cos * 32767);
+  f.sin = lround(state.sin * 32767);
+  f.sx = lround(setpoint(0) * 100);
+  f.sy = lround(setpoint(1) * 100);
+  if (step_replay.isLoaded()) {
+    f.flags |= TELEMETRY_REPLAY;
+    f.index = step_replay.tick();
+    f.size = step_replay.numTicks();
+    if (step_replay.isPlaying()) f.flags |= TELEMETRY_PLAYING;
+  } else {
+    f.index = gcode_player.index();
+    f.size = gcode_player.size();
+    if (gcode_player.isPlaying() && !gcode_player.isFinished()) {
+      f.flags |= TELEMETRY_PLAYING;
+    }
+    if (gcode_player.isUploading()) f.flags |= TELEMETRY_UPLOADING;
+  }
+  f.percent = f.size ? std::min<uint32_t>(10000, 10000ull * f.index / f.size) : 0;
+  f.queue = std::min<long>(65535, std::max(labs(stepper1.distanceToGo()),
+                                           labs(stepper2.distanceToGo())));
+  if (servo_target == SERVO_DOWN_ANGLE) f.flags |= TELEMETRY_PEN_DOWN;
+  if (motors_disabled) f.flags |= TELEMETRY_MOTORS_DISABLED;
+  return f;
+}
+
+void onTelemetryEvent(AsyncWebSocket* ws, AsyncWebSocketClient* client,
+                      AwsEventType type, void* arg, uint8_t* data, size_t len) {
+  (void)ws;
+  if (type == WS_EVT_CONNECT) {
+    WebSerial.printf("Telemetry client %u connected.\n", client->id());
+    telemetry_last_ms = millis() - telemetry_period_ms;  // Send one right away
+  } else if (type == WS_EVT_DATA) {
+    const AwsFrameInfo* info = static_cast<AwsFrameInfo*>(arg);
+    if (!info->final || info->index != 0 || info->len != len ||
+        info->opcode != WS_TEXT) {
+      return;
+    }
+    std::string_view text(reinterpret_cast<const char*>(data), len);
+    uint32_t period_ms;
+    if (parseNumbers(text, period_ms)) {
+      telemetry_period_ms =
+          period_ms == 0 ? 0 : std::max<uint32_t>(TELEMETRY_MIN_MS, period_ms);
+    }
+  }
+}
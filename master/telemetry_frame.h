@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Binary status frame pushed to /telemetry WebSocket subscribers (see
+// telemetry.h).  Fixed layout, little-endian, no padding, so a client can
+// decode it with nothing but this header.
+
+#define TELEMETRY_VERSION 1
+
+enum TelemetryFlags : uint8_t {
+  TELEMETRY_PEN_DOWN = 1 << 0,         // Servo commanded down
+  TELEMETRY_PLAYING = 1 << 1,          // Program or step stream running
+  TELEMETRY_REPLAY = 1 << 2,           // index/size count step stream ticks
+  TELEMETRY_MOTORS_DISABLED = 1 << 3,  // 'P0'
+  TELEMETRY_UPLOADING = 1 << 4,
+};
+
+struct __attribute__((packed)) TelemetryFrame {
+  uint8_t version;
+  uint8_t flags;       // TelemetryFlags
+  uint16_t seq;        // Wraps; gaps mean dropped frames
+  uint32_t ms;         // millis()
+  int32_t x, y;        // Axle position, 1/100 unit
+  int16_t cos, sin;    // Heading, 1/32767
+  int32_t sx, sy;      // Controller setpoint, 1/100 unit
+  uint32_t index;      // Current command (or tick)
+  uint32_t size;       // Program commands (or ticks)
+  uint16_t percent;    // Complete, 1/100 %
+  uint16_t queue;      // Wheel steps still queued (the larger wheel)
+};
+static_assert(sizeof(TelemetryFrame) == 40, "TelemetryFrame layout changed");
+
+namespace telemetry {
+
+inline bool decode(const uint8_t* data, size_t len, TelemetryFrame& frame) {
+  if (len != sizeof(TelemetryFrame) || data[0] != TELEMETRY_VERSION) return false;
+  memcpy(&frame, data, sizeof(frame));
+  return true;
+}
+
+// One line of text, for clients and logs.
+inline int format(const TelemetryFrame& f, char* buf, size_t max_chars) {
+  return snprintf(buf, max_chars,
+                  "%5u %9.3fs pose (%8.2f, %8.2f) heading (%+.4f, %+.4f) "
+                  "setpoint (%8.2f, %8.2f) %s %u/%u %6.2f%% queue %u pen %s%s%s%s\n",
+                  f.seq, f.ms / 1e3, f.x / 100.0, f.y / 100.0, f.cos / 32767.0,
+                  f.sin / 32767.0, f.sx / 100.0, f.sy / 100.0,
+                  f.flags & TELEMETRY_REPLAY ? "tick" : "cmd", f.index, f.size,
+                  f.percent / 100.0, f.queue,
+                  f.flags & TELEMETRY_PEN_DOWN ? "down" : "up",
+                  f.flags & TELEMETRY_PLAYING ? " playing" : "",
+                  f.flags & TELEMETRY_MOTORS_DISABLED ? " disabled" : "",
+                  f.flags & TELEMETRY_UPLOADING ? " uploading" : "");
+}
+
+}  // namespace telemetry
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cmath>
+
+#include <ArduinoEigen.h>
+#include <WebSerial.h>
+
+#include "fixed_format.h"
+#include "kinematics.h"
+#include "motion_params.h"
+#include "move_timing.h"
+#include "step_mode.h"
+
+void moveWheelsTo(long s1, long s2);
+
+// Pen-up travel as explicit wheel motions instead of letting the controller
+// steer the pen straight at the target.  With the pen LENGTH ahead of the
+// axle, the controller's path to a point behind the robot can be a long swing.
+//
+// A plan ends with the pen on the target and some heading phi, i.e. the axle
+// at  target - L * (cos phi, sin phi).  For each candidate phi the search
+// tries, forwards and in reverse:
+//   TURN_STRAIGHT_TURN  turn in place to face the axle goal, drive to it,
+//                       turn in place to phi
+//   ARC_TURN            the one arc tangent to the current heading that ends
+//                       on the axle goal, then turn in place to phi
+// Each segment is timed as one moveWheelsTo, from a standstill to a
+// standstill at the pen-up step rate and motion_params.acceleration.  (With
+// only wheel speed bounded, turns in place and straights are enough for the
+// optimum; the arc saves a segment.)  The alternative is the controller
+// steering the pen straight at the target (STEER), timed by MoveTiming as
+// ProgramAnalysis times it.  Steering turns and drives at once and keeps
+// the wheels going between commands, so it is usually as quick, and
+// planning is off by default: a plan replaces steering only if it is
+// TRAVEL_MIN_GAIN quicker.  phi is searched coarsely and then refined around
+// the best, a few samples per control tick, mostly while the pen lifts.
+#define TRAVEL_SAMPLES 32          // Coarse headings tried
+#define TRAVEL_REFINE 8            // Halvings of the step around the best
+#define TRAVEL_SAMPLES_PER_CALL 16 // Search spread over control ticks
+#define TRAVEL_SEGMENT_MS 20       // Lost per segment handing over to the next
+#define TRAVEL_MIN_GAIN 0.02       // Fraction of the steered time a plan must save
+
+// Set with the 'V' WebSerial command.
+struct TravelSettings {
+  bool plan = false;            // Plan pen-up moves (else the controller steers)
+  bool orient_strokes = false;  // Pick stroke directions on load
+
+  void print() const {
+    WebSerial.printf(R"(
+Travel:
+  V%d,%d
+  (plan pen-up moves, pick stroke directions on load)
+)",
+                     plan, orient_strokes);
+  }
+};
+
+TravelSettings travel_settings{};
+
+struct TravelPlan {
+  enum Shape : uint8_t { TURN_STRAIGHT_TURN, ARC_TURN, STEER };
+
+  Shape shape = STEER;
+  bool reverse = false;
+  uint8_t num_segments = 0;
+  // Wheel travel (right, left) in units
+  Eigen::Vector2d segments[3] = {Eigen::Vector2d::Zero(), Eigen::Vector2d::Zero(),
+                                 Eigen::Vector2d::Zero()};
+  double time_s = INFINITY;
+  State end{};  // Pose afterwards
+};
+
+class TravelSearch {
+ public:
+  void begin(const State& from, const Eigen::Vector2d& target) {
+    from_ = from;
+    target_ = target;
+    const Eigen::Vector2d to_target = target - Eigen::Vector2d(from.x, from.y);
+    // Sample 0 is the pen arriving along the line from the axle.
+    phi0_ = std::atan2(to_target(1), to_target(0));
+    sample_ = 0;
+    best_ = TravelPlan{};
+    best_phi_ = phi0_;
+    steer_ = TravelPlan{};
+    steer_.end = from;
+    MoveTiming timing;  // From a standstill: the pen has just lifted
+    steer_.time_s = timing.steer(steer_.end, target, step_mode.maxUnitsPerS(false));
+  }
+
+  // Tries up to `samples` more headings.  Returns true once the search is
+  // done.
+  bool step(int samples) {
+    constexpr int kTotal = TRAVEL_SAMPLES + 2 * TRAVEL_REFINE;
+    for (; samples > 0 && sample_ < kTotal; --samples, ++sample_) {
+      if (sample_ < TRAVEL_SAMPLES) {
+        tryHeading(phi0_ + 2 * M_PI * sample_ / TRAVEL_SAMPLES);
+      } else {
+        const int k = sample_ - TRAVEL_SAMPLES;
+        const double delta = M_PI / TRAVEL_SAMPLES / (1 << (k / 2));
+        tryHeading(best_phi_ + (k % 2 ? delta : -delta));
+      }
+    }
+    return sample_ >= kTotal;
+  }
+
+  // The best plan, or STEER unless it gains enough on steering.
+  const TravelPlan& plan() const {
+    return best_.time_s < (1 - TRAVEL_MIN_GAIN) * steer_.time_s ? best_ : steer_;
+  }
+
+  // Full search, for load-time use.
+  const TravelPlan& solve(const State& from, const Eigen::Vector2d& target) {
+    begin(from, target);
+    while (!step(TRAVEL_SAMPLES + 2 * TRAVEL_REFINE)) {
+    }
+    return plan();
+  }
+
+ private:
+  static double wrap(double angle) { return std::remainder(angle, 2 * M_PI); }
+  static Eigen::Vector2d turn(double angle) {
+    return Eigen::Vector2d(1, -1) * angle * Robot::half_width_unit;
+  }
+
+  void tryHeading(double phi) {
+    const Eigen::Vector2d heading(std::cos(phi), std::sin(phi));
+    const Eigen::Vector2d axle = target_ - heading * Robot::length_unit;
+    const Eigen::Vector2d c = axle - Eigen::Vector2d(from_.x, from_.y);
+    const double d = c.norm();
+    const double theta0 = std::atan2(from_.sin, from_.cos);
+
+    TravelPlan plan;
+    plan.end = State{axle(0), axle(1), heading(0), heading(1)};
+    if (d < 0.5 * Robot::units_per_step) {
+      consider(plan, {turn(wrap(phi - theta0))}, phi);
+      return;
+    }
+    for (const int sign : {1, -1}) {
+      plan.reverse = sign < 0;
+
+      const double psi = std::atan2(sign * c(1), sign * c(0));
+      plan.shape = TravelPlan::TURN_STRAIGHT_TURN;
+      consider(plan,
+               {turn(wrap(psi - theta0)), Eigen::Vector2d::Constant(sign * d),
+                turn(wrap(phi - psi))},
+               phi);
+
+      // Arc tangent to the heading: the chord makes half the turn angle.
+      const Eigen::Vector2d h(sign * from_.cos, sign * from_.sin);
+      const double along = c.dot(h), across = h(0) * c(1) - h(1) * c(0);
+      const double sweep = 2 * std::atan2(across, along);
+      if (std::abs(sweep) > 1.5 * M_PI) continue;  // Loops right round: never best
+      const double length =
+          std::abs(sweep) < 1e-9 ? along : d * (sweep / 2) / std::sin(sweep / 2);
+      plan.shape = TravelPlan::ARC_TURN;
+      consider(plan,
+               {Eigen::Vector2d::Constant(sign * length) + turn(sweep),
+                turn(wrap(phi - theta0 - sweep))},
+               phi);
+    }
+  }
+
+  void consider(TravelPlan plan, std::initializer_list<Eigen::Vector2d> segments,
+                double phi) {
+    const double speed = step_mode.maxUnitsPerS(false);
+    plan.num_segments = 0;
+    plan.time_s = 0;
+    for (const auto& dq : segments) {
+      const double most = dq.cwiseAbs().maxCoeff();
+      if (most < 0.5 * Robot::units_per_step) continue;
+      plan.segments[plan.num_segments++] = dq;
+      plan.time_s += stoppingMoveTime(most, speed) + TRAVEL_SEGMENT_MS / 1e3;
+    }
+    if (plan.time_s < best_.time_s) {
+      best_ = plan;
+      best_phi_ = phi;
+    }
+  }
+
+  State from_;
+  Eigen::Vector2d target_;
+  double phi0_ = 0, best_phi_ = 0;
+  int sample_ = 0;
+  TravelPlan best_;
+  TravelPlan steer_;  // The controller's move, for comparison
+};
+
+// Runs plans on the robot.  The search starts when the player begins lifting
+// the pen and the move when it calls go(); until then the controller keeps
+// the wheels.  Segments are sent as absolute wheel targets from where the
+// wheels were when planning started, one when the last has finished; that
+// start is kept in units, as the step mode may change before the move.
+class TravelPlanner {
+ public:
+  void begin(const State& from, const Eigen::Vector2d& target) {
+    search_.begin(from, target);
+    phase_ = PLANNING;
+    go_ = false;
+    have_start_ = false;
+  }
+  void go() { go_ = phase_ != IDLE; }
+  void cancel() { phase_ = IDLE; }
+  // Owns (or is about to own) the wheels.
+  bool isMoving() const { return phase_ != IDLE && go_; }
+  // On the segment that brings the pen to the target: the pen can go down as
+  // soon as it is close enough, as with the controller.
+  bool isArriving() const {
+    return phase_ == MOVING && segment_ == search_.plan().num_segments;
+  }
+
+  // Call every control tick with the wheel positions.  Returns true while the
+  // controller should leave the wheels alone.
+  bool update(long cur_s1, long cur_s2) {
+    switch (phase_) {
+      case IDLE:
+        return false;
+      case PLANNING:
+        if (!have_start_) {
+          start_ = Eigen::Vector2d(cur_s1, cur_s2) * step_mode.unitsPerStep();
+          have_start_ = true;
+        }
+        if (search_.step(TRAVEL_SAMPLES_PER_CALL) && go_) {
+          const TravelPlan& plan = search_.plan();
+          ++plans_;
+          ++shapes_[plan.shape][plan.reverse];
+          planned_s_ += plan.time_s;
+          if (plan.shape == TravelPlan::STEER) {  // Controller's move after all
+            phase_ = IDLE;
+            return false;
+          }
+          phase_ = MOVING;
+          segment_ = 0;
+          travelled_ = Eigen::Vector2d::Zero();
+          nextSegment();
+        }
+        return go_;
+      case MOVING:
+        if (cur_s1 == target1_ && cur_s2 == target2_) nextSegment();
+        return phase_ == MOVING;
+    }
+    return false;
+  }
+
+  void print() const {
+    char buf[128 + 6 * Unsigned<>::kMaxChars + Fixed<1>::kMaxChars];
+    TextWriter out(buf, sizeof(buf));
+    out << "\nTravel plans: " << Unsigned<>(plans_) << ", " << Fixed<1>(planned_s_)
+        << "s planned\n  turn-straight-turn: " << Unsigned<>(shapes_[0][0]) << " forward, "
+        << Unsigned<>(shapes_[0][1]) << " reverse\n  arc-turn:           "
+        << Unsigned<>(shapes_[1][0]) << " forward, " << Unsigned<>(shapes_[1][1])
+        << " reverse\n  controller steers:  " << Unsigned<>(shapes_[2][0]) << "\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(buf), out.length());
+  }
+
+ private:
+  enum Phase : uint8_t { IDLE, PLANNING, MOVING };
+
+  void nextSegment() {
+    const TravelPlan& plan = search_.plan();
+    if (segment_ >= plan.num_segments) {
+      phase_ = IDLE;
+      return;
+    }
+    travelled_ += plan.segments[segment_++];
+    const Eigen::Vector2d target = (start_ + travelled_) * step_mode.stepsPerUnit();
+    target1_ = std::lround(target(0));
+    target2_ = std::lround(target(1));
+    moveWheelsTo(target1_, target2_);
+  }
+
+  TravelSearch search_;
+  Phase phase_ = IDLE;
+  bool go_ = false;
+  bool have_start_ = false;
+  Eigen::Vector2d start_ = Eigen::Vector2d::Zero();  // Wheel positions, units
+  long target1_ = 0, target2_ = 0;
+  uint8_t segment_ = 0;
+  Eigen::Vector2d travelled_ = Eigen::Vector2d::Zero();
+  uint32_t plans_ = 0;
+  uint32_t shapes_[3][2] = {};
+  double planned_s_ = 0;
+};
+
+TravelPlanner travel_planner;
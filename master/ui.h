@@ -1,10 +1,16 @@
 #pragma once
 
 #include "gcode_player.h"
+#include "input_recorder.h"
+#include "step_replay.h"
+#include "svg_preview.h"
 
 void handleFileUpload(AsyncWebServerRequest* request, String filename,
                       size_t index, uint8_t* data, size_t len, bool final);
 void handlePrintGcode(AsyncWebServerRequest* request);
+void handleAnalysis(AsyncWebServerRequest* request);
+void handleInputLog(AsyncWebServerRequest* request);
+void handlePreview(AsyncWebServerRequest* request);
 
 static const auto kUploadPage PROGMEM = R"rawliteral(
 <!DOCTYPE html>
@@ -21,10 +27,10 @@ static const auto kUploadPage PROGMEM = R"rawliteral(
 <body>
   <h1>DoodleBot Gcode Upload</h1>
   <form action="/upload" method="post" enctype="multipart/form-data">
-    <input type="file" name="file" accept=".gcode,.gz" required>
+    <input type="file" name="file" accept=".gcode,.hpgl,.plt,.gz,.dbs" required>
     <input type="submit" value="Upload">
   </form>
-  <p>Upload a gcode file to the DoodleBot!  Accepted file types: .gcode, .gz</p>
+  <p>Upload a gcode file to the DoodleBot!  Accepted file types: .gcode, .hpgl/.plt (HPGL), .gz, .dbs (precompiled step stream)</p>
 </body>
 </html>
 )rawliteral";
@@ -99,6 +105,9 @@ class LineByLineParser {
 
 LineByLineParser gcode_line_parser(
     [](std::string_view line) { gcode_player.loadLine(line); }, '\n');
+// HPGL uploads (detected on the first chunk) bypass the line splitter: the
+// player's HPGL parser takes chunks split anywhere.
+bool hpgl_upload = false;
 
 void setupUi() {
   server.on("/upload", HTTP_GET, [](AsyncWebServerRequest* request) {
@@ -115,12 +124,16 @@ void setupUi() {
     request->send(200, "text/html", kSuccessPage);
   });
   server.on("/print", HTTP_GET, handlePrintGcode);
+  server.on("/analysis", HTTP_GET, handleAnalysis);
+  server.on("/inputs.log", HTTP_GET, handleInputLog);
+  server.on("/preview.svg", HTTP_GET, handlePreview);
 }
 
 void updateUi() {}
 
 void handleFileUpload(AsyncWebServerRequest* request, String filename,
                       size_t index, uint8_t* data, size_t len, bool final) {
+  input_recorder.recordUpload(index, data, len, final);
   WebSerial.printf("Received chunk %zu of %zu bytes.  Final? %d\n", index, len,
                    final);
 
@@ -129,13 +142,31 @@ void handleFileUpload(AsyncWebServerRequest* request, String filename,
 
   // Initialize on first chunk
   if (!index) {
-    gcode_player.startUpload();
+    if (step_stream::isStepStream(data, len)) {
+      step_replay.startUpload();
+    } else {
+      step_replay.unload();
+      gcode_player.startUpload();
+      hpgl_upload = HpglParser::isHpgl(
+          std::string_view(reinterpret_cast<const char*>(data), len));
+    }
   }
 
   // Handle reading
-  if (gcode_player.isUploading()) {
+  if (step_replay.isUploading()) {
+    step_replay.appendUpload(data, len);
+    if (final) {
+      step_replay.endUpload();
+      request->redirect("/success.html");
+    }
+    return;
+  } else if (gcode_player.isUploading()) {
     std::string_view input(reinterpret_cast<const char*>(data), len);
-    gcode_line_parser.parseContent(input);
+    if (hpgl_upload) {
+      gcode_player.loadHpgl(input);
+    } else {
+      gcode_line_parser.parseContent(input);
+    }
   } else {
     request->send(500, "text/plain",
                   "500: Upload not started, cannot write data");
@@ -166,5 +197,43 @@ void handlePrintGcode(AsyncWebServerRequest* request) {
       });
   // Don't download as a file.  Instead, display in browser:
   response->addHeader("X-Content-Type-Options", "nosniff");
+  char est_time_s[Fixed<1>::kMaxChars + 1];
+  TextWriter out(est_time_s, sizeof(est_time_s));
+  out << Fixed<1>(gcode_player.analysis().timeMs() / 1000.0);
+  response->addHeader("X-Estimated-Time-S", est_time_s);
+  request->send(response);
+}
+
+// Job statistics for the loaded program, as JSON.
+void handleAnalysis(AsyncWebServerRequest* request) {
+  char buf[ProgramAnalysis::kJsonMaxChars];
+  gcode_player.analysis().toJson(buf, sizeof(buf), gcode_player.stored());
+  request->send(200, "application/json", buf);
+}
+
+// Downloads the input recording (see input_recorder.h) as far as it has got:
+// recording carries on until Q0.
+void handleInputLog(AsyncWebServerRequest* request) {
+  const size_t size = input_recorder.snapshot();
+  auto* response = request->beginChunkedResponse(
+      "application/octet-stream",
+      [size](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        if (index >= size) return 0;
+        File file = LittleFS.open(INPUT_LOG_PATH, "r");
+        if (!file || !file.seek(index)) return 0;
+        return file.read(buffer, std::min(maxLen, size - index));
+      });
+  request->send(response);
+}
+
+// The loaded program as an SVG (see svg_preview.h), with the robot's pose and
+// progress as of the request.
+void handlePreview(AsyncWebServerRequest* request) {
+  const SvgPreview preview(gcode_player, estimator.state());
+  auto* response = request->beginChunkedResponse(
+      "image/svg+xml",
+      [preview](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        return preview.fill(reinterpret_cast<char*>(buffer), maxLen, index);
+      });
   request->send(response);
 }
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WebSerial.h>
+
+#include "fixed_format.h"
+#include "motors.h"
+#include "ota_delta.h"
+
+// Warm restart: snapshots of what a reset loses -- pose, wheel step counts,
+// controller setpoint, step mode, pen and where the player is -- so that
+// after an OTA update, a watchdog reset or a crash the robot carries on
+// without being re-homed.  The program itself is already kept in flash (see
+// ProgramPlayer).
+//
+// Snapshots go to RTC memory, which survives a reset but not a power cut,
+// every SNAPSHOT_RTC_MS while anything changes, above the first 32 blocks:
+// those hold the core's eboot command, which tells the bootloader to copy in
+// an image from an OTA update.  They go to flash, for the
+// next power-up, once the robot rests with no job playing (at most every
+// SNAPSHOT_FLASH_MS) and before an OTA restart; one taken mid-job would be
+// stale by the time the power went, so a flash snapshot of a job playing is
+// only trusted alongside its RTC copy.  Flash snapshots rotate over
+// SNAPSHOT_SLOTS files, so that a write cut short never takes the last good
+// snapshot with it and no one file takes all the erases.
+//
+// Once an update is committed, snapshots stop until the restart, but for
+// the one taken for it.
+//
+// At boot the newest valid snapshot is restored: the pose at once, and a job
+// that was playing as the resume point for 'J', or straight away after an OTA
+// restart.  The pen comes back up.
+//
+// Format: a SnapshotHeader, then a Snapshot.  Fields are only ever added at
+// the end of Snapshot, with a new SNAPSHOT_VERSION: a snapshot from older
+// firmware restores the fields it has and leaves the rest at their defaults,
+// and one from newer firmware restores the fields this one knows.
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RTC_MS 20
+#define SNAPSHOT_FLASH_MS 10000
+#define SNAPSHOT_SLOTS 4
+#define SNAPSHOT_PATH "/snapshot%u.bin"
+#define SNAPSHOT_RTC_BLOCK 32  // Offset into RTC user memory, 4-byte blocks
+
+constexpr char SNAPSHOT_MAGIC[4] = {'D', 'B', 'W', 'R'};
+
+struct SnapshotHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t size;      // Of the Snapshot that follows
+  uint32_t sequence;  // The newest valid snapshot wins
+  uint32_t crc;       // Of the Snapshot
+};
+
+struct Snapshot {
+  // Version 1
+  double x = 0, y = 0, cos = 1, sin = 0;  // Estimator pose
+  double q[2] = {0, 0};                   // Wheel positions it last saw, units
+  double setpoint[2] = {0, 0};
+  int32_t steps[2] = {0, 0};  // Wheel positions, in steps of the mode below
+  uint32_t generation = 0;    // Program `index` is in
+  uint32_t index = 0;
+  uint8_t half_steps = 0;
+  uint8_t step_setting = STEP_MODE_FULL;
+  uint8_t pen_down = 0;
+  uint8_t playing = 0;
+  uint8_t restart = 0;  // Taken for a planned restart
+  uint8_t reserved[3] = {0, 0, 0};
+};
+
+class WarmRestart {
+ public:
+  static constexpr size_t kMaxBytes = sizeof(SnapshotHeader) + sizeof(Snapshot);
+
+  // Writes `snapshot` to `buf` (kMaxBytes) and returns the bytes written.
+  static size_t encode(const Snapshot& snapshot, uint32_t sequence, uint8_t* buf) {
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.size = sizeof(Snapshot);
+    header.sequence = sequence;
+    header.crc = ota_delta::crc32(0, reinterpret_cast<const uint8_t*>(&snapshot),
+                                  sizeof(Snapshot));
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), &snapshot, sizeof(Snapshot));
+    return kMaxBytes;
+  }
+
+  // Reads a snapshot of any version.  Returns false if it isn't a whole,
+  // intact one.
+  static bool decode(const uint8_t* buf, size_t len, Snapshot& snapshot,
+                     SnapshotHeader& header) {
+    if (len < sizeof(header)) return false;
+    memcpy(&header, buf, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.size > len - sizeof(header) ||
+        ota_delta::crc32(0, buf + sizeof(header), header.size) != header.crc) {
+      return false;
+    }
+    snapshot = Snapshot();
+    memcpy(&snapshot, buf + sizeof(header), std::min<size_t>(header.size, sizeof(Snapshot)));
+    return true;
+  }
+
+  // The file of flash slot `slot`.
+  static const char* path(uint8_t slot) {
+    static char buf[24];
+    snprintf(buf, sizeof(buf), SNAPSHOT_PATH, slot);
+    return buf;
+  }
+
+  // Call at boot, once the program is loaded.
+  bool restore() {
+    Snapshot snapshot;
+    SnapshotHeader header{};
+    bool found = false;
+    uint8_t buf[kMaxBytes + 64];  // Room for a newer version's extra fields
+    auto consider = [&](size_t len, const char* from) {
+      Snapshot s;
+      SnapshotHeader h;
+      if (!decode(buf, len, s, h) || (found && h.sequence <= header.sequence)) return;
+      snapshot = s;
+      header = h;
+      found = true;
+      from_ = from;
+    };
+    uint32_t words[sizeof(buf) / 4];
+    if (ESP.rtcUserMemoryRead(SNAPSHOT_RTC_BLOCK, words, sizeof(words))) {
+      memcpy(buf, words, sizeof(buf));
+      consider(sizeof(buf), kFromRtc);
+    }
+    uint32_t newest_in_flash = 0;
+    for (uint8_t slot = 0; slot < SNAPSHOT_SLOTS; ++slot) {
+      File file = LittleFS.open(path(slot), "r");
+      if (!file) continue;
+      const size_t len = file.read(buf, sizeof(buf));
+      Snapshot s;
+      SnapshotHeader h;
+      if (decode(buf, len, s, h) && h.sequence >= newest_in_flash) {
+        newest_in_flash = h.sequence;
+        slot_ = (slot + 1) % SNAPSHOT_SLOTS;  // Rotation carries on after it
+      }
+      consider(len, kFromFlash);
+    }
+    if (!found) return false;
+    sequence_ = header.sequence;
+    const bool from_rtc = from_ == kFromRtc;
+    if (snapshot.playing && !from_rtc && !snapshot.restart) {
+      WebSerial.printf("Snapshot in flash is from mid-job: not restored.\n");
+      return false;
+    }
+    restored_ = true;
+    apply(snapshot);
+    last_ = snapshot;
+    if (!from_rtc) flash_ = snapshot;
+    // from_ is "RTC memory" or "flash"
+    char line[56 + Unsigned<>::kMaxChars + 2 * Fixed<2>::kMaxChars];
+    TextWriter out(line, sizeof(line));
+    out << "Warm restart from " << from_ << " (snapshot v" << Unsigned<>(header.version)
+        << "): pen at (" << Fixed<2>(estimator.state().pen()(0)) << ", "
+        << Fixed<2>(estimator.state().pen()(1)) << ")\n";
+    WebSerial.write(reinterpret_cast<const uint8_t*>(line), out.length());
+    if (!snapshot.playing || snapshot.generation != gcode_player.generation() ||
+        snapshot.index >= gcode_player.size()) {
+      return true;
+    }
+    gcode_player.saveResumePoint(snapshot.index);
+    if (snapshot.restart) {
+      gcode_player.resume(snapshot.index);
+    } else {
+      WebSerial.printf("Job stopped at command %u: J to resume.\n", snapshot.index);
+    }
+    return true;
+  }
+
+  // Takes a snapshot, to flash as well if `flash`.  `restart`: a planned
+  // restart follows, and the job is to carry on after it; nothing more is
+  // written until then.
+  void save(bool flash, bool restart = false) {
+    if (!enabled) return;
+    held_ |= restart;
+    Snapshot snapshot = capture();
+    snapshot.restart = restart;
+    const uint32_t start_us = micros();
+    alignas(4) uint8_t buf[(kMaxBytes + 3) / 4 * 4] = {};
+    const size_t len = encode(snapshot, ++sequence_, buf);
+    ESP.rtcUserMemoryWrite(SNAPSHOT_RTC_BLOCK, reinterpret_cast<uint32_t*>(buf), sizeof(buf));
+    ++rtc_writes_;
+    last_ = snapshot;
+    if (flash) {
+      File file = LittleFS.open(path(slot_), "w");
+      slot_ = (slot_ + 1) % SNAPSHOT_SLOTS;
+      file.write(buf, len);
+      file.close();
+      ++flash_writes_;
+      flash_ = snapshot;
+      flash_ms_ = millis();
+    }
+    last_us_ = micros() - start_us;
+  }
+
+  // Call every SNAPSHOT_RTC_MS.  Nothing is written while nothing changes.
+  void update() {
+    if (!enabled || held_) return;
+    const Snapshot snapshot = capture();
+    if (memcmp(&snapshot, &last_, sizeof(Snapshot)) != 0) {
+      save(false);
+    } else if (!snapshot.playing && memcmp(&snapshot, &flash_, sizeof(Snapshot)) != 0 &&
+               millis() - flash_ms_ >= SNAPSHOT_FLASH_MS) {
+      save(true);  // At rest since the last update
+    }
+  }
+
+  // Forgets every snapshot, e.g. after moving the robot by hand.
+  void discard() {
+    const uint32_t zeros[(kMaxBytes + 3) / 4] = {};
+    ESP.rtcUserMemoryWrite(SNAPSHOT_RTC_BLOCK, const_cast<uint32_t*>(zeros), sizeof(zeros));
+    for (uint8_t slot = 0; slot < SNAPSHOT_SLOTS; ++slot) LittleFS.remove(path(slot));
+    last_ = flash_ = Snapshot();
+  }
+
+  // Stops the periodic snapshots once an update is committed (the restart's
+  // own snapshot still goes out with save(true, true)), or lets them carry on
+  // after an update failed.
+  void hold(bool on = true) { held_ = on; }
+
+  uint32_t rtcWrites() const { return rtc_writes_; }
+  uint32_t flashWrites() const { return flash_writes_; }
+  uint32_t lastWriteUs() const { return last_us_; }
+  uint32_t sequence() const { return sequence_; }
+  bool restored() const { return restored_; }
+
+  void print() const {
+    WebSerial.printf(R"(
+Warm restart:
+  N%d
+  (1 snapshots on, 0 off and forget them)
+  %s, %u RTC writes, %u flash writes, last took %uus, sequence %u
+)",
+                     enabled, restored_ ? from_ : "cold boot", rtc_writes_, flash_writes_,
+                     last_us_, sequence_);
+  }
+
+  bool enabled = true;  // Set with the 'N' WebSerial command
+
+ private:
+  static constexpr const char* kFromRtc = "RTC memory";
+  static constexpr const char* kFromFlash = "flash";
+
+  static Snapshot capture() {
+    Snapshot s;
+    const auto& state = estimator.state();
+    s.x = state.x;
+    s.y = state.y;
+    s.cos = state.cos;
+    s.sin = state.sin;
+    s.q[0] = estimator.q()(0);
+    s.q[1] = estimator.q()(1);
+    s.setpoint[0] = controller.setpoint()(0);
+    s.setpoint[1] = controller.setpoint()(1);
+    s.steps[0] = stepper1.currentPosition();
+    s.steps[1] = stepper2.currentPosition();
+    s.generation = gcode_player.generation();
+    s.index = gcode_player.index();
+    s.half_steps = step_mode.half();
+    s.step_setting = step_mode.setting;
+    s.pen_down = servo_target == SERVO_DOWN_ANGLE;
+    s.playing = gcode_player.isPlaying() && !gcode_player.isFinished();
+    return s;
+  }
+
+  // The wheels are told where they are, in the mode they were in, so the
+  // coil phases carry on; the estimator takes up the steps it hadn't seen.
+  static void apply(const Snapshot& s) {
+    step_mode.setting = s.step_setting;
+    if (s.half_steps) {
+      stepper1.setHalfStep(true);
+      stepper2.setHalfStep(true);
+      step_mode.switched(true);
+      applyMotionParams();
+    }
+    stepper1.setCurrentPosition(s.steps[0]);
+    stepper2.setCurrentPosition(s.steps[1]);
+    estimator.setState(Estimator::State{s.x, s.y, s.cos, s.sin}, Q(s.q[0], s.q[1]));
+    controller.setSetpoint(Eigen::Vector2d(s.setpoint[0], s.setpoint[1]));
+  }
+
+  uint32_t sequence_ = 0;
+  uint8_t slot_ = 0;  // Flash slot the next write goes to
+  Snapshot last_, flash_;  // Last written to RTC memory, to flash
+  uint32_t flash_ms_ = 0;
+  uint32_t rtc_writes_ = 0, flash_writes_ = 0;
+  uint32_t last_us_ = 0;
+  bool restored_ = false;
+  bool held_ = false;
+  const char* from_ = "";
+};
+
+static_assert((SNAPSHOT_RTC_BLOCK * 4 + WarmRestart::kMaxBytes + 64 + 3) / 4 <= RESUME_RTC_BLOCK,
+              "Snapshots, with room for newer ones, end before the resume point");
+
+WarmRestart warm_restart;
+
+void updateWarmRestart() { warm_restart.update(); }
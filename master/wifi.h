@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+
 #include <ESP8266WiFi.h>
 #include <ESPAsyncWebServer.h>
+#include <WebSerial.h>
 
 #include "secrets.h"  // Define wifi credentials here or in secrets.h
 
@@ -15,22 +18,101 @@ const char* password = STAPSK;
 
 AsyncWebServer server(80);
 
-void setupWifi() {
-  WiFi.mode(WIFI_STA);
-  WiFi.hostname("doodlebot");
-  WiFi.begin(ssid, password);
-
-  while (WiFi.waitForConnectResult() != WL_CONNECTED) {
-    // Serial.println("Connection Failed! Rebooting...");
-    delay(5000);
-    ESP.restart();
+// Connects in the background, so that the robot boots and draws a stored
+// program whether or not the access point is there.  An attempt that hasn't
+// connected after WIFI_ATTEMPT_MS is abandoned, and the next one waits twice
+// as long as the last, from WIFI_RETRY_MIN_MS up to WIFI_RETRY_MAX_MS.  A lost
+// link is retried at once.  The web server starts on the first connection.
+#define WIFI_ATTEMPT_MS 15000
+#define WIFI_RETRY_MIN_MS 1000
+#define WIFI_RETRY_MAX_MS 60000
+
+class WifiLink {
+ public:
+  void begin() {
+    WiFi.mode(WIFI_STA);
+    WiFi.hostname("doodlebot");
+    attempt(millis());
+  }
+
+  void update() {
+    const uint32_t now = millis();
+    switch (state_) {
+      case CONNECTING:
+        if (WiFi.status() == WL_CONNECTED) {
+          connected(now);
+        } else if (now - since_ms_ >= WIFI_ATTEMPT_MS) {
+          WiFi.disconnect();
+          state_ = WAITING;
+          since_ms_ = now;
+        }
+        break;
+      case WAITING:
+        if (now - since_ms_ >= retry_ms_) {
+          retry_ms_ = std::min<uint32_t>(2 * retry_ms_, WIFI_RETRY_MAX_MS);
+          attempt(now);
+        }
+        break;
+      case CONNECTED:
+        if (WiFi.status() != WL_CONNECTED) {
+          ++drops_;
+          attempt(now);
+        }
+        break;
+    }
+  }
+
+  bool isConnected() const { return state_ == CONNECTED; }
+  uint32_t attempts() const { return attempts_; }
+  uint32_t drops() const { return drops_; }
+  // When the link first came up, 0 if it hasn't.
+  uint32_t firstConnectedMs() const { return first_ms_; }
+
+  void print() const {
+    WebSerial.printf(R"(
+Wi-Fi: %s, first up after %lums, %u attempts, %u drops
+)",
+                     state_ == CONNECTED    ? "connected"
+                     : state_ == CONNECTING ? "connecting"
+                                            : "waiting to retry",
+                     static_cast<unsigned long>(first_ms_), attempts_, drops_);
   }
 
-  server.begin();
+ private:
+  enum State : uint8_t { CONNECTING, WAITING, CONNECTED };
 
+  void attempt(uint32_t now) {
+    WiFi.begin(ssid, password);
+    ++attempts_;
+    state_ = CONNECTING;
+    since_ms_ = now;
+  }
+
+  void connected(uint32_t now) {
+    state_ = CONNECTED;
+    retry_ms_ = WIFI_RETRY_MIN_MS;
+    if (first_ms_ == 0) {
+      first_ms_ = std::max<uint32_t>(now, 1);
+      server.begin();
+    }
+    WebSerial.printf("Wi-Fi connected after %u attempts, %lums after reset\n",
+                     attempts_, static_cast<unsigned long>(now));
+  }
+
+  State state_ = CONNECTING;
+  uint32_t since_ms_ = 0;
+  uint32_t retry_ms_ = WIFI_RETRY_MIN_MS;
+  uint32_t first_ms_ = 0;
+  uint32_t attempts_ = 0, drops_ = 0;
+};
+
+WifiLink wifi_link;
+
+void setupWifi() {
   server.onNotFound([](AsyncWebServerRequest* request) {
     request->send(404, "text/plain", "404: Not Found");
   });
+  wifi_link.begin();
 }
 
-void updateWifi() {}
+void updateWifi() { wifi_link.update(); }